@@ -9,15 +9,71 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+
+#ifdef CONFIG_TRACING
+#include <zephyr/tracing/tracing.h>
+#endif
+
+#ifdef CONFIG_OPENDOTT_HOT_PATH_RAMFUNC
+#include <zephyr/linker/section_tags.h>
+#endif
+
+#ifdef CONFIG_OPENDOTT_RAM_BANKS
+#include <zephyr/devicetree.h>
+#include <zephyr/linker/devicetree_regions.h>
+#endif
+
+/* Innermost pixel loops run from RAM in the release profile */
+#ifdef CONFIG_OPENDOTT_HOT_PATH_RAMFUNC
+#define OPENDOTT_RAMFUNC __ramfunc
+#else
+#define OPENDOTT_RAMFUNC
+#endif
+
+/* RAM bank placement (see the board DTS). Strip buffers are aligned to a
+ * bank each; neither region is zeroed at boot */
+#ifdef CONFIG_OPENDOTT_RAM_BANKS
+#define OPENDOTT_STRIP_RAM \
+    __attribute__((section(LINKER_DT_NODE_REGION_NAME(DT_NODELABEL(strip_ram)))))
+#define OPENDOTT_DECODE_RAM \
+    __attribute__((section(LINKER_DT_NODE_REGION_NAME(DT_NODELABEL(decode_ram)))))
+#define OPENDOTT_STRIP_ALIGN 8192
+#else
+#define OPENDOTT_STRIP_RAM
+#define OPENDOTT_DECODE_RAM
+#define OPENDOTT_STRIP_ALIGN 4
+#endif
 
 /* Display constants */
 #define DISPLAY_WIDTH  240
 #define DISPLAY_HEIGHT 240
 #define DISPLAY_BPP    2  /* RGB565 = 2 bytes per pixel */
 
+/* GC9A01 gamma registers 0xF0-0xF3 and their data length */
+#define DISPLAY_GAMMA_REGS  4
+#define DISPLAY_GAMMA_LEN   6
+
+/* Clockwise rotation of the picture, done by the panel (display.c) */
+enum display_rotation {
+    DISPLAY_ROTATION_0 = 0,
+    DISPLAY_ROTATION_90,
+    DISPLAY_ROTATION_180,
+    DISPLAY_ROTATION_270,
+    DISPLAY_ROTATION_COUNT,
+};
+
 /* Maximum image size (16MB external flash) */
 #define MAX_IMAGE_SIZE (16 * 1024 * 1024)
 
+/* Stored media is checksummed in extents of this size */
+#define STORAGE_EXTENT_SIZE 4096
+
+/* Media flags kept in each file's CRC sidecar */
+#define MEDIA_FLAG_CORRUPT  BIT(0)
+#define MEDIA_FLAG_DITHER   BIT(1)   /* Ordered dither when drawn */
+
 /* Error codes */
 enum opendott_error {
     OPENDOTT_OK = 0,
@@ -27,8 +83,88 @@ enum opendott_error {
     OPENDOTT_ERR_FLASH_READ = -4,
     OPENDOTT_ERR_NO_MEMORY = -5,
     OPENDOTT_ERR_DECODE_FAILED = -6,
+    OPENDOTT_ERR_CORRUPT = -7,
+};
+
+/* Idle-time storage compaction */
+enum storage_compact_state {
+    STORAGE_COMPACT_IDLE = 0,
+    STORAGE_COMPACT_MEASURE,
+    STORAGE_COMPACT_REWRITE,
+    STORAGE_COMPACT_PRE_ERASE,
+};
+
+struct storage_compact_status {
+    enum storage_compact_state state;
+    uint32_t files_done;
+    uint32_t blocks_pre_erased;
+    uint32_t free_extents;
+    uint32_t largest_free_extent;  /* In 4KB blocks */
+};
+
+/* Background integrity scrubbing */
+struct storage_scrub_status {
+    bool running;
+    uint32_t passes;
+    uint32_t files_checked;     /* In the current or last pass */
+    uint32_t extents_checked;
+    uint32_t corrupt_files;
+};
+
+/* GIF decoding */
+#define GIF_PALETTE_SIZE 256
+#define GIF_LZW_MAX_CODES 4096
+
+struct gif_info {
+    uint16_t width;
+    uint16_t height;
+    uint16_t frame_count;
+    uint16_t loop_count;        /* 0 = forever */
+};
+
+struct gif_frame_info {
+    uint32_t offset;            /* Of the image descriptor in the file */
+    uint16_t x, y, w, h;
+    uint16_t delay_ms;
+    uint8_t disposal;
+    uint8_t flags;
+    uint8_t transparent;
+    uint8_t lct_bits;           /* 0 when the frame uses the global table */
+    uint16_t reserved;
+} __packed;
+
+/* Preview thumbnails: THUMBNAIL_SIZE^2 RGB565 pixels, big-endian */
+#define THUMBNAIL_SIZE          60
+#define THUMBNAIL_BYTES         (THUMBNAIL_SIZE * THUMBNAIL_SIZE * 2)
+#define THUMBNAIL_FORMAT_RGB565 0
+
+/* Storage I/O tracing */
+enum storage_trace_op {
+    STORAGE_OP_OPEN = 0,
+    STORAGE_OP_READ,
+    STORAGE_OP_WRITE,
+    STORAGE_OP_CLOSE,
+    STORAGE_OP_STAT,
+    STORAGE_OP_FLASH_READ,
+    STORAGE_OP_FLASH_PROG,
+    STORAGE_OP_FLASH_ERASE,
+    STORAGE_OP_COUNT,
 };
 
+/* log2(us) buckets: bucket 19 collects everything from ~0.5s up */
+#define STORAGE_TRACE_BUCKETS 20
+
+/*
+ * Timeline markers for Zephyr tracing: SystemView on the device, CTF to a
+ * file on native_sim (tracing_*.conf). Start/end pairs share a prefix;
+ * names stay under 20 characters for CTF. No code without CONFIG_TRACING.
+ */
+#ifdef CONFIG_TRACING
+#define OPENDOTT_TRACE(name, arg0, arg1) sys_trace_named_event(name, arg0, arg1)
+#else
+#define OPENDOTT_TRACE(name, arg0, arg1) do { } while (0)
+#endif
+
 /* Image format detection */
 typedef enum {
     IMAGE_FORMAT_UNKNOWN = 0,
@@ -36,8 +172,151 @@ typedef enum {
     IMAGE_FORMAT_PNG,
     IMAGE_FORMAT_JPEG,
     IMAGE_FORMAT_BMP,
+    IMAGE_FORMAT_NATIVE,        /* Raw panel-order RGB565 frames */
 } image_format_t;
 
+/*
+ * Media pipeline: source -> decoder -> compositor -> sink
+ *
+ * Frames travel as strips of MEDIA_STRIP_LINES full-width rows of
+ * panel-order RGB565, through a fixed pool of strip buffers. The sink runs
+ * on its own thread, so the next strip is decoded while the last one is
+ * still being sent. Strip height and count are set in Kconfig.
+ */
+#define MEDIA_STRIP_LINES   CONFIG_OPENDOTT_STRIP_LINES
+#define MEDIA_STRIP_COUNT   CONFIG_OPENDOTT_STRIP_COUNT
+#define MEDIA_MAX_OVERLAYS  4
+
+/* Static RAM that the Kconfig sizing options control: the strip pool and
+ * the display strip (one bank each with OPENDOTT_RAM_BANKS), the predecode
+ * and transition index strips, the GIF reader, canvas and LZW tables, the
+ * player's first-frame cache and the BLE upload buffer. main.c checks it against
+ * CONFIG_OPENDOTT_RAM_BUDGET_KB */
+#define MEDIA_STRIP_BYTES   (DISPLAY_WIDTH * MEDIA_STRIP_LINES * DISPLAY_BPP)
+
+#define OPENDOTT_SIZED_RAM_BYTES ( \
+    (MEDIA_STRIP_COUNT + 1) * ROUND_UP(MEDIA_STRIP_BYTES, OPENDOTT_STRIP_ALIGN) + \
+    2 * DISPLAY_WIDTH * MEDIA_STRIP_LINES + \
+    CONFIG_OPENDOTT_GIF_READ_BUF_SIZE + \
+    DISPLAY_WIDTH * DISPLAY_HEIGHT + GIF_PALETTE_SIZE * sizeof(uint16_t) + \
+    GIF_LZW_MAX_CODES * 4 + 1 + \
+    (2 * CONFIG_OPENDOTT_PREFETCH_DEPTH + 1) * sizeof(struct predecode_first) + \
+    (IS_ENABLED(CONFIG_BT) ? CONFIG_OPENDOTT_BLE_RX_BUFFER_KB * 1024 : 0))
+
+/* Native media: this header, then frame_count full-panel RGB565 frames */
+#define MEDIA_NATIVE_MAGIC  0x3536354F  /* 'O565' */
+
+struct media_native_header {
+    uint32_t magic;
+    uint16_t width;
+    uint16_t height;
+    uint16_t frame_count;
+    uint16_t delay_ms;
+} __packed;
+
+struct media_source;
+
+struct media_source_api {
+    ssize_t (*read)(struct media_source *src, size_t offset, void *buf, size_t len);
+    void (*close)(struct media_source *src);
+};
+
+/* Byte source: memory (RAM, XIP-mapped flash, the BLE receive buffer) or a
+ * stored file */
+struct media_source {
+    const struct media_source_api *api;
+    const char *name;           /* Stored file name, NULL for memory */
+    size_t size;
+    uint32_t read_us;           /* Time spent in reads, for deadline accounting */
+    union {
+        const uint8_t *mem;
+        struct fs_file_t file;
+    };
+};
+
+struct media_info {
+    uint16_t width;
+    uint16_t height;
+    uint16_t frame_count;
+    uint16_t loop_count;        /* 0 = forever */
+};
+
+struct media_strip {
+    uint16_t y;
+    uint16_t lines;
+    uint16_t *pixels;           /* DISPLAY_WIDTH * lines */
+};
+
+/* Decoders are single-instance, and own the media between open and close */
+struct media_decoder_api {
+    const char *name;
+    int (*open)(struct media_source *src, struct media_info *info, k_timeout_t timeout);
+    int (*decode_frame)(uint16_t index, uint16_t *delay_ms);
+    int (*read_strip)(struct media_strip *strip);
+    void (*close)(void);
+};
+
+/* Compositor stage: overlays and masks edit each strip in place */
+typedef void (*media_overlay_t)(struct media_strip *strip, uint16_t frame, void *user_data);
+
+struct media_sink;
+
+struct media_sink_api {
+    int (*frame_begin)(struct media_sink *sink, uint16_t frame);
+    int (*write_strip)(struct media_sink *sink, const struct media_strip *strip);
+    int (*frame_end)(struct media_sink *sink);
+};
+
+struct media_sink {
+    const struct media_sink_api *api;
+    void *ctx;
+};
+
+enum media_stage {
+    MEDIA_STAGE_DECODE = 0,     /* decode_frame() */
+    MEDIA_STAGE_CONVERT,        /* read_strip() */
+    MEDIA_STAGE_COMPOSITE,      /* Overlays */
+    MEDIA_STAGE_SINK,           /* write_strip(), on the sink thread */
+    MEDIA_STAGE_COUNT,
+};
+
+struct media_stage_stats {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+};
+
+/* A frame that finished after its deadline (its start plus its own delay),
+ * with where the time went */
+struct media_late_frame {
+    uint32_t uptime_ms;         /* When it finished */
+    uint16_t frame;
+    uint16_t budget_ms;         /* The frame's delay */
+    uint16_t late_ms;
+    uint32_t read_us;           /* Source reads (flash) */
+    uint32_t decode_us;         /* decode_frame() + read_strip(), less reads */
+    uint32_t composite_us;
+    uint32_t sink_us;           /* write_strip(): SPI for the panel */
+};
+
+struct media_pipeline {
+    struct media_source *source;
+    const struct media_decoder_api *decoder;
+    struct media_sink *sink;
+    struct {
+        media_overlay_t fn;
+        void *user_data;
+    } overlays[MEDIA_MAX_OVERLAYS];
+    uint8_t overlay_count;
+    bool open;
+    volatile bool stop;
+    struct media_info info;
+    struct media_stage_stats stats[MEDIA_STAGE_COUNT];
+    uint32_t frame_us[MEDIA_STAGE_COUNT];   /* Last rendered frame only */
+    uint32_t frame_read_us;
+    k_tid_t play_tid;           /* In media_pipeline_play*(), woken by stop */
+};
+
 /* Transfer states */
 typedef enum {
     TRANSFER_IDLE,
@@ -47,11 +326,56 @@ typedef enum {
     TRANSFER_FAILED
 } transfer_state_t;
 
-/* Button events */
+/* Frame 0 of a stored GIF ready to show: header and LUT in RAM, the index
+ * canvas in its predecode frame cache */
+struct predecode_first {
+    char name[32];
+    uint16_t delay_ms;
+    uint16_t frame_count;
+    uint16_t color_id;          /* Color profile the LUT was built with */
+    uint16_t lut[GIF_PALETTE_SIZE];
+};
+
+/* Color correction (color.c); percentages, 100 = unchanged */
+struct color_profile {
+    uint16_t gamma_x100;        /* Exponent applied to 0..1 channel values */
+    uint8_t gain[3];            /* White balance: R, G, B */
+    uint8_t saturation;
+} __packed;
+
+#define COLOR_PROFILE_NONE { .gamma_x100 = 100, .gain = { 100, 100, 100 }, .saturation = 100 }
+
+/* Slot transitions (transition.c) */
+enum transition_effect {
+    TRANSITION_CUT = 0,
+    TRANSITION_CROSSFADE,
+    TRANSITION_WIPE,
+    TRANSITION_IRIS,            /* Opens from the centre of the round panel */
+    TRANSITION_COUNT,
+};
+
+/* Cost of the last transition, per step where not stated */
+struct transition_stats {
+    enum transition_effect effect;
+    uint16_t steps;
+    uint32_t elapsed_ms;        /* Whole transition */
+    uint32_t compose_us;        /* Blending, CPU only */
+    uint32_t read_us;           /* Frame cache reads */
+    uint32_t sink_us;           /* SPI, overlapped with the next step */
+};
+
+/* Button events (see button.c for timing) */
 typedef enum {
-    BUTTON_EVENT_SHORT_PRESS,
-    BUTTON_EVENT_MEDIUM_PRESS,
-    BUTTON_EVENT_LONG_PRESS,
+    BUTTON_EVENT_SHORT_PRESS,   /* Single tap, once no second tap follows */
+    BUTTON_EVENT_MEDIUM_PRESS,  /* Released after HOLD */
+    BUTTON_EVENT_LONG_PRESS,    /* Released after LONG_HOLD */
+    BUTTON_EVENT_DOWN,          /* Debounced press, reported on contact */
+    BUTTON_EVENT_UP,
+    BUTTON_EVENT_DOUBLE_TAP,
+    BUTTON_EVENT_TRIPLE_TAP,
+    BUTTON_EVENT_HOLD,          /* Hold threshold crossed, still pressed */
+    BUTTON_EVENT_LONG_HOLD,
+    BUTTON_EVENT_HOLD_REPEAT,   /* Periodically while held after HOLD */
 } button_event_t;
 
 /* Button callback function type */
@@ -65,11 +389,25 @@ void ble_transfer_complete(bool success);
 
 /* Display API */
 int display_init(void);
+int display_load_settings(void);
+int display_set_rotation(enum display_rotation rotation);
+enum display_rotation display_get_rotation(void);
+int display_set_gamma(uint8_t reg, const uint8_t *values);
+bool display_get_gamma(uint8_t reg, uint8_t *values);
 void display_clear(uint16_t color);
 int opendott_set_brightness(uint8_t brightness);
 int display_draw_buffer(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t *buf);
+int display_draw_indexed(uint16_t y, uint16_t height, const uint8_t *pixels,
+                         const uint16_t *lut);
 int display_show_image(const char *path);
-void display_gif(const uint8_t *data, size_t size);
+void display_frame_end(void);
+int display_bus_suspend(bool suspend);
+
+/* Mock panel (native_sim, CONFIG_OPENDOTT_MOCK_PANEL) */
+int mock_panel_cmd(uint8_t cmd);
+int mock_panel_data(const uint8_t *data, size_t len);
+void mock_panel_frame_end(void);
+const uint8_t *mock_panel_rgb(void);
 
 /* Storage API */
 int storage_init(void);
@@ -78,16 +416,179 @@ int storage_load_gif(uint8_t *data, size_t max_size, uint8_t slot);
 int storage_save_image(const uint8_t *data, size_t size, const char *name);
 int storage_load_image(const char *name, uint8_t **data, size_t *size);
 int storage_delete_image(const char *name);
+int storage_get_info(const char *name, size_t *size, uint32_t *crc);
+int storage_read_at(const char *name, size_t offset, uint8_t *buf, size_t len);
+bool storage_next_file(const char *after, char *out, size_t out_size);
+int storage_get_extent_crc(const char *name, uint32_t index, uint32_t *crc,
+                           uint32_t *count);
+int storage_get_flags(const char *name, uint16_t *flags);
+int storage_set_flags(const char *name, uint16_t flags);
+int storage_file_open(const char *name, struct fs_file_t *file);
+ssize_t storage_file_read(struct fs_file_t *file, size_t offset, void *buf, size_t len);
+ssize_t storage_file_write(struct fs_file_t *file, size_t offset, const void *buf, size_t len);
+int storage_file_close(struct fs_file_t *file);
+int storage_meta_open(const char *name, const char *ext, bool write, struct fs_file_t *file);
+int storage_meta_read(const char *name, const char *ext, size_t offset, void *buf, size_t len);
+void storage_meta_delete(const char *name, const char *ext);
 int storage_get_free_space(size_t *free_bytes);
 int storage_format(void);
+void storage_lock(void);
+void storage_unlock(void);
+int storage_compact_start(void);
+void storage_compact_schedule(void);
+void storage_compact_cancel(void);
+void storage_compact_get_status(struct storage_compact_status *status);
+
+/* Integrity scrubbing (storage_scrub.c), call after idle_init() */
+int storage_scrub_init(void);
+int storage_scrub_start(void);
+void storage_scrub_get_status(struct storage_scrub_status *status);
+
+/* Storage trace API */
+static inline uint32_t storage_trace_start(void)
+{
+    return k_cycle_get_32();
+}
+void storage_trace_record(enum storage_trace_op op, uint32_t start, size_t bytes);
+void storage_trace_reset(void);
+int storage_trace_dump(uint8_t *buf, size_t size);
 
 /* Image Handler API */
 image_format_t image_detect_format(const uint8_t *data, size_t size);
 const char *image_format_to_string(image_format_t format);
 bool image_validate(const uint8_t *data, size_t size);
-int image_decode_and_display(const uint8_t *data, size_t size);
+
+/* GIF decoder API (one user at a time, between open and close) */
+int gif_decoder_open(const char *name, k_timeout_t timeout);
+int gif_decoder_open_source(struct media_source *src, k_timeout_t timeout);
+void gif_decoder_close(void);
+const struct gif_info *gif_decoder_info(void);
+int gif_decoder_frame_info(uint16_t index, struct gif_frame_info *frame);
+int gif_decoder_decode(uint16_t index);
+uint16_t gif_decoder_position(void);
+int gif_decoder_resume(uint16_t next, const uint16_t *lut, const uint8_t *residuals);
+uint8_t *gif_decoder_canvas(void);
+const uint16_t *gif_decoder_lut(void);
+const uint8_t *gif_decoder_residuals(void);
+
+/* Media pipeline API */
+int media_source_mem_init(struct media_source *src, const void *data, size_t size);
+int media_source_file_open(struct media_source *src, const char *name);
+int media_source_meta_open(struct media_source *src, const char *name, const char *ext);
+ssize_t media_source_read(struct media_source *src, size_t offset, void *buf, size_t len);
+void media_source_close(struct media_source *src);
+
+extern const struct media_decoder_api media_decoder_gif;
+extern const struct media_decoder_api media_decoder_native;
+const struct media_decoder_api *media_decoder_find(struct media_source *src);
+
+void media_sink_panel_init(struct media_sink *sink);
+void media_sink_null_init(struct media_sink *sink);
+
+int media_pipeline_open(struct media_pipeline *p, struct media_source *src,
+                        struct media_sink *sink, k_timeout_t timeout);
+int media_pipeline_open_decoder(struct media_pipeline *p, struct media_source *src,
+                                const struct media_decoder_api *decoder,
+                                struct media_sink *sink, k_timeout_t timeout);
+int media_pipeline_add_overlay(struct media_pipeline *p, media_overlay_t fn, void *user_data);
+int media_pipeline_render(struct media_pipeline *p, uint16_t frame, uint16_t *delay_ms);
+int media_pipeline_play(struct media_pipeline *p, uint16_t loops);
+int media_pipeline_play_from(struct media_pipeline *p, uint16_t first, uint16_t loops);
+void media_pipeline_stop(struct media_pipeline *p);
+void media_pipeline_close(struct media_pipeline *p);
+int media_show(struct media_source *src);
+int media_late_dump(uint8_t *buf, size_t size);
+void media_late_reset(void);
+
+/* Idle-time pre-decode (predecode.c), call after idle_init() */
+int predecode_init(void);
+int predecode_schedule(const char *name);
+int predecode_schedule_thumbnail(const char *name);
+int predecode_show_boot_snapshot(void);
+int predecode_load_first(const char *name, struct predecode_first *first, k_timeout_t timeout);
+int predecode_show_first(const struct predecode_first *first);
+int predecode_resume_first(const struct predecode_first *first);
+int predecode_first_source(const struct predecode_first *first, struct media_source *src,
+                           size_t *pixels);
+
+/* Color correction (color.c), call color_init() after storage_init() */
+int color_init(void);
+uint16_t color_to_rgb565(uint8_t r, uint8_t g, uint8_t b, uint8_t *residual);
+void color_correct_rgb565(uint16_t *pixels, size_t count);
+void color_dither_row(uint16_t *out, const uint8_t *idx, const uint16_t *lut,
+                      const uint8_t *residuals, size_t count, uint16_t y);
+const uint8_t *color_dither_thresholds(uint16_t y);
+uint16_t color_profile_id(void);
+void color_get_profile(struct color_profile *profile);
+int color_set_profile(const struct color_profile *profile);
+
+/* Slot transitions (transition.c) */
+int transition_run(const struct predecode_first *from, const struct predecode_first *to);
+void transition_stop(void);
+int transition_init(void);
+int transition_set(enum transition_effect effect, uint16_t duration_ms);
+void transition_get(enum transition_effect *effect, uint16_t *duration_ms);
+void transition_get_stats(struct transition_stats *stats);
+
+/* Slot player (player.c) */
+int player_play(const char *name);
+void player_step(int step);
+void player_pause(void);
+
+/* Thumbnail API. A line callback returns canvas line Y, or NULL on error */
+typedef const uint8_t *(*thumbnail_line_t)(void *user, uint16_t y);
+int thumbnail_generate(const char *name, thumbnail_line_t line, void *user,
+                       const uint16_t *lut);
+int thumbnail_read(const char *name, size_t offset, uint8_t *buf, size_t len);
 
 /* Button API */
 int button_init(button_callback_t callback);
 
+/* Idle job API (low-priority background work) */
+int idle_init(void);
+void idle_mark_busy(void);
+bool idle_is_idle(void);
+int idle_submit(struct k_work_delayable *work, k_timeout_t delay);
+
+/* Still-image power down (power.c): the panel bus and the QSPI flash sleep
+ * while a still is up; users bracket access with power_get()/power_put() */
+void power_still(bool still);
+void power_get(void);
+void power_put(void);
+
+/* OTA stream decoders (ota_codec.c); EMIT gets the image a byte at a time */
+#define OTA_LZ_WINDOW_BITS  12
+#define OTA_LZ_WINDOW_SIZE  BIT(OTA_LZ_WINDOW_BITS)
+
+typedef int (*ota_emit_t)(uint8_t b, void *user);
+
+struct ota_lz {
+    uint8_t window[OTA_LZ_WINDOW_SIZE];
+    uint16_t pos;
+    uint8_t flags;
+    uint8_t items;
+    uint8_t lo;
+    bool have_lo;
+};
+
+struct ota_delta_io {
+    int (*read_byte)(void *user, uint8_t *b);                   /* Next patch byte */
+    int (*copy)(void *user, uint32_t src, uint32_t count);      /* Emit base bytes */
+    ota_emit_t emit;
+};
+
+void ota_lz_init(struct ota_lz *lz);
+int ota_lz_feed(struct ota_lz *lz, const uint8_t *data, size_t len, ota_emit_t emit,
+                void *user);
+int ota_delta_apply(const struct ota_delta_io *io, void *user, uint32_t out_size);
+
+/* Asset pack API (fonts, icons, palettes read in place from QSPI via XIP) */
+int assets_init(void);
+int assets_get_palette(const char *name, uint16_t *out, size_t max);
+int assets_draw_icon(const char *name, uint16_t x, uint16_t y);
+int assets_draw_text(const char *font, uint16_t x, uint16_t y, const char *text,
+                     uint16_t fg, uint16_t bg);
+int assets_text_width(const char *font, const char *text);
+void assets_xip_enable(bool enable);
+
 #endif /* OPENDOTT_H */
@@ -0,0 +1,514 @@
+/*
+ * OpenDOTT - Asset Pack
+ * SPDX-License-Identifier: MIT
+ *
+ * Read-only fonts, icons and palettes built by tools/dott_assets.py and
+ * flashed to the assets partition at the end of the QSPI flash. The pack is
+ * never copied to RAM: it is read in place through the nRF52840 XIP window.
+ * Rendered glyphs are kept in a small static cache, so drawing text and
+ * icons needs no heap.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash/nrf_qspi_nor.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(assets, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* QSPI flash is memory mapped here once XIP is enabled */
+#define QSPI_XIP_BASE        0x12000000
+#define ASSETS_PARTITION     assets_partition
+#define ASSETS_XIP_ADDR      (QSPI_XIP_BASE + FIXED_PARTITION_OFFSET(ASSETS_PARTITION))
+#define ASSETS_MAX_SIZE      FIXED_PARTITION_SIZE(ASSETS_PARTITION)
+
+/*
+ * Pack layout (little-endian), must match tools/dott_assets.py:
+ *
+ *   header | entry[count] | blobs...
+ *
+ * Entry offsets are relative to the start of the pack. The CRC covers
+ * everything after the header.
+ */
+#define ASSET_PACK_MAGIC     0x5041444F  /* "ODAP" */
+#define ASSET_PACK_VERSION   1
+
+enum asset_type {
+    ASSET_TYPE_FONT = 1,
+    ASSET_TYPE_ICON = 2,    /* RGB565 big-endian, width x height */
+    ASSET_TYPE_PALETTE = 3, /* RGB565 big-endian, size / 2 entries */
+};
+
+struct asset_pack_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;
+    uint32_t crc32;
+} __packed;
+
+struct asset_entry {
+    char name[16];
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t width;
+    uint16_t height;
+    uint16_t reserved2;
+    uint32_t offset;
+    uint32_t size;
+} __packed;
+
+/* Font blob: header, glyph table, then 4bpp coverage atlas */
+struct asset_font {
+    uint8_t first_char;
+    uint8_t glyph_count;
+    uint8_t height;
+    uint8_t bpp;
+    uint8_t baseline;
+    uint8_t reserved[3];
+} __packed;
+
+struct asset_glyph {
+    uint32_t offset;  /* From start of font blob */
+    uint8_t width;
+    uint8_t advance;
+    uint16_t reserved;
+} __packed;
+
+/* Glyph cache: rendered RGB565 cells keyed by glyph and colors */
+#define GLYPH_CACHE_SIZE     8
+#define GLYPH_MAX_WIDTH      16
+#define GLYPH_MAX_HEIGHT     24
+
+struct glyph_cache_entry {
+    const struct asset_glyph *glyph;
+    uint16_t fg;
+    uint16_t bg;
+    uint32_t last_used;
+    uint8_t pixels[GLYPH_MAX_WIDTH * GLYPH_MAX_HEIGHT * DISPLAY_BPP];
+};
+
+static struct glyph_cache_entry glyph_cache[GLYPH_CACHE_SIZE];
+static uint32_t glyph_cache_clock;
+
+/*
+ * Bounce buffer for icons and oversized glyphs. SPIM EasyDMA can only read
+ * from RAM, so XIP data is staged here a few lines at a time.
+ */
+static uint8_t strip_buf[DISPLAY_WIDTH * DISPLAY_BPP * 4];
+
+static const struct device *const flash_dev = DEVICE_DT_GET(DT_NODELABEL(gd25q128));
+static const struct asset_pack_header *pack;
+
+static const struct asset_entry *pack_entries(void)
+{
+    return (const struct asset_entry *)(pack + 1);
+}
+
+static const struct asset_entry *find_entry(const char *name, uint8_t type)
+{
+    if (!pack || !name) {
+        return NULL;
+    }
+
+    const struct asset_entry *entries = pack_entries();
+
+    for (uint16_t i = 0; i < pack->count; i++) {
+        if (entries[i].type == type &&
+            strncmp(entries[i].name, name, sizeof(entries[i].name)) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static const uint8_t *entry_data(const struct asset_entry *entry)
+{
+    return (const uint8_t *)pack + entry->offset;
+}
+
+/* Check that a font's glyph table and bitmaps lie inside its blob */
+static bool font_valid(const uint8_t *blob, uint32_t size)
+{
+    const struct asset_font *font = (const void *)blob;
+
+    if (size < sizeof(*font) ||
+        (size - sizeof(*font)) / sizeof(struct asset_glyph) < font->glyph_count) {
+        return false;
+    }
+
+    const struct asset_glyph *glyphs = (const void *)(font + 1);
+
+    for (uint16_t i = 0; i < font->glyph_count; i++) {
+        uint32_t bytes = ((glyphs[i].width + 1) / 2) * font->height;
+
+        if (glyphs[i].offset > size || bytes > size - glyphs[i].offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Every entry must lie inside the pack, after the entry table, and hold as
+ * many bytes as its type needs, so the drawing code can trust offsets and
+ * sizes without checks of its own. Caller holds storage_lock.
+ */
+static int check_entries(const struct asset_pack_header *hdr)
+{
+    const struct asset_entry *entries = (const void *)(hdr + 1);
+    uint32_t data_start = sizeof(*hdr) + hdr->count * sizeof(struct asset_entry);
+
+    for (uint16_t i = 0; i < hdr->count; i++) {
+        const struct asset_entry *e = &entries[i];
+        const uint8_t *blob = (const uint8_t *)hdr + e->offset;
+        bool valid = e->offset >= data_start && e->offset <= hdr->size &&
+                     e->size <= hdr->size - e->offset;
+
+        if (valid) {
+            switch (e->type) {
+            case ASSET_TYPE_ICON:
+                valid = (uint64_t)e->width * e->height * DISPLAY_BPP == e->size;
+                break;
+            case ASSET_TYPE_PALETTE:
+                valid = e->size % sizeof(uint16_t) == 0;
+                break;
+            case ASSET_TYPE_FONT:
+                valid = font_valid(blob, e->size);
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (!valid) {
+            LOG_ERR("Asset '%.16s' (type %u) invalid: offset %u, size %u",
+                    e->name, e->type, e->offset, e->size);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+int assets_init(void)
+{
+    if (!device_is_ready(flash_dev)) {
+        LOG_ERR("QSPI flash not ready");
+        return -ENODEV;
+    }
+
+    nrf_qspi_nor_xip_enable(flash_dev, true);
+
+    const struct asset_pack_header *hdr = (const void *)ASSETS_XIP_ADDR;
+    int ret = 0;
+
+    storage_lock();
+
+    if (hdr->magic != ASSET_PACK_MAGIC) {
+        LOG_WRN("No asset pack found");
+        ret = -ENOENT;
+    } else if (hdr->version != ASSET_PACK_VERSION) {
+        LOG_ERR("Unsupported asset pack version %u", hdr->version);
+        ret = -ENOTSUP;
+    } else if (hdr->size > ASSETS_MAX_SIZE ||
+               hdr->size < sizeof(*hdr) + hdr->count * sizeof(struct asset_entry)) {
+        LOG_ERR("Asset pack size invalid: %u", hdr->size);
+        ret = -EINVAL;
+    } else if (crc32_ieee((const uint8_t *)(hdr + 1), hdr->size - sizeof(*hdr)) !=
+               hdr->crc32) {
+        LOG_ERR("Asset pack CRC mismatch");
+        ret = -EIO;
+    } else {
+        ret = check_entries(hdr);
+    }
+
+    storage_unlock();
+
+    if (ret < 0) {
+        nrf_qspi_nor_xip_enable(flash_dev, false);
+        return ret;
+    }
+
+    pack = hdr;
+    LOG_INF("Asset pack: %u assets, %u bytes at 0x%08x",
+            pack->count, pack->size, (uint32_t)ASSETS_XIP_ADDR);
+    return 0;
+}
+
+/* XIP keeps the QSPI peripheral running, so power.c turns it off before
+ * powering the flash down, and back on after. Nothing to do without a pack */
+void assets_xip_enable(bool enable)
+{
+    if (pack) {
+        nrf_qspi_nor_xip_enable(flash_dev, enable);
+    }
+}
+
+/*
+ * Copy up to MAX entries of a palette into OUT and return how many were
+ * copied. No XIP pointer is handed out: power.c turns XIP off and puts the
+ * flash into deep power-down while a still image is shown, and a pointer
+ * kept across that would fault.
+ */
+int assets_get_palette(const char *name, uint16_t *out, size_t max)
+{
+    int ret = -ENOENT;
+
+    storage_lock();
+    const struct asset_entry *entry = find_entry(name, ASSET_TYPE_PALETTE);
+    if (entry) {
+        size_t count = MIN(entry->size / sizeof(uint16_t), max);
+
+        memcpy(out, entry_data(entry), count * sizeof(uint16_t));
+        ret = count;
+    }
+    storage_unlock();
+
+    return ret;
+}
+
+int assets_draw_icon(const char *name, uint16_t x, uint16_t y)
+{
+    storage_lock();
+
+    const struct asset_entry *entry = find_entry(name, ASSET_TYPE_ICON);
+    if (!entry) {
+        storage_unlock();
+        LOG_WRN("Icon '%s' not found", name);
+        return -ENOENT;
+    }
+
+    uint16_t width = entry->width;
+    uint16_t height = entry->height;
+    const uint8_t *src = entry_data(entry);
+
+    storage_unlock();
+
+    if (width == 0 || width > DISPLAY_WIDTH) {
+        return -EINVAL;
+    }
+
+    size_t line_bytes = width * DISPLAY_BPP;
+    uint16_t lines_per_strip = sizeof(strip_buf) / line_bytes;
+
+    for (uint16_t row = 0; row < height; row += lines_per_strip) {
+        uint16_t lines = MIN(lines_per_strip, height - row);
+
+        storage_lock();
+        memcpy(strip_buf, src + row * line_bytes, lines * line_bytes);
+        storage_unlock();
+
+        int ret = display_draw_buffer(x, y + row, width, lines, strip_buf);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/* Build the 16-step bg->fg ramp used to resolve 4bpp coverage */
+static void build_ramp(uint16_t fg, uint16_t bg, uint8_t ramp[16][2])
+{
+    int fr = fg >> 11, fgc = (fg >> 5) & 0x3F, fb = fg & 0x1F;
+    int br = bg >> 11, bgc = (bg >> 5) & 0x3F, bb = bg & 0x1F;
+
+    for (int a = 0; a < 16; a++) {
+        uint16_t r = br + ((fr - br) * a) / 15;
+        uint16_t g = bgc + ((fgc - bgc) * a) / 15;
+        uint16_t b = bb + ((fb - bb) * a) / 15;
+        uint16_t c = (r << 11) | (g << 5) | b;
+
+        ramp[a][0] = c >> 8;
+        ramp[a][1] = c & 0xFF;
+    }
+}
+
+/* Expand glyph rows [row0, row0 + rows) into big-endian RGB565 */
+static void render_glyph_rows(const uint8_t *bitmap, uint8_t width, uint16_t row0,
+                              uint16_t rows, const uint8_t ramp[16][2], uint8_t *out)
+{
+    size_t stride = (width + 1) / 2;
+
+    for (uint16_t row = row0; row < row0 + rows; row++) {
+        const uint8_t *src = bitmap + row * stride;
+
+        for (uint8_t col = 0; col < width; col++) {
+            uint8_t a = (col & 1) ? (src[col / 2] & 0x0F) : (src[col / 2] >> 4);
+            *out++ = ramp[a][0];
+            *out++ = ramp[a][1];
+        }
+    }
+}
+
+static struct glyph_cache_entry *glyph_cache_lookup(const struct asset_glyph *glyph,
+                                                    uint16_t fg, uint16_t bg)
+{
+    struct glyph_cache_entry *victim = &glyph_cache[0];
+
+    for (int i = 0; i < GLYPH_CACHE_SIZE; i++) {
+        struct glyph_cache_entry *e = &glyph_cache[i];
+
+        if (e->glyph == glyph && e->fg == fg && e->bg == bg) {
+            e->last_used = ++glyph_cache_clock;
+            return e;
+        }
+        if (e->last_used < victim->last_used) {
+            victim = e;
+        }
+    }
+
+    victim->glyph = NULL;
+    return victim;
+}
+
+static int draw_glyph(const struct asset_font *font, const struct asset_glyph *glyph,
+                      uint16_t x, uint16_t y, uint16_t fg, uint16_t bg,
+                      const uint8_t ramp[16][2])
+{
+    storage_lock();
+    uint8_t width = glyph->width;
+    uint8_t height = font->height;
+    const uint8_t *bitmap = (const uint8_t *)font + glyph->offset;
+    storage_unlock();
+
+    if (width == 0) {
+        return 0;
+    }
+
+    if (width <= GLYPH_MAX_WIDTH && height <= GLYPH_MAX_HEIGHT) {
+        struct glyph_cache_entry *e = glyph_cache_lookup(glyph, fg, bg);
+
+        if (!e->glyph) {
+            storage_lock();
+            render_glyph_rows(bitmap, width, 0, height, ramp, e->pixels);
+            storage_unlock();
+
+            e->glyph = glyph;
+            e->fg = fg;
+            e->bg = bg;
+            e->last_used = ++glyph_cache_clock;
+        }
+
+        return display_draw_buffer(x, y, width, height, e->pixels);
+    }
+
+    /* Too big for the cache: stream through the strip buffer */
+    uint16_t lines_per_strip = sizeof(strip_buf) / (width * DISPLAY_BPP);
+
+    for (uint16_t row = 0; row < height; row += lines_per_strip) {
+        uint16_t lines = MIN(lines_per_strip, height - row);
+
+        storage_lock();
+        render_glyph_rows(bitmap, width, row, lines, ramp, strip_buf);
+        storage_unlock();
+
+        int ret = display_draw_buffer(x, y + row, width, lines, strip_buf);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static const struct asset_font *get_font(const char *name)
+{
+    storage_lock();
+    const struct asset_entry *entry = find_entry(name, ASSET_TYPE_FONT);
+    storage_unlock();
+
+    if (!entry) {
+        LOG_WRN("Font '%s' not found", name);
+        return NULL;
+    }
+
+    return (const struct asset_font *)entry_data(entry);
+}
+
+static const struct asset_glyph *get_glyph(const struct asset_font *font, char c)
+{
+    const struct asset_glyph *glyphs = (const struct asset_glyph *)(font + 1);
+    uint8_t ch = (uint8_t)c;
+
+    if (ch < font->first_char || ch >= font->first_char + font->glyph_count) {
+        ch = '?';
+        if (ch < font->first_char || ch >= font->first_char + font->glyph_count) {
+            return NULL;
+        }
+    }
+
+    return &glyphs[ch - font->first_char];
+}
+
+int assets_draw_text(const char *font_name, uint16_t x, uint16_t y, const char *text,
+                     uint16_t fg, uint16_t bg)
+{
+    const struct asset_font *font = get_font(font_name);
+    if (!font || !text) {
+        return -ENOENT;
+    }
+
+    uint8_t ramp[16][2];
+    build_ramp(fg, bg, ramp);
+
+    storage_lock();
+    uint8_t height = font->height;
+    storage_unlock();
+
+    if (y + height > DISPLAY_HEIGHT) {
+        return -EINVAL;
+    }
+
+    for (const char *p = text; *p; p++) {
+        storage_lock();
+        const struct asset_glyph *glyph = get_glyph(font, *p);
+        uint8_t width = glyph ? glyph->width : 0;
+        uint8_t advance = glyph ? glyph->advance : 0;
+        storage_unlock();
+
+        if (!glyph) {
+            continue;
+        }
+
+        if (x + width > DISPLAY_WIDTH) {
+            break;
+        }
+
+        int ret = draw_glyph(font, glyph, x, y, fg, bg, ramp);
+        if (ret < 0) {
+            return ret;
+        }
+
+        x += advance;
+    }
+
+    return 0;
+}
+
+int assets_text_width(const char *font_name, const char *text)
+{
+    const struct asset_font *font = get_font(font_name);
+    if (!font || !text) {
+        return -ENOENT;
+    }
+
+    int width = 0;
+
+    storage_lock();
+    for (const char *p = text; *p; p++) {
+        const struct asset_glyph *glyph = get_glyph(font, *p);
+        if (glyph) {
+            width += glyph->advance;
+        }
+    }
+    storage_unlock();
+
+    return width;
+}
@@ -11,8 +11,13 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 
+#ifdef CONFIG_MCUMGR_GRP_IMG_UPLOAD_CHECK_HOOK
+#include <zephyr/mgmt/mcumgr/mgmt/callbacks.h>
+#endif
+
 #include "opendott.h"
 
 LOG_MODULE_REGISTER(ble_service, CONFIG_LOG_DEFAULT_LEVEL);
@@ -54,6 +59,31 @@ LOG_MODULE_REGISTER(ble_service, CONFIG_LOG_DEFAULT_LEVEL);
 #define TRIGGER_CMD_VALUE    0x00104000  /* 0x00401000 little-endian */
 #define READY_INDICATION     0xFFFFFFFF
 
+/* Command characteristic (0x1526) opcodes - OpenDOTT extensions.
+ * Write [opcode, args...], then read back [opcode, status, payload...] */
+#define CMD_STORAGE_TRACE          0x10
+#define CMD_STORAGE_TRACE_RESET    0x11
+#define CMD_STORAGE_COMPACT_STATUS 0x12
+#define CMD_STORAGE_SCRUB_STATUS   0x13
+#define CMD_THUMBNAIL              0x14
+#define CMD_LIST_FILES             0x15
+#define CMD_LATE_FRAMES            0x16
+#define CMD_LATE_FRAMES_RESET      0x17
+#define CMD_SETTING_GET            0x18
+#define CMD_SETTING_SET            0x19
+
+/* Keys of CMD_SETTING_GET and CMD_SETTING_SET, which take [key, value...].
+ * Every setting is saved on the device and survives a reboot */
+#define SETTING_ROTATION           0x01  /* u8 quarter turns clockwise */
+#define SETTING_COLOR_PROFILE      0x02  /* struct color_profile */
+#define SETTING_PANEL_GAMMA        0x03  /* u8 register, DISPLAY_GAMMA_LEN values */
+#define SETTING_DITHER             0x04  /* u8 on, per file: the name follows */
+#define SETTING_TRANSITION         0x05  /* u8 effect, u16 duration_ms */
+
+#define SETTING_NAME_MAX           32
+
+#define CMD_RESPONSE_MAX     512  /* ATT maximum attribute value length */
+
 /* GIF magic bytes */
 #define GIF_MAGIC_89A        0x613938464947  /* "GIF89a" */
 #define GIF_MAGIC_87A        0x613738464947  /* "GIF87a" */
@@ -89,6 +119,10 @@ static struct {
     .gif_valid = false
 };
 
+/* Last Command characteristic response, served with long reads */
+static uint8_t cmd_response[CMD_RESPONSE_MAX];
+static uint16_t cmd_response_len;
+
 /* Advertising data */
 static const struct bt_data ad[] = {
     BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
@@ -108,6 +142,10 @@ static ssize_t write_trigger(struct bt_conn *conn, const struct bt_gatt_attr *at
                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
 static ssize_t read_status(struct bt_conn *conn, const struct bt_gatt_attr *attr,
                            void *buf, uint16_t len, uint16_t offset);
+static ssize_t read_command(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            void *buf, uint16_t len, uint16_t offset);
+static ssize_t write_command(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
 
 static void trigger_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value);
 static void notify_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value);
@@ -128,7 +166,7 @@ BT_GATT_SERVICE_DEFINE(dott_svc,
     BT_GATT_CHARACTERISTIC(&command_uuid.uuid,
                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
                           BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                          NULL, NULL, NULL),
+                          read_command, write_command, NULL),
     
     /* 0x1527 - Status Characteristic */
     BT_GATT_CHARACTERISTIC(&status_uuid.uuid,
@@ -169,6 +207,14 @@ static void connected(struct bt_conn *conn, uint8_t err)
     current_conn = bt_conn_ref(conn);
     LOG_INF("Connected");
     
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+    /* 251-byte LL packets carry a full SMP chunk in two PDUs instead of ten */
+    err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        LOG_WRN("Data length update failed (err %d)", err);
+    }
+#endif
+    
     /* Reset transfer state */
     transfer.state = TRANSFER_IDLE;
     transfer.received_size = 0;
@@ -283,6 +329,9 @@ static ssize_t write_data(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 {
     const uint8_t *data = buf;
     
+    OPENDOTT_TRACE("ble_rx", len, transfer.received_size);
+    idle_mark_busy();
+    
     if (transfer.state != TRANSFER_TRIGGERED && transfer.state != TRANSFER_RECEIVING) {
         LOG_WRN("Data received but not in receive mode (state=%d)", transfer.state);
         return len;  /* Accept but ignore */
@@ -325,6 +374,8 @@ static ssize_t write_trigger(struct bt_conn *conn, const struct bt_gatt_attr *at
     uint32_t cmd = *(uint32_t *)buf;
     LOG_INF("Trigger received: 0x%08x", cmd);
     
+    idle_mark_busy();
+    
     /* Check for the magic trigger command */
     if (cmd == TRIGGER_CMD_VALUE) {
         LOG_INF("Starting GIF receive mode");
@@ -333,6 +384,10 @@ static ssize_t write_trigger(struct bt_conn *conn, const struct bt_gatt_attr *at
         transfer.state = TRANSFER_TRIGGERED;
         transfer.received_size = 0;
         transfer.gif_valid = false;
+
+        /* Drop a half-done compaction copy and its space; saving the
+         * upload schedules the next pass */
+        storage_compact_cancel();
         
         /* Send ready indication (0xFFFFFFFF) */
         int err = send_trigger_indication(READY_INDICATION);
@@ -355,16 +410,313 @@ static ssize_t read_status(struct bt_conn *conn, const struct bt_gatt_attr *attr
     return bt_gatt_attr_read(conn, attr, buf, len, offset, &status, sizeof(status));
 }
 
+/* Read command characteristic - returns the response to the last command */
+static ssize_t read_command(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            void *buf, uint16_t len, uint16_t offset)
+{
+    return bt_gatt_attr_read(conn, attr, buf, len, offset,
+                            cmd_response, cmd_response_len);
+}
+
+/* Copy a file name argument into NAME */
+static int setting_name(const uint8_t *args, size_t len, char *name)
+{
+    if (len == 0 || len >= SETTING_NAME_MAX) {
+        return -EINVAL;
+    }
+    memcpy(name, args, len);
+    name[len] = '\0';
+    return 0;
+}
+
+/* Turn MEDIA_FLAG_DITHER of file NAME on or off */
+static int set_dither(const char *name, bool on)
+{
+    uint16_t flags;
+
+    int ret = storage_get_flags(name, &flags);
+    if (ret < 0) {
+        return ret;
+    }
+
+    flags = on ? (flags | MEDIA_FLAG_DITHER) : (flags & ~MEDIA_FLAG_DITHER);
+    return storage_set_flags(name, flags);
+}
+
+/* Read setting KEY into OUT; returns its length */
+static int setting_get(uint8_t key, const uint8_t *args, size_t len,
+                       uint8_t *out, size_t max)
+{
+    switch (key) {
+    case SETTING_ROTATION:
+        out[0] = display_get_rotation();
+        return 1;
+
+    case SETTING_COLOR_PROFILE: {
+        struct color_profile profile;
+
+        color_get_profile(&profile);
+        sys_put_le16(profile.gamma_x100, &out[0]);
+        memcpy(&out[2], profile.gain, sizeof(profile.gain));
+        out[5] = profile.saturation;
+        return 6;
+    }
+
+    case SETTING_PANEL_GAMMA:
+        /* [register, 1 + values] or [register, 0] while at the default */
+        if (len != 1 || args[0] >= DISPLAY_GAMMA_REGS) {
+            return -EINVAL;
+        }
+        out[0] = args[0];
+        out[1] = display_get_gamma(args[0], &out[2]);
+        return out[1] ? 2 + DISPLAY_GAMMA_LEN : 2;
+
+    case SETTING_DITHER: {
+        char name[SETTING_NAME_MAX];
+        uint16_t flags;
+
+        int ret = setting_name(args, len, name);
+        if (ret == 0) {
+            ret = storage_get_flags(name, &flags);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        out[0] = (flags & MEDIA_FLAG_DITHER) != 0;
+        return 1;
+    }
+
+    case SETTING_TRANSITION: {
+        enum transition_effect effect;
+        uint16_t duration_ms;
+
+        transition_get(&effect, &duration_ms);
+        out[0] = effect;
+        sys_put_le16(duration_ms, &out[1]);
+        return 3;
+    }
+
+    default:
+        return -ENOTSUP;
+    }
+}
+
+/* Apply and save setting KEY */
+static int setting_set(uint8_t key, const uint8_t *value, size_t len)
+{
+    int ret;
+
+    switch (key) {
+    case SETTING_ROTATION:
+        if (len != 1) {
+            return -EINVAL;
+        }
+        ret = display_set_rotation(value[0]);
+        break;
+
+    case SETTING_COLOR_PROFILE: {
+        struct color_profile profile;
+
+        if (len != 6) {
+            return -EINVAL;
+        }
+        profile.gamma_x100 = sys_get_le16(&value[0]);
+        memcpy(profile.gain, &value[2], sizeof(profile.gain));
+        profile.saturation = value[5];
+        ret = color_set_profile(&profile);
+        break;
+    }
+
+    case SETTING_PANEL_GAMMA:
+        /* Register alone: back to the default from the next boot */
+        if (len != 1 && len != 1 + DISPLAY_GAMMA_LEN) {
+            return -EINVAL;
+        }
+        ret = display_set_gamma(value[0], len > 1 ? &value[1] : NULL);
+        break;
+
+    case SETTING_DITHER: {
+        char name[SETTING_NAME_MAX];
+
+        if (len < 2 || setting_name(&value[1], len - 1, name) < 0) {
+            return -EINVAL;
+        }
+        ret = set_dither(name, value[0] != 0);
+        if (ret < 0) {
+            return ret;
+        }
+        break;
+    }
+
+    case SETTING_TRANSITION:
+        /* Nothing to redraw: it shows at the next switch */
+        if (len != 3) {
+            return -EINVAL;
+        }
+        return transition_set(value[0], sys_get_le16(&value[1]));
+
+    default:
+        return -ENOTSUP;
+    }
+
+    /* Applied even if saving failed: redraw a still frame with it */
+    if (ret != -EINVAL) {
+        player_play(NULL);
+    }
+    return ret;
+}
+
+/* Write command characteristic - runs an OpenDOTT extension command */
+static ssize_t write_command(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    const uint8_t *cmd = buf;
+    uint8_t *payload = cmd_response + 2;
+    size_t payload_max = sizeof(cmd_response) - 2;
+    int ret = 0;
+    
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    
+    if (len < 1) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    
+    LOG_DBG("Command 0x%02x (%u bytes)", cmd[0], len);
+    
+    switch (cmd[0]) {
+    case CMD_STORAGE_TRACE:
+        ret = storage_trace_dump(payload, payload_max);
+        break;
+        
+    case CMD_STORAGE_TRACE_RESET:
+        storage_trace_reset();
+        break;
+        
+    case CMD_STORAGE_COMPACT_STATUS: {
+        struct storage_compact_status st;
+        storage_compact_get_status(&st);
+        payload[0] = st.state;
+        sys_put_le32(st.files_done, &payload[1]);
+        sys_put_le32(st.blocks_pre_erased, &payload[5]);
+        sys_put_le32(st.free_extents, &payload[9]);
+        sys_put_le32(st.largest_free_extent, &payload[13]);
+        ret = 17;
+        break;
+    }
+        
+    case CMD_STORAGE_SCRUB_STATUS: {
+        struct storage_scrub_status st;
+        storage_scrub_get_status(&st);
+        payload[0] = st.running;
+        sys_put_le32(st.passes, &payload[1]);
+        sys_put_le32(st.files_checked, &payload[5]);
+        sys_put_le32(st.extents_checked, &payload[9]);
+        sys_put_le32(st.corrupt_files, &payload[13]);
+        ret = 17;
+        break;
+    }
+        
+    case CMD_THUMBNAIL: {
+        char name[32];
+        uint16_t thumb_offset;
+
+        if (len < 4 || len - 3 >= sizeof(name)) {
+            ret = -EINVAL;
+            break;
+        }
+        thumb_offset = sys_get_le16(&cmd[1]);
+        memcpy(name, &cmd[3], len - 3);
+        name[len - 3] = '\0';
+
+        ret = thumbnail_read(name, thumb_offset, &payload[7], payload_max - 7);
+        if (ret >= 0) {
+            payload[0] = THUMBNAIL_FORMAT_RGB565;
+            payload[1] = THUMBNAIL_SIZE;
+            payload[2] = THUMBNAIL_SIZE;
+            sys_put_le16(THUMBNAIL_BYTES, &payload[3]);
+            sys_put_le16(thumb_offset, &payload[5]);
+            ret += 7;
+        }
+        break;
+    }
+
+    case CMD_LIST_FILES: {
+        char name[32] = "";
+        size_t used = 0;
+
+        if (len - 1 >= sizeof(name)) {
+            ret = -EINVAL;
+            break;
+        }
+        memcpy(name, &cmd[1], len - 1);
+        name[len - 1] = '\0';
+
+        /* As many NUL-terminated names as fit; pass the last one back in
+         * to continue, an empty payload ends the listing */
+        while (storage_next_file(name, name, sizeof(name))) {
+            size_t n = strlen(name) + 1;
+            if (used + n > payload_max) {
+                break;
+            }
+            memcpy(&payload[used], name, n);
+            used += n;
+        }
+        ret = used;
+        break;
+    }
+
+    case CMD_LATE_FRAMES:
+        ret = media_late_dump(payload, payload_max);
+        break;
+
+    case CMD_LATE_FRAMES_RESET:
+        media_late_reset();
+        break;
+
+    case CMD_SETTING_GET:
+        ret = (len < 2) ? -EINVAL :
+              setting_get(cmd[1], &cmd[2], len - 2, payload, payload_max);
+        break;
+
+    case CMD_SETTING_SET:
+        ret = (len < 2) ? -EINVAL : setting_set(cmd[1], &cmd[2], len - 2);
+        break;
+
+    default:
+        LOG_WRN("Unknown command: 0x%02x", cmd[0]);
+        ret = -ENOTSUP;
+        break;
+    }
+    
+    cmd_response[0] = cmd[0];
+    cmd_response[1] = (ret < 0) ? (uint8_t)(-ret) : 0;
+    cmd_response_len = 2 + ((ret > 0) ? ret : 0);
+    
+    return len;
+}
+
 /* Complete transfer (call after timeout or detecting end of GIF) */
 void ble_transfer_complete(bool success)
 {
     if (success && transfer.gif_valid) {
         LOG_INF("Transfer complete: %u bytes", transfer.received_size);
+
+        /* The host only hears about success once the upload is on flash */
+        int ret = storage_save_gif(transfer.buffer, transfer.received_size, 0);
+        if (ret < 0) {
+            LOG_ERR("Failed to save upload: %d", ret);
+            transfer.state = TRANSFER_FAILED;
+            send_notify("Transfer Fail");
+            return;
+        }
+
         transfer.state = TRANSFER_COMPLETE;
         send_notify("Transfer Complete");
-        
-        /* TODO: Trigger display update */
-        
+
+        /* Get it ready to play while nothing else runs */
+        predecode_schedule("slot0.gif");
     } else {
         LOG_ERR("Transfer failed");
         transfer.state = TRANSFER_FAILED;
@@ -372,6 +724,23 @@ void ble_transfer_complete(bool success)
     }
 }
 
+#ifdef CONFIG_MCUMGR_GRP_IMG_UPLOAD_CHECK_HOOK
+/* Every SMP image upload chunk counts as foreground work, so idle jobs
+ * (compaction, scrubbing) keep off the flash until the OTA is done */
+static enum mgmt_cb_return smp_upload_cb(uint32_t event, enum mgmt_cb_return prev_status,
+                                         int32_t *rc, uint16_t *group, bool *abort_more,
+                                         void *data, size_t data_size)
+{
+    idle_mark_busy();
+    return MGMT_CB_OK;
+}
+
+static struct mgmt_callback smp_upload_callback = {
+    .callback = smp_upload_cb,
+    .event_id = MGMT_EVT_OP_IMG_MGMT_UPLOAD,
+};
+#endif
+
 /* Initialize BLE */
 int ble_service_init(uint8_t *rx_buffer, size_t rx_buffer_size)
 {
@@ -390,6 +759,10 @@ int ble_service_init(uint8_t *rx_buffer, size_t rx_buffer_size)
     
     LOG_INF("Bluetooth initialized");
     
+#ifdef CONFIG_MCUMGR_GRP_IMG_UPLOAD_CHECK_HOOK
+    mgmt_callback_register(&smp_upload_callback);
+#endif
+    
     /* Start advertising */
     err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
     if (err) {
@@ -1,8 +1,24 @@
 /*
  * OpenDOTT - Button Handler
  * SPDX-License-Identifier: MIT
- * 
- * Button input with short/medium/long press detection
+ *
+ * Button input engine. Edges are debounced in interrupt context by lockout:
+ * the first edge that changes the state is reported at once, then edges
+ * are ignored for BUTTON_DEBOUNCE_MS, after which the pin is sampled again
+ * in case a change was missed. A press is therefore reported on contact,
+ * not after release.
+ *
+ * Gestures are classified from the same interrupt and timer context:
+ *  - DOWN / UP on every debounced edge
+ *  - HOLD and LONG_HOLD as the hold thresholds are crossed, then
+ *    HOLD_REPEAT every BUTTON_REPEAT_MS until release
+ *  - MEDIUM_PRESS / LONG_PRESS on release after a hold
+ *  - SHORT_PRESS, DOUBLE_TAP or TRIPLE_TAP once a tap sequence ends, i.e.
+ *    BUTTON_TAP_GAP_MS after its last tap (at once on the third)
+ *
+ * Events go through a message queue to a dedicated thread that runs the
+ * callback, so a slow callback delays later events instead of losing them,
+ * and nothing waits behind the system work queue.
  */
 
 #include <zephyr/kernel.h>
@@ -14,59 +30,201 @@
 
 LOG_MODULE_REGISTER(button, CONFIG_LOG_DEFAULT_LEVEL);
 
-/* Button timing thresholds (ms) */
-#define SHORT_PRESS_MAX_MS    500
-#define MEDIUM_PRESS_MAX_MS   3000
-/* Long press is anything longer than MEDIUM_PRESS_MAX_MS */
+/* Button timing (ms) */
+#define BUTTON_DEBOUNCE_MS    5
+#define BUTTON_HOLD_MS        500     /* Was the short/medium boundary */
+#define BUTTON_LONG_HOLD_MS   3000    /* Was the medium/long boundary */
+#define BUTTON_REPEAT_MS      250
+#define BUTTON_TAP_GAP_MS     250     /* Longest gap inside a multi-tap */
+#define BUTTON_MAX_TAPS       3
+
+#define BUTTON_QUEUE_LEN      16
+#define BUTTON_STACK_SIZE     1024
+#define BUTTON_PRIORITY       4       /* Ahead of the media sink thread */
+
+struct button_msg {
+    uint8_t event;
+    uint32_t time_ms;           /* Uptime when the event was raised */
+};
 
 /* Button GPIO */
 static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(DT_ALIAS(sw0), gpios);
 static struct gpio_callback button_cb_data;
 
-/* State tracking */
 static button_callback_t user_callback = NULL;
-static int64_t press_start_time = 0;
-static struct k_work_delayable button_work;
 
-/* Work handler for button release processing */
-static void button_work_handler(struct k_work *work)
+K_MSGQ_DEFINE(button_q, sizeof(struct button_msg), BUTTON_QUEUE_LEN, 4);
+
+static struct k_timer debounce_timer;
+static struct k_timer hold_timer;
+static struct k_timer tap_timer;
+
+/* Shared by the GPIO interrupt and the three timers */
+static struct k_spinlock lock;
+static struct {
+    bool pressed;               /* Debounced state */
+    bool settling;              /* Edges ignored until debounce_timer fires */
+    int64_t down_ms;
+    uint8_t taps;               /* Short presses in the current sequence */
+    uint8_t hold_stage;         /* 0 none, 1 HOLD sent, 2 LONG_HOLD sent */
+    uint32_t dropped;
+} btn;
+
+static void post(button_event_t event)
 {
-    int64_t press_duration = k_uptime_get() - press_start_time;
-
-    button_event_t event;
-    if (press_duration < SHORT_PRESS_MAX_MS) {
-        event = BUTTON_EVENT_SHORT_PRESS;
-        LOG_INF("Short press (%lld ms)", press_duration);
-    } else if (press_duration < MEDIUM_PRESS_MAX_MS) {
-        event = BUTTON_EVENT_MEDIUM_PRESS;
-        LOG_INF("Medium press (%lld ms)", press_duration);
-    } else {
-        event = BUTTON_EVENT_LONG_PRESS;
-        LOG_INF("Long press (%lld ms)", press_duration);
+    struct button_msg msg = {
+        .event = event,
+        .time_ms = k_uptime_get_32(),
+    };
+
+    OPENDOTT_TRACE("button", event, 0);
+
+    if (k_msgq_put(&button_q, &msg, K_NO_WAIT) < 0) {
+        btn.dropped++;
+    }
+}
+
+/* End the tap sequence, reporting how many taps it had */
+static void flush_taps(void)
+{
+    static const button_event_t tap_events[BUTTON_MAX_TAPS] = {
+        BUTTON_EVENT_SHORT_PRESS,
+        BUTTON_EVENT_DOUBLE_TAP,
+        BUTTON_EVENT_TRIPLE_TAP,
+    };
+
+    if (btn.taps > 0) {
+        post(tap_events[btn.taps - 1]);
+        btn.taps = 0;
+    }
+    k_timer_stop(&tap_timer);
+}
+
+static void state_changed(bool pressed)
+{
+    btn.pressed = pressed;
+
+    if (pressed) {
+        btn.down_ms = k_uptime_get();
+        btn.hold_stage = 0;
+        k_timer_stop(&tap_timer);
+        post(BUTTON_EVENT_DOWN);
+        k_timer_start(&hold_timer, K_MSEC(BUTTON_HOLD_MS), K_MSEC(BUTTON_REPEAT_MS));
+        return;
+    }
+
+    k_timer_stop(&hold_timer);
+    post(BUTTON_EVENT_UP);
+
+    if (btn.hold_stage > 0) {
+        post(btn.hold_stage > 1 ? BUTTON_EVENT_LONG_PRESS : BUTTON_EVENT_MEDIUM_PRESS);
+        return;
     }
 
-    if (user_callback) {
-        user_callback(event);
+    if (++btn.taps == BUTTON_MAX_TAPS) {
+        flush_taps();
+    } else {
+        k_timer_start(&tap_timer, K_MSEC(BUTTON_TAP_GAP_MS), K_NO_WAIT);
     }
 }
 
-/* GPIO interrupt callback */
+/* GPIO interrupt: report a change at once, then let the contacts settle */
 static void button_pressed(const struct device *dev, struct gpio_callback *cb,
                            uint32_t pins)
 {
-    int state = gpio_pin_get_dt(&button);
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (!btn.settling) {
+        bool level = gpio_pin_get_dt(&button) > 0;
+
+        if (level != btn.pressed) {
+            state_changed(level);
+        }
+        btn.settling = true;
+        k_timer_start(&debounce_timer, K_MSEC(BUTTON_DEBOUNCE_MS), K_NO_WAIT);
+    }
 
-    if (state) {
-        /* Button pressed */
-        press_start_time = k_uptime_get();
-        LOG_DBG("Button pressed");
+    k_spin_unlock(&lock, key);
+}
+
+/* Lockout over: catch an edge that bounced back during it */
+static void debounce_expired(struct k_timer *timer)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool level = gpio_pin_get_dt(&button) > 0;
+
+    btn.settling = false;
+    if (level != btn.pressed) {
+        state_changed(level);
+        btn.settling = true;
+        k_timer_start(&debounce_timer, K_MSEC(BUTTON_DEBOUNCE_MS), K_NO_WAIT);
+    }
+
+    k_spin_unlock(&lock, key);
+}
+
+/* First expiry at BUTTON_HOLD_MS, then every BUTTON_REPEAT_MS */
+static void hold_expired(struct k_timer *timer)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (!btn.pressed) {
+        k_spin_unlock(&lock, key);
+        return;
+    }
+
+    if (btn.hold_stage == 0) {
+        /* Taps before this press end their sequence here */
+        flush_taps();
+        btn.hold_stage = 1;
+        post(BUTTON_EVENT_HOLD);
+    } else if (btn.hold_stage == 1 &&
+               k_uptime_get() - btn.down_ms >= BUTTON_LONG_HOLD_MS) {
+        btn.hold_stage = 2;
+        post(BUTTON_EVENT_LONG_HOLD);
     } else {
-        /* Button released - schedule work to process */
-        k_work_schedule(&button_work, K_MSEC(10));  /* Small debounce */
-        LOG_DBG("Button released");
+        post(BUTTON_EVENT_HOLD_REPEAT);
     }
+
+    k_spin_unlock(&lock, key);
 }
 
+static void tap_expired(struct k_timer *timer)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (!btn.pressed) {
+        flush_taps();
+    }
+
+    k_spin_unlock(&lock, key);
+}
+
+static void button_thread(void *p1, void *p2, void *p3)
+{
+    struct button_msg msg;
+    uint32_t reported_drops = 0;
+
+    while (1) {
+        k_msgq_get(&button_q, &msg, K_FOREVER);
+
+        if (btn.dropped != reported_drops) {
+            LOG_WRN("%u button events dropped", btn.dropped - reported_drops);
+            reported_drops = btn.dropped;
+        }
+
+        LOG_DBG("Event %u, %u ms after it was raised", msg.event,
+                k_uptime_get_32() - msg.time_ms);
+
+        if (user_callback) {
+            user_callback(msg.event);
+        }
+    }
+}
+
+K_THREAD_DEFINE(button_tid, BUTTON_STACK_SIZE, button_thread, NULL, NULL, NULL,
+                BUTTON_PRIORITY, 0, 0);
+
 int button_init(button_callback_t callback)
 {
     int ret;
@@ -86,6 +244,10 @@ int button_init(button_callback_t callback)
         return ret;
     }
 
+    k_timer_init(&debounce_timer, debounce_expired, NULL);
+    k_timer_init(&hold_timer, hold_expired, NULL);
+    k_timer_init(&tap_timer, tap_expired, NULL);
+
     /* Configure interrupt on both edges */
     ret = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
     if (ret < 0) {
@@ -101,9 +263,6 @@ int button_init(button_callback_t callback)
         return ret;
     }
 
-    /* Initialize work item */
-    k_work_init_delayable(&button_work, button_work_handler);
-
     LOG_INF("Button initialized on pin %d", button.pin);
     return 0;
 }
@@ -0,0 +1,355 @@
+/*
+ * OpenDOTT - Color Correction
+ * SPDX-License-Identifier: MIT
+ *
+ * Gamma, white balance and saturation for the panel, which shows colors
+ * differently from the screen the media was made on. Corrections are
+ * applied where colors are converted to RGB565, not per pixel: palettes
+ * are corrected as they are read (gif_decoder.c), so indexed playback pays
+ * nothing for it. RGB565 media (native frames) goes through three small
+ * per-channel tables. Those carry gamma and white balance; saturation
+ * mixes the channels, so it is only applied to palettes.
+ *
+ * LUTs built with a profile (the GIF index, frame caches) record its id
+ * and are rebuilt once it changes. The profile is kept in LittleFS.
+ *
+ * Converting to RGB565 drops the low bits of each channel, which shows as
+ * banding in gradients. Each converted color also yields those bits (the
+ * residual), and images flagged for dithering get them back as a 4x4
+ * ordered dither: a channel rounds up where its residual beats the Bayer
+ * threshold for that pixel. One compare per channel, no division.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(color, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Not a valid media name, so no upload can shadow it */
+#define COLOR_PROFILE_NAME      ".color"
+#define COLOR_PROFILE_EXT       "cfg"
+#define COLOR_PROFILE_MAGIC     0x4C4F434F  /* 'OCOL' */
+#define COLOR_PROFILE_VERSION   1
+
+#define COLOR_GAMMA_MIN         25      /* x100 */
+#define COLOR_GAMMA_MAX         400
+
+struct color_record {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved[3];
+    struct color_profile profile;
+} __packed;
+
+static const struct color_profile identity = COLOR_PROFILE_NONE;
+
+static struct color_profile profile = COLOR_PROFILE_NONE;
+static uint16_t profile_id;             /* 0 while the profile is identity */
+
+/* Gamma and gain per channel, 8 bits in and out */
+static uint8_t curve[3][256];
+
+/* The same for RGB565 input, already shifted into place */
+static uint16_t curve565_r[32];
+static uint16_t curve565_g[64];
+static uint16_t curve565_b[32];
+
+/* 4x4 Bayer matrix, [y & 3][x & 3], thresholds 0..15 */
+static const uint8_t bayer4[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+/* 2^(2^-k) for k = 1.., in Q16 */
+static const uint32_t exp2_roots[] = {
+    92682, 77936, 71468, 68438, 66971, 66250, 65892, 65714, 65625, 65580, 65558, 65547,
+};
+
+/* log2(x / 65536) in Q16, for 0 < x <= 65536 */
+static int32_t log2_q16(uint32_t x)
+{
+    int32_t result = 0;
+
+    while (x < 65536) {
+        x <<= 1;
+        result -= 65536;
+    }
+
+    /* Fraction bits, one per squaring */
+    for (uint32_t bit = 32768; bit; bit >>= 1) {
+        x = (uint32_t)(((uint64_t)x * x) >> 16);
+        if (x >= 131072) {
+            x >>= 1;
+            result += bit;
+        }
+    }
+    return result;
+}
+
+/* 2^(y / 65536) in Q16, for y <= 0 */
+static uint32_t exp2_q16(int32_t y)
+{
+    int32_t whole = y >> 16;            /* Rounds down */
+    uint32_t frac = y & 0xFFFF;
+    uint32_t result = 65536;
+
+    for (int k = 0; k < ARRAY_SIZE(exp2_roots); k++) {
+        if (frac & (32768U >> k)) {
+            result = (uint32_t)(((uint64_t)result * exp2_roots[k]) >> 16);
+        }
+    }
+
+    /* Only the fraction's result can reach 2.0; whole is <= -1 then */
+    return whole <= -32 ? 0 : result >> -whole;
+}
+
+static uint8_t apply_gamma(uint8_t value, uint16_t gamma_x100)
+{
+    if (value == 0 || value == 255 || gamma_x100 == 100) {
+        return value;
+    }
+
+    int32_t l = log2_q16((uint32_t)value * 65536 / 255);
+    uint32_t e = exp2_q16((int64_t)l * gamma_x100 / 100);
+
+    return MIN((e * 255 + 32768) >> 16, 255);
+}
+
+static void build_curves(void)
+{
+    for (int ch = 0; ch < 3; ch++) {
+        for (int v = 0; v < 256; v++) {
+            uint32_t c = apply_gamma(v, profile.gamma_x100);
+
+            curve[ch][v] = MIN(c * profile.gain[ch] / 100, 255);
+        }
+    }
+
+    for (int v = 0; v < 32; v++) {
+        uint8_t v8 = (v << 3) | (v >> 2);
+
+        curve565_r[v] = (curve[0][v8] & 0xF8) << 8;
+        curve565_b[v] = curve[2][v8] >> 3;
+    }
+    for (int v = 0; v < 64; v++) {
+        uint8_t v8 = (v << 2) | (v >> 4);
+
+        curve565_g[v] = (curve[1][v8] & 0xFC) << 3;
+    }
+
+    if (memcmp(&profile, &identity, sizeof(profile)) == 0) {
+        profile_id = 0;
+    } else {
+        profile_id = crc16_ccitt(0xFFFF, (const uint8_t *)&profile, sizeof(profile));
+        profile_id = profile_id ? profile_id : 1;
+    }
+}
+
+/* RGB888 to CPU-order RGB565, corrected. RESIDUAL (may be NULL) gets the
+ * bits lost to truncation, RRRGGBBB, for color_dither_row() */
+uint16_t color_to_rgb565(uint8_t r, uint8_t g, uint8_t b, uint8_t *residual)
+{
+    if (profile_id != 0) {
+        if (profile.saturation != 100) {
+            int32_t y = (77 * r + 150 * g + 29 * b) >> 8;
+
+            r = CLAMP(y + (r - y) * profile.saturation / 100, 0, 255);
+            g = CLAMP(y + (g - y) * profile.saturation / 100, 0, 255);
+            b = CLAMP(y + (b - y) * profile.saturation / 100, 0, 255);
+        }
+        r = curve[0][r];
+        g = curve[1][g];
+        b = curve[2][b];
+    }
+
+    if (residual) {
+        /* A channel at full scale has nowhere to round up to */
+        *residual = (r < 0xF8 ? (r & 7) << 5 : 0) |
+                    (g < 0xFC ? (g & 3) << 3 : 0) |
+                    (b < 0xF8 ? b & 7 : 0);
+    }
+
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+/* Palette indexes to panel pixels for row Y, each rounded up per channel
+ * where its residual beats the Bayer threshold. Red and blue residuals are
+ * eighths of a step, green quarters */
+OPENDOTT_RAMFUNC void color_dither_row(uint16_t *out, const uint8_t *idx, const uint16_t *lut,
+                                       const uint8_t *residuals, size_t count, uint16_t y)
+{
+    const uint8_t *t = bayer4[y & 3];
+
+    for (size_t x = 0; x < count; x++) {
+        uint8_t e = residuals[idx[x]];
+
+        if (e == 0) {
+            out[x] = lut[idx[x]];
+            continue;
+        }
+
+        uint8_t th = t[x & 3];
+        uint16_t c = sys_be16_to_cpu(lut[idx[x]]);
+
+        c += ((e >> 5) > (th >> 1)) << 11;
+        c += (((e >> 3) & 3) > (th >> 2)) << 5;
+        c += (e & 7) > (th >> 1);
+        out[x] = sys_cpu_to_be16(c);
+    }
+}
+
+/* The four Bayer thresholds (0..15) along row Y, for callers that dither
+ * their own arithmetic */
+const uint8_t *color_dither_thresholds(uint16_t y)
+{
+    return bayer4[y & 3];
+}
+
+/* Correct panel-order RGB565 pixels in place (gamma and white balance) */
+OPENDOTT_RAMFUNC void color_correct_rgb565(uint16_t *pixels, size_t count)
+{
+    if (profile_id == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint16_t c = sys_be16_to_cpu(pixels[i]);
+
+        pixels[i] = sys_cpu_to_be16(curve565_r[c >> 11] | curve565_g[(c >> 5) & 0x3F] |
+                                    curve565_b[c & 0x1F]);
+    }
+}
+
+/* Identifies the profile LUTs were built with; 0 for no correction */
+uint16_t color_profile_id(void)
+{
+    return profile_id;
+}
+
+void color_get_profile(struct color_profile *out)
+{
+    *out = profile;
+}
+
+/* Use NEW from now on and remember it. LUTs already built stay as they are
+ * until rebuilt, i.e. on the next open of their media */
+int color_set_profile(const struct color_profile *new_profile)
+{
+    if (new_profile->gamma_x100 < COLOR_GAMMA_MIN ||
+        new_profile->gamma_x100 > COLOR_GAMMA_MAX) {
+        return -EINVAL;
+    }
+
+    struct color_record rec = {
+        .magic = COLOR_PROFILE_MAGIC,
+        .version = COLOR_PROFILE_VERSION,
+        .profile = *new_profile,
+    };
+    struct fs_file_t file;
+
+    profile = *new_profile;
+    build_curves();
+
+    int ret = storage_meta_open(COLOR_PROFILE_NAME, COLOR_PROFILE_EXT, true, &file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_write(&file, 0, &rec, sizeof(rec));
+    storage_file_close(&file);
+    return ret < 0 ? ret : 0;
+}
+
+/* Load the saved profile; call once storage is up, before anything is
+ * decoded */
+int color_init(void)
+{
+    struct color_record rec;
+
+    build_curves();
+
+    int ret = storage_meta_read(COLOR_PROFILE_NAME, COLOR_PROFILE_EXT, 0, &rec, sizeof(rec));
+    if (ret != sizeof(rec) || rec.magic != COLOR_PROFILE_MAGIC ||
+        rec.version != COLOR_PROFILE_VERSION ||
+        rec.profile.gamma_x100 < COLOR_GAMMA_MIN ||
+        rec.profile.gamma_x100 > COLOR_GAMMA_MAX) {
+        return 0;
+    }
+
+    profile = rec.profile;
+    build_curves();
+    LOG_INF("Color profile %04x: gamma %u, gain %u/%u/%u, saturation %u", profile_id,
+            profile.gamma_x100, profile.gain[0], profile.gain[1], profile.gain[2],
+            profile.saturation);
+    return 0;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_color_show(const struct shell *sh, size_t argc, char **argv)
+{
+    shell_print(sh, "Profile %04x: gamma %u.%02u, gain R %u%% G %u%% B %u%%, saturation %u%%",
+                profile_id, profile.gamma_x100 / 100, profile.gamma_x100 % 100,
+                profile.gain[0], profile.gain[1], profile.gain[2], profile.saturation);
+    return 0;
+}
+
+static int apply(const struct shell *sh, const struct color_profile *new_profile)
+{
+    int ret = color_set_profile(new_profile);
+    if (ret == -EINVAL) {
+        shell_error(sh, "Gamma must be %u..%u (x100)", COLOR_GAMMA_MIN, COLOR_GAMMA_MAX);
+        return ret;
+    }
+    if (ret < 0) {
+        shell_error(sh, "Applied, but not saved: %d", ret);
+    }
+
+    /* Redraw with LUTs built for the new profile */
+    player_play(NULL);
+    return cmd_color_show(sh, 0, NULL);
+}
+
+static int cmd_color_set(const struct shell *sh, size_t argc, char **argv)
+{
+    struct color_profile new_profile = profile;
+
+    new_profile.gamma_x100 = strtoul(argv[1], NULL, 0);
+    for (int ch = 0; ch < 3 && ch + 2 < argc; ch++) {
+        new_profile.gain[ch] = MIN(strtoul(argv[ch + 2], NULL, 0), UINT8_MAX);
+    }
+    if (argc > 5) {
+        new_profile.saturation = MIN(strtoul(argv[5], NULL, 0), UINT8_MAX);
+    }
+
+    return apply(sh, &new_profile);
+}
+
+static int cmd_color_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    return apply(sh, &identity);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(color_cmds,
+    SHELL_CMD(show, NULL, "Show the color profile", cmd_color_show),
+    SHELL_CMD_ARG(set, NULL,
+                  "Set the profile (percent, 100 = unchanged): "
+                  "set <gamma x100> [gain R] [gain G] [gain B] [saturation]",
+                  cmd_color_set, 2, 4),
+    SHELL_CMD(reset, NULL, "Turn color correction off", cmd_color_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(color, &color_cmds, "Color correction", NULL);
+#endif /* CONFIG_SHELL */
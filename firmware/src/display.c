@@ -6,6 +6,22 @@
  * 
  * Note: Using minimal direct SPI implementation due to Zephyr driver bug
  * with display-inversion boolean property handling.
+ *
+ * With CONFIG_OPENDOTT_MOCK_PANEL (native_sim) the same command stream goes
+ * to the GC9A01 model in mock_panel.c instead of SPI.
+ *
+ * Rotation is done by the panel: MADCTL changes the order it writes its
+ * RAM in, so a rotated frame is sent exactly like an upright one. The
+ * GC9A01's RAM is exactly 240x240, so the CASET/RASET window needs no
+ * offset in any orientation.
+ *
+ * The panel's gamma curves (0xF0-0xF3) can be replaced too; until they are,
+ * the panel keeps its power-on defaults. Color correction that the panel
+ * cannot do is folded into the palettes instead (color.c). Both settings
+ * are kept in LittleFS.
+ *
+ * The panel shows its frame memory without help, so while a still is up
+ * the SPI controller is suspended (power.c); every write wakes it first.
  */
 
 #include <zephyr/kernel.h>
@@ -13,13 +29,21 @@
 #include <zephyr/drivers/spi.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/pwm.h>
+#include <zephyr/pm/device.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <string.h>
 
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#endif
+
 #include "opendott.h"
 
 LOG_MODULE_REGISTER(display, CONFIG_LOG_DEFAULT_LEVEL);
 
+#ifndef CONFIG_OPENDOTT_MOCK_PANEL
 /* Backlight PWM */
 static const struct pwm_dt_spec backlight = PWM_DT_SPEC_GET(DT_ALIAS(pwm_led0));
 
@@ -28,11 +52,79 @@ static const struct spi_dt_spec spi_dev = SPI_DT_SPEC_GET(DT_NODELABEL(gc9a01),
     SPI_OP_MODE_MASTER | SPI_WORD_SET(8), 0);
 static const struct gpio_dt_spec dc_gpio = GPIO_DT_SPEC_GET(DT_NODELABEL(gc9a01), cmd_data_gpios);
 static const struct gpio_dt_spec reset_gpio = GPIO_DT_SPEC_GET(DT_NODELABEL(gc9a01), reset_gpios);
+#endif
+
+/* Memory access control: upright is MX + BGR; the rotations swap and
+ * mirror the write order on top of that */
+#define GC9A01_MADCTL       0x36
+#define MADCTL_MY           BIT(7)
+#define MADCTL_MX           BIT(6)
+#define MADCTL_MV           BIT(5)
+#define MADCTL_BGR          BIT(3)
+#define MADCTL_UPRIGHT      (MADCTL_MX | MADCTL_BGR)
+
+/* Persisted settings; not a valid media name, so no upload can shadow it */
+#define DISPLAY_SETTINGS_NAME    ".display"
+#define DISPLAY_SETTINGS_EXT     "cfg"
+#define DISPLAY_SETTINGS_MAGIC   0x5053444F  /* 'ODSP' */
+#define DISPLAY_SETTINGS_VERSION 2
+
+/* Positive and negative gamma curves, two registers each */
+#define GC9A01_SET_GAMMA1   0xF0
+
+struct display_settings {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t rotation;
+    uint8_t gamma_set;          /* Bit N: gamma[N] replaces the default */
+    uint8_t reserved;
+    uint8_t gamma[DISPLAY_GAMMA_REGS][DISPLAY_GAMMA_LEN];
+} __packed;
+
+/* Clockwise rotation of the picture, relative to upright */
+static const uint8_t rotation_madctl[DISPLAY_ROTATION_COUNT] = {
+    [DISPLAY_ROTATION_0] = MADCTL_UPRIGHT,
+    [DISPLAY_ROTATION_90] = MADCTL_UPRIGHT ^ (MADCTL_MV | MADCTL_MX),
+    [DISPLAY_ROTATION_180] = MADCTL_UPRIGHT ^ (MADCTL_MX | MADCTL_MY),
+    [DISPLAY_ROTATION_270] = MADCTL_UPRIGHT ^ (MADCTL_MV | MADCTL_MY),
+};
+
+/* Palette index rows are converted to RGB565, and clears sent, this many
+ * lines at a time */
+#define DISPLAY_STRIP_LINES MEDIA_STRIP_LINES
+
+static uint16_t strip_buf[DISPLAY_WIDTH * DISPLAY_STRIP_LINES]
+    __aligned(OPENDOTT_STRIP_ALIGN) OPENDOTT_STRIP_RAM;
 
 /* Current brightness (0-100) */
 static uint8_t current_brightness = 100;
 static bool display_initialized = false;
 
+static enum display_rotation rotation = DISPLAY_ROTATION_0;
+static uint8_t gamma_set;
+static uint8_t gamma[DISPLAY_GAMMA_REGS][DISPLAY_GAMMA_LEN];
+
+/* Register writes waiting for the next frame start */
+#define PENDING_MADCTL      BIT(0)
+#define PENDING_GAMMA       BIT(1)
+static atomic_t pending;
+
+#ifdef CONFIG_OPENDOTT_MOCK_PANEL
+static int display_send_cmd(uint8_t cmd)
+{
+    return mock_panel_cmd(cmd);
+}
+
+static int display_send_data(const uint8_t *data, size_t len)
+{
+    return mock_panel_data(data, len);
+}
+
+static int display_hw_reset(void)
+{
+    return 0;
+}
+#else
 /* Send command to display */
 static int display_send_cmd(uint8_t cmd)
 {
@@ -41,7 +133,10 @@ static int display_send_cmd(uint8_t cmd)
     struct spi_buf buf = { .buf = &cmd, .len = 1 };
     struct spi_buf_set bufs = { .buffers = &buf, .count = 1 };
     
-    return spi_write_dt(&spi_dev, &bufs);
+    power_get();
+    int ret = spi_write_dt(&spi_dev, &bufs);
+    power_put();
+    return ret;
 }
 
 /* Send data to display */
@@ -52,10 +147,13 @@ static int display_send_data(const uint8_t *data, size_t len)
     struct spi_buf buf = { .buf = (void *)data, .len = len };
     struct spi_buf_set bufs = { .buffers = &buf, .count = 1 };
     
-    return spi_write_dt(&spi_dev, &bufs);
+    power_get();
+    int ret = spi_write_dt(&spi_dev, &bufs);
+    power_put();
+    return ret;
 }
 
-int display_init(void)
+static int display_hw_reset(void)
 {
     int ret;
 
@@ -93,6 +191,17 @@ int display_init(void)
     gpio_pin_set_dt(&reset_gpio, 1);
     k_msleep(120);
 
+    return 0;
+}
+#endif /* CONFIG_OPENDOTT_MOCK_PANEL */
+
+int display_init(void)
+{
+    int ret = display_hw_reset();
+    if (ret < 0) {
+        return ret;
+    }
+
     /* Basic GC9A01 initialization sequence */
     display_send_cmd(0xEF);  /* Inter register enable 2 */
     display_send_cmd(0xEB);
@@ -102,8 +211,8 @@ int display_init(void)
     display_send_cmd(0xFE);  /* Inter register enable 1 */
     display_send_cmd(0xEF);  /* Inter register enable 2 */
     
-    display_send_cmd(0x36);  /* Memory access control */
-    uint8_t madctl = 0x48;   /* MX + BGR */
+    display_send_cmd(GC9A01_MADCTL);  /* Memory access control */
+    uint8_t madctl = rotation_madctl[rotation];
     display_send_data(&madctl, 1);
     
     display_send_cmd(0x3A);  /* Pixel format */
@@ -118,24 +227,50 @@ int display_init(void)
     display_send_cmd(0x29);  /* Display on */
     k_msleep(20);
 
+#ifndef CONFIG_OPENDOTT_MOCK_PANEL
     /* Initialize backlight */
     if (pwm_is_ready_dt(&backlight)) {
         opendott_set_brightness(100);
     } else {
         LOG_WRN("Backlight PWM not ready");
     }
+#endif
 
     display_initialized = true;
     LOG_INF("Display initialized: %dx%d", DISPLAY_WIDTH, DISPLAY_HEIGHT);
     return 0;
 }
 
+/* A new MADCTL between two RAM writes only changes where the next one
+ * lands, and a new gamma curve halfway down would show as a band, so
+ * register changes wait for the start of a frame */
+static void apply_pending(void)
+{
+    atomic_val_t changes = atomic_clear(&pending);
+
+    if (changes & PENDING_MADCTL) {
+        uint8_t madctl = rotation_madctl[rotation];
+
+        display_send_cmd(GC9A01_MADCTL);
+        display_send_data(&madctl, 1);
+    }
+
+    for (int reg = 0; reg < DISPLAY_GAMMA_REGS && (changes & PENDING_GAMMA); reg++) {
+        if (gamma_set & BIT(reg)) {
+            display_send_cmd(GC9A01_SET_GAMMA1 + reg);
+            display_send_data(gamma[reg], DISPLAY_GAMMA_LEN);
+        }
+    }
+}
+
 void display_clear(uint16_t color)
 {
     if (!display_initialized) {
         return;
     }
 
+    apply_pending();
+
     /* Set column address (0-239) */
     display_send_cmd(0x2A);
     uint8_t col_data[] = {0x00, 0x00, 0x00, 0xEF};
@@ -149,25 +284,41 @@ void display_clear(uint16_t color)
     /* Write to RAM */
     display_send_cmd(0x2C);
 
-    /* Fill with color (RGB565, big-endian) */
-    uint8_t color_be[2] = { (color >> 8) & 0xFF, color & 0xFF };
-    
-    gpio_pin_set_dt(&dc_gpio, 1);  /* Data mode */
-    
-    /* Write line by line to avoid large buffers */
-    uint8_t line_buf[DISPLAY_WIDTH * 2];
-    for (int i = 0; i < DISPLAY_WIDTH; i++) {
-        line_buf[i * 2] = color_be[0];
-        line_buf[i * 2 + 1] = color_be[1];
+    /* Fill a strip with the color (RGB565, big-endian) and send it as
+     * often as it takes; strip_buf is free outside display_draw_indexed() */
+    uint16_t color_be = sys_cpu_to_be16(color);
+
+    for (size_t i = 0; i < ARRAY_SIZE(strip_buf); i++) {
+        strip_buf[i] = color_be;
     }
-    
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        struct spi_buf buf = { .buf = line_buf, .len = sizeof(line_buf) };
-        struct spi_buf_set bufs = { .buffers = &buf, .count = 1 };
-        spi_write_dt(&spi_dev, &bufs);
+
+    for (int y = 0; y < DISPLAY_HEIGHT; y += DISPLAY_STRIP_LINES) {
+        int lines = MIN(DISPLAY_STRIP_LINES, DISPLAY_HEIGHT - y);
+        display_send_data((const uint8_t *)strip_buf, lines * DISPLAY_WIDTH * DISPLAY_BPP);
     }
 }
 
+/* Suspend or resume the panel SPI controller; the panel keeps showing what
+ * it has. Only power.c calls this, with no writes in flight */
+int display_bus_suspend(bool suspend)
+{
+#if defined(CONFIG_PM_DEVICE) && !defined(CONFIG_OPENDOTT_MOCK_PANEL)
+    int ret = pm_device_action_run(spi_dev.bus, suspend ? PM_DEVICE_ACTION_SUSPEND :
+                                                          PM_DEVICE_ACTION_RESUME);
+    return ret == -EALREADY ? 0 : ret;
+#else
+    return 0;
+#endif
+}
+
+/* A full frame has been sent (the mock panel dumps it) */
+void display_frame_end(void)
+{
+#ifdef CONFIG_OPENDOTT_MOCK_PANEL
+    mock_panel_frame_end();
+#endif
+}
+
 int opendott_set_brightness(uint8_t brightness)
 {
     if (brightness > 100) {
@@ -176,6 +327,9 @@ int opendott_set_brightness(uint8_t brightness)
 
     current_brightness = brightness;
 
+#ifdef CONFIG_OPENDOTT_MOCK_PANEL
+    return 0;
+#else
     if (!pwm_is_ready_dt(&backlight)) {
         return -ENODEV;
     }
@@ -190,6 +344,7 @@ int opendott_set_brightness(uint8_t brightness)
 
     LOG_DBG("Brightness set to %d%%", brightness);
     return 0;
+#endif
 }
 
 int display_draw_buffer(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
@@ -205,6 +360,10 @@ int display_draw_buffer(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
         return -EINVAL;
     }
 
+    if (y == 0) {
+        apply_pending();
+    }
+
     /* Set column address */
     display_send_cmd(0x2A);
     uint8_t col_data[] = {
@@ -223,37 +382,231 @@ int display_draw_buffer(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
 
     /* Write to RAM */
     display_send_cmd(0x2C);
-    display_send_data(buf, width * height * DISPLAY_BPP);
+    OPENDOTT_TRACE("spi_start", y, width * height * DISPLAY_BPP);
+    int ret = display_send_data(buf, width * height * DISPLAY_BPP);
+    OPENDOTT_TRACE("spi_done", y, ret);
+
+    return ret;
+}
+
+static OPENDOTT_RAMFUNC void lut_expand(uint16_t *out, const uint8_t *in, size_t count,
+                                         const uint16_t *lut)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = lut[in[i]];
+    }
+}
+
+/* Draw full-width rows of palette indexes through a panel-order RGB565 LUT */
+int display_draw_indexed(uint16_t y, uint16_t height, const uint8_t *pixels,
+                         const uint16_t *lut)
+{
+    uint16_t lines;
+
+    for (uint16_t done = 0; done < height; done += lines) {
+        lines = MIN(DISPLAY_STRIP_LINES, height - done);
+
+        lut_expand(strip_buf, pixels + (size_t)done * DISPLAY_WIDTH,
+                   (size_t)lines * DISPLAY_WIDTH, lut);
+
+        int ret = display_draw_buffer(0, y + done, DISPLAY_WIDTH, lines,
+                                      (const uint8_t *)strip_buf);
+        if (ret < 0) {
+            return ret;
+        }
+    }
 
     return 0;
 }
 
+static int settings_write(void)
+{
+    struct display_settings settings = {
+        .magic = DISPLAY_SETTINGS_MAGIC,
+        .version = DISPLAY_SETTINGS_VERSION,
+        .rotation = rotation,
+        .gamma_set = gamma_set,
+    };
+    struct fs_file_t file;
+
+    memcpy(settings.gamma, gamma, sizeof(gamma));
+
+    int ret = storage_meta_open(DISPLAY_SETTINGS_NAME, DISPLAY_SETTINGS_EXT, true, &file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_write(&file, 0, &settings, sizeof(settings));
+    storage_file_close(&file);
+    return ret < 0 ? ret : 0;
+}
+
+/* Apply the settings saved by display_set_rotation() and
+ * display_set_gamma(); call once storage is up, before anything is drawn
+ * that they should apply to */
+int display_load_settings(void)
+{
+    struct display_settings settings;
+
+    int ret = storage_meta_read(DISPLAY_SETTINGS_NAME, DISPLAY_SETTINGS_EXT, 0,
+                                &settings, sizeof(settings));
+    if (ret != sizeof(settings) || settings.magic != DISPLAY_SETTINGS_MAGIC ||
+        settings.version != DISPLAY_SETTINGS_VERSION ||
+        settings.rotation >= DISPLAY_ROTATION_COUNT) {
+        return -ENOENT;
+    }
+
+    if (settings.rotation != rotation) {
+        rotation = settings.rotation;
+        atomic_or(&pending, PENDING_MADCTL);
+        LOG_INF("Rotation %d degrees", rotation * 90);
+    }
+
+    gamma_set = settings.gamma_set;
+    memcpy(gamma, settings.gamma, sizeof(gamma));
+    if (gamma_set) {
+        atomic_or(&pending, PENDING_GAMMA);
+    }
+    return 0;
+}
+
+/* Rotate the picture clockwise, from the next frame on, and remember it */
+int display_set_rotation(enum display_rotation new_rotation)
+{
+    if (new_rotation >= DISPLAY_ROTATION_COUNT) {
+        return -EINVAL;
+    }
+
+    rotation = new_rotation;
+    atomic_or(&pending, PENDING_MADCTL);
+    return settings_write();
+}
+
+/* Replace gamma register 0xF0 + REG from the next frame on, and remember
+ * it; VALUES NULL goes back to the default at the next boot */
+int display_set_gamma(uint8_t reg, const uint8_t *values)
+{
+    if (reg >= DISPLAY_GAMMA_REGS) {
+        return -EINVAL;
+    }
+
+    if (values) {
+        memcpy(gamma[reg], values, DISPLAY_GAMMA_LEN);
+        gamma_set |= BIT(reg);
+        atomic_or(&pending, PENDING_GAMMA);
+    } else {
+        gamma_set &= ~BIT(reg);
+    }
+    return settings_write();
+}
+
+enum display_rotation display_get_rotation(void)
+{
+    return rotation;
+}
+
+/* Copy the saved values of gamma register 0xF0 + REG; false while it is at
+ * the panel default */
+bool display_get_gamma(uint8_t reg, uint8_t *values)
+{
+    if (reg >= DISPLAY_GAMMA_REGS || !(gamma_set & BIT(reg))) {
+        return false;
+    }
+
+    memcpy(values, gamma[reg], DISPLAY_GAMMA_LEN);
+    return true;
+}
+
+/* Show the first frame of a stored image, streamed from flash */
 int display_show_image(const char *path)
 {
-    uint8_t *data = NULL;
-    size_t size = 0;
+    struct media_source src;
 
-    int ret = storage_load_image(path, &data, &size);
+    int ret = media_source_file_open(&src, path);
     if (ret < 0) {
-        LOG_ERR("Failed to load image '%s': %d", path, ret);
+        LOG_ERR("Failed to open image '%s': %d", path, ret);
         return ret;
     }
 
-    ret = image_decode_and_display(data, size);
-    k_free(data);
+    ret = media_show(&src);
+    media_source_close(&src);
 
+    if (ret < 0) {
+        LOG_ERR("Failed to show image '%s': %d", path, ret);
+    }
     return ret;
 }
 
-void display_gif(const uint8_t *data, size_t size)
+#ifdef CONFIG_SHELL
+static int cmd_display_rotate(const struct shell *sh, size_t argc, char **argv)
 {
-    if (!data || size == 0) {
-        LOG_ERR("Invalid GIF data");
-        return;
+    if (argc < 2) {
+        shell_print(sh, "Rotation: %d degrees", rotation * 90);
+        return 0;
+    }
+
+    int degrees = atoi(argv[1]);
+    if (degrees < 0 || degrees % 90 != 0 || degrees / 90 >= DISPLAY_ROTATION_COUNT) {
+        shell_error(sh, "Rotation must be 0, 90, 180 or 270");
+        return -EINVAL;
+    }
+
+    int ret = display_set_rotation(degrees / 90);
+    if (ret < 0) {
+        shell_error(sh, "Rotated, but not saved: %d", ret);
+    }
+
+    /* A still frame would otherwise stay as it was */
+    player_play(NULL);
+    return 0;
+}
+
+static int cmd_display_gamma(const struct shell *sh, size_t argc, char **argv)
+{
+    uint8_t values[DISPLAY_GAMMA_LEN];
+
+    if (argc < 2) {
+        for (int reg = 0; reg < DISPLAY_GAMMA_REGS; reg++) {
+            if (gamma_set & BIT(reg)) {
+                const uint8_t *g = gamma[reg];
+
+                shell_print(sh, "%02X: %02X %02X %02X %02X %02X %02X",
+                            GC9A01_SET_GAMMA1 + reg, g[0], g[1], g[2], g[3], g[4], g[5]);
+            } else {
+                shell_print(sh, "%02X: default", GC9A01_SET_GAMMA1 + reg);
+            }
+        }
+        return 0;
     }
 
-    int ret = image_decode_and_display(data, size);
+    int reg = strtol(argv[1], NULL, 16) - GC9A01_SET_GAMMA1;
+    if (reg < 0 || reg >= DISPLAY_GAMMA_REGS ||
+        (argc > 2 && argc != 2 + DISPLAY_GAMMA_LEN)) {
+        shell_error(sh, "Usage: gamma <F0-F3> [%d hex bytes | (none): default]",
+                    DISPLAY_GAMMA_LEN);
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < DISPLAY_GAMMA_LEN && argc > 2; i++) {
+        values[i] = strtoul(argv[2 + i], NULL, 16);
+    }
+
+    int ret = display_set_gamma(reg, argc > 2 ? values : NULL);
     if (ret < 0) {
-        LOG_ERR("Failed to display GIF: %d", ret);
+        shell_error(sh, "Not saved: %d", ret);
+    } else if (argc == 2) {
+        shell_print(sh, "Default from the next boot");
     }
+    return 0;
 }
+
+SHELL_STATIC_SUBCMD_SET_CREATE(display_cmds,
+    SHELL_CMD_ARG(rotate, NULL, "Show or set the rotation: rotate [0|90|180|270]",
+                  cmd_display_rotate, 1, 1),
+    SHELL_CMD_ARG(gamma, NULL, "Show or set panel gamma: gamma [F0-F3] [6 hex bytes]",
+                  cmd_display_gamma, 1, DISPLAY_GAMMA_LEN + 1),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(display, &display_cmds, "Display", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,959 @@
+/*
+ * OpenDOTT - GIF Decoder
+ * SPDX-License-Identifier: MIT
+ *
+ * Streaming GIF decoder that reads through a media source (a stored file,
+ * or memory) and composites frames into a 240x240 canvas of palette
+ * indexes. The logical screen is centered on the panel (and cropped if
+ * larger).
+ *
+ * The first open of a file builds an index in /.meta/NAME.idx: frame
+ * offsets, timing and disposal, plus the global palette already converted
+ * to panel-order RGB565. Later opens only read that, so seeking to a frame
+ * never re-parses the file. Memory sources are re-indexed on every open.
+ *
+ * Palettes are color corrected as they are converted (color.c); an index
+ * built with another color profile is rebuilt.
+ *
+ * A GIF whose later frames change nothing on the panel (empty or off-panel
+ * rectangles, as some tools write for stills) is reported as one frame, so
+ * it is drawn once instead of being played.
+ *
+ * The canvas has its own 256-entry LUT. A frame whose palette differs
+ * (a local color table, typically) has its colors merged into it: exact
+ * matches first, then slots no visible pixel uses, then the nearest color.
+ * Each LUT entry carries the bits its RGB565 color lost, so files flagged
+ * MEDIA_FLAG_DITHER are drawn with an ordered dither (color.c).
+ *
+ * Limitation: disposal 3 (restore previous) is treated as 1 (keep).
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(gif_decoder, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define GIF_INDEX_MAGIC      0x5849474F  /* 'OGIX' */
+#define GIF_INDEX_VERSION    4
+#define GIF_INDEX_EXT        "idx"
+#define GIF_MEM_INDEX_KEY    ".mem"     /* Index name for memory sources */
+
+#define GIF_MAX_FRAMES       1024
+#define GIF_DEFAULT_DELAY_MS 100
+#define GIF_READ_BUF_SIZE    CONFIG_OPENDOTT_GIF_READ_BUF_SIZE
+
+#define GIF_DESC_INTERLACED  BIT(0)
+#define GIF_DESC_TRANSPARENT BIT(1)
+
+/* Disposal methods (GCE packed bits 2-4) */
+#define GIF_DISPOSE_BACKGROUND 2
+
+/* Index header flags */
+#define GIF_INDEX_STILL      BIT(0)  /* Frames after the first change nothing */
+
+struct gif_index_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t gct_bits;       /* 0 when there is no global color table */
+    uint8_t bg_index;
+    uint8_t flags;
+    uint16_t width;
+    uint16_t height;
+    uint16_t frame_count;
+    uint16_t loop_count;
+    uint32_t source_size;
+    uint16_t color_id;      /* Profile the palette was corrected with */
+} __packed;
+
+/* The header is followed by the global palette, its residuals, then the
+ * frame table */
+#define GIF_INDEX_RES_OFFSET \
+    (sizeof(struct gif_index_header) + GIF_PALETTE_SIZE * sizeof(uint16_t))
+#define GIF_INDEX_FRAMES_OFFSET (GIF_INDEX_RES_OFFSET + GIF_PALETTE_SIZE)
+
+/* Buffered reader over the source */
+struct gif_reader {
+    struct media_source *src;
+    size_t pos;             /* File offset of buf[0] */
+    size_t len;
+    size_t idx;
+    int err;
+    uint8_t buf[GIF_READ_BUF_SIZE];
+};
+
+static K_MUTEX_DEFINE(gif_lock);
+
+static struct gif_reader rd;
+static struct media_source file_src;
+static bool owns_src;
+static struct gif_index_header index_hdr;
+static struct gif_info info;
+static char gif_name[32];
+static bool gif_open = false;
+static uint16_t next_frame;
+static bool dither;                     /* MEDIA_FLAG_DITHER of the open file */
+
+static uint8_t canvas[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+static uint16_t canvas_lut[GIF_PALETTE_SIZE];
+static uint16_t global_lut[GIF_PALETTE_SIZE];
+static uint16_t local_lut[GIF_PALETTE_SIZE];
+
+/* Bits each LUT color lost to RGB565, for dithering */
+static uint8_t canvas_res[GIF_PALETTE_SIZE];
+static uint8_t global_res[GIF_PALETTE_SIZE];
+static uint8_t local_res[GIF_PALETTE_SIZE];
+
+/* Frame palette -> canvas LUT mapping, filled in lazily per color */
+static const uint16_t *frame_pal;
+static const uint8_t *frame_res;
+static bool remap_identity;
+static uint8_t remap[GIF_PALETTE_SIZE];
+static uint32_t remap_done[GIF_PALETTE_SIZE / 32];
+static uint32_t slot_used[GIF_PALETTE_SIZE / 32];
+
+/* LZW tables */
+static uint16_t lzw_prefix[GIF_LZW_MAX_CODES] OPENDOTT_DECODE_RAM;
+static uint8_t lzw_suffix[GIF_LZW_MAX_CODES] OPENDOTT_DECODE_RAM;
+static uint8_t lzw_stack[GIF_LZW_MAX_CODES + 1] OPENDOTT_DECODE_RAM;
+
+/* Output cursor for the frame being decoded */
+static struct gif_frame_info cur;
+static int cur_x0, cur_y0;
+static uint16_t cur_col, cur_row, cur_pass;
+static uint32_t cur_left;
+
+static int rd_fill(void)
+{
+    rd.pos += rd.len;
+    rd.idx = 0;
+
+    ssize_t ret = media_source_read(rd.src, rd.pos, rd.buf, sizeof(rd.buf));
+    if (ret <= 0) {
+        rd.len = 0;
+        rd.err = ret < 0 ? ret : OPENDOTT_ERR_DECODE_FAILED;
+        return rd.err;
+    }
+
+    rd.len = ret;
+    return 0;
+}
+
+static void rd_seek(size_t offset)
+{
+    rd.pos = offset;
+    rd.len = 0;
+    rd.idx = 0;
+    rd.err = 0;
+}
+
+static size_t rd_tell(void)
+{
+    return rd.pos + rd.idx;
+}
+
+static uint8_t rd_byte(void)
+{
+    if (rd.idx >= rd.len && rd_fill() < 0) {
+        return 0;
+    }
+    return rd.buf[rd.idx++];
+}
+
+static void rd_bytes(uint8_t *out, size_t len)
+{
+    while (len-- > 0) {
+        *out++ = rd_byte();
+    }
+}
+
+static void rd_skip(size_t len)
+{
+    if (rd.idx + len <= rd.len) {
+        rd.idx += len;
+    } else {
+        rd.pos = rd_tell() + len;
+        rd.len = 0;
+        rd.idx = 0;
+    }
+}
+
+/* Skip a run of data sub-blocks up to and including the terminator */
+static void rd_skip_blocks(void)
+{
+    uint8_t len;
+
+    while ((len = rd_byte()) != 0 && rd.err == 0) {
+        rd_skip(len);
+    }
+}
+
+/* Read a color table of 2^(bits) entries into a panel-order RGB565 LUT
+ * and its residuals */
+static void read_palette(uint16_t *lut, uint8_t *res, uint8_t bits)
+{
+    size_t count = 1U << bits;
+    uint8_t rgb[3];
+
+    memset(lut, 0, GIF_PALETTE_SIZE * sizeof(uint16_t));
+    memset(res, 0, GIF_PALETTE_SIZE);
+    for (size_t i = 0; i < count; i++) {
+        rd_bytes(rgb, 3);
+        lut[i] = sys_cpu_to_be16(color_to_rgb565(rgb[0], rgb[1], rgb[2], &res[i]));
+    }
+}
+
+/* Panel position of the logical screen origin */
+static int screen_x0(void)
+{
+    return (DISPLAY_WIDTH - (int)index_hdr.width) / 2;
+}
+
+static int screen_y0(void)
+{
+    return (DISPLAY_HEIGHT - (int)index_hdr.height) / 2;
+}
+
+/* Whether any of FRAME's rectangle lands on the panel */
+static bool frame_on_panel(const struct gif_frame_info *frame)
+{
+    int x0 = screen_x0() + frame->x;
+    int y0 = screen_y0() + frame->y;
+
+    return frame->w > 0 && frame->h > 0 && x0 < DISPLAY_WIDTH && y0 < DISPLAY_HEIGHT &&
+           x0 + frame->w > 0 && y0 + frame->h > 0;
+}
+
+static int index_build(const char *name, size_t source_size)
+{
+    struct fs_file_t out;
+    struct gif_frame_info frame;
+    uint8_t hdr[13];
+    uint8_t gce_packed = 0;
+    uint16_t gce_delay = 0;
+    uint8_t gce_transparent = 0;
+    bool done = false;
+    bool changes = false;       /* A frame after the first changes the panel */
+    bool clears = false;        /* The last frame is cleared before the next */
+
+    rd_seek(0);
+    rd_bytes(hdr, sizeof(hdr));
+    if (rd.err || memcmp(hdr, "GIF", 3) != 0) {
+        return OPENDOTT_ERR_INVALID_FORMAT;
+    }
+
+    memset(&index_hdr, 0, sizeof(index_hdr));
+    index_hdr.magic = GIF_INDEX_MAGIC;
+    index_hdr.version = GIF_INDEX_VERSION;
+    index_hdr.width = sys_get_le16(&hdr[6]);
+    index_hdr.height = sys_get_le16(&hdr[8]);
+    index_hdr.bg_index = hdr[11];
+    index_hdr.source_size = source_size;
+    index_hdr.color_id = color_profile_id();
+
+    if (index_hdr.width == 0 || index_hdr.height == 0) {
+        return OPENDOTT_ERR_INVALID_FORMAT;
+    }
+
+    if (hdr[10] & 0x80) {
+        index_hdr.gct_bits = (hdr[10] & 0x07) + 1;
+        read_palette(global_lut, global_res, index_hdr.gct_bits);
+    } else {
+        memset(global_lut, 0, sizeof(global_lut));
+        memset(global_res, 0, sizeof(global_res));
+    }
+
+    int ret = storage_meta_open(name, GIF_INDEX_EXT, true, &out);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_write(&out, sizeof(index_hdr), global_lut, sizeof(global_lut));
+    if (ret >= 0) {
+        ret = storage_file_write(&out, GIF_INDEX_RES_OFFSET, global_res, sizeof(global_res));
+    }
+
+    while (ret >= 0 && !done && rd.err == 0) {
+        uint8_t block = rd_byte();
+
+        switch (block) {
+        case 0x21: {
+            uint8_t label = rd_byte();
+            uint8_t len = rd_byte();
+            uint8_t app[11];
+
+            if (label == 0xF9 && len == 4) {
+                gce_packed = rd_byte();
+                gce_delay = rd_byte();
+                gce_delay |= rd_byte() << 8;
+                gce_transparent = rd_byte();
+                len = 0;
+            } else if (label == 0xFF && len == sizeof(app)) {
+                rd_bytes(app, sizeof(app));
+                len = rd_byte();
+                if (len == 0) {
+                    break;
+                }
+                if (memcmp(app, "NETSCAPE2.0", sizeof(app)) == 0 && len >= 3) {
+                    uint8_t id = rd_byte();
+                    uint16_t loops = rd_byte();
+
+                    loops |= rd_byte() << 8;
+                    if (id == 1) {
+                        index_hdr.loop_count = loops;
+                    }
+                    len -= 3;
+                }
+            }
+            rd_skip(len);
+            rd_skip_blocks();
+            break;
+        }
+        case 0x2C: {
+            uint8_t desc[9];
+
+            if (index_hdr.frame_count >= GIF_MAX_FRAMES) {
+                ret = OPENDOTT_ERR_FILE_TOO_LARGE;
+                break;
+            }
+
+            memset(&frame, 0, sizeof(frame));
+            frame.offset = rd_tell() - 1;
+            rd_bytes(desc, sizeof(desc));
+            frame.x = sys_get_le16(&desc[0]);
+            frame.y = sys_get_le16(&desc[2]);
+            frame.w = sys_get_le16(&desc[4]);
+            frame.h = sys_get_le16(&desc[6]);
+            frame.delay_ms = gce_delay > 1 ? gce_delay * 10 : GIF_DEFAULT_DELAY_MS;
+            frame.disposal = (gce_packed >> 2) & 0x07;
+            frame.transparent = gce_transparent;
+            if (desc[8] & 0x40) {
+                frame.flags |= GIF_DESC_INTERLACED;
+            }
+            if (gce_packed & 0x01) {
+                frame.flags |= GIF_DESC_TRANSPARENT;
+            }
+            if (desc[8] & 0x80) {
+                frame.lct_bits = (desc[8] & 0x07) + 1;
+                rd_skip(3U << frame.lct_bits);
+            }
+
+            /* LZW minimum code size, then the image data */
+            rd_byte();
+            rd_skip_blocks();
+
+            ret = storage_file_write(&out, GIF_INDEX_FRAMES_OFFSET +
+                                     index_hdr.frame_count * sizeof(frame),
+                                     &frame, sizeof(frame));
+
+            bool visible = frame_on_panel(&frame);
+
+            if (index_hdr.frame_count > 0 && (visible || clears)) {
+                changes = true;
+            }
+            clears = visible && frame.disposal == GIF_DISPOSE_BACKGROUND;
+            index_hdr.frame_count++;
+            gce_packed = 0;
+            gce_delay = 0;
+            break;
+        }
+        case 0x3B:
+            done = true;
+            break;
+        default:
+            LOG_WRN("%s: unknown block 0x%02x at %zu", name, block, rd_tell() - 1);
+            done = true;
+            break;
+        }
+    }
+
+    if (ret >= 0 && index_hdr.frame_count == 0) {
+        ret = rd.err ? rd.err : OPENDOTT_ERR_INVALID_FORMAT;
+    }
+
+    if (!changes) {
+        index_hdr.flags |= GIF_INDEX_STILL;
+    }
+
+    if (ret >= 0) {
+        /* Header last, so a partial index never looks valid */
+        ret = storage_file_write(&out, 0, &index_hdr, sizeof(index_hdr));
+    }
+
+    storage_file_close(&out);
+
+    if (ret < 0) {
+        storage_meta_delete(name, GIF_INDEX_EXT);
+        return ret;
+    }
+
+    LOG_INF("%s: indexed %u frames (%ux%u, loop %u%s)", name, index_hdr.frame_count,
+            index_hdr.width, index_hdr.height, index_hdr.loop_count,
+            (index_hdr.flags & GIF_INDEX_STILL) ? ", still" : "");
+    return 0;
+}
+
+static int index_load(const char *name, size_t source_size, bool rebuild)
+{
+    int ret = rebuild ? -ENOENT :
+              storage_meta_read(name, GIF_INDEX_EXT, 0, &index_hdr, sizeof(index_hdr));
+
+    if (ret == sizeof(index_hdr) && index_hdr.magic == GIF_INDEX_MAGIC &&
+        index_hdr.version == GIF_INDEX_VERSION && index_hdr.source_size == source_size &&
+        index_hdr.color_id == color_profile_id()) {
+        ret = storage_meta_read(name, GIF_INDEX_EXT, sizeof(index_hdr), global_lut,
+                                sizeof(global_lut));
+        if (ret == sizeof(global_lut)) {
+            ret = storage_meta_read(name, GIF_INDEX_EXT, GIF_INDEX_RES_OFFSET, global_res,
+                                    sizeof(global_res));
+        }
+        if (ret == sizeof(global_res)) {
+            return 0;
+        }
+    }
+
+    return index_build(name, source_size);
+}
+
+static void canvas_fill_rect(int x, int y, int w, int h, uint8_t color)
+{
+    int x0 = MAX(x, 0);
+    int x1 = MIN(x + w, DISPLAY_WIDTH);
+    int y0 = MAX(y, 0);
+    int y1 = MIN(y + h, DISPLAY_HEIGHT);
+
+    for (int row = y0; row < y1 && x0 < x1; row++) {
+        memset(&canvas[row * DISPLAY_WIDTH + x0], color, x1 - x0);
+    }
+}
+
+static void canvas_reset(void)
+{
+    memset(canvas, index_hdr.bg_index, sizeof(canvas));
+    memcpy(canvas_lut, global_lut, sizeof(canvas_lut));
+    memcpy(canvas_res, global_res, sizeof(canvas_res));
+    next_frame = 0;
+}
+
+static uint32_t rgb565_distance(uint16_t a, uint16_t b)
+{
+    a = sys_be16_to_cpu(a);
+    b = sys_be16_to_cpu(b);
+
+    int dr = (int)(a >> 11) - (int)(b >> 11);
+    int dg = (int)((a >> 5) & 0x3F) - (int)((b >> 5) & 0x3F);
+    int db = (int)(a & 0x1F) - (int)(b & 0x1F);
+
+    return 4 * dr * dr + dg * dg + 4 * db * db;
+}
+
+static uint8_t nearest_slot(uint16_t color)
+{
+    uint32_t best = UINT32_MAX;
+    uint8_t slot = 0;
+
+    for (int i = 0; i < GIF_PALETTE_SIZE && best > 0; i++) {
+        uint32_t d = rgb565_distance(canvas_lut[i], color);
+        if (d < best) {
+            best = d;
+            slot = i;
+        }
+    }
+    return slot;
+}
+
+static void map_color(uint8_t c)
+{
+    uint16_t color = frame_pal[c];
+    int slot = -1;
+
+    for (int i = 0; i < GIF_PALETTE_SIZE; i++) {
+        if (canvas_lut[i] == color) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0) {
+        for (int i = 0; i < GIF_PALETTE_SIZE; i++) {
+            if (!(slot_used[i / 32] & BIT(i % 32))) {
+                slot = i;
+                canvas_lut[i] = color;
+                canvas_res[i] = frame_res[c];
+                break;
+            }
+        }
+    }
+
+    if (slot < 0) {
+        slot = nearest_slot(color);
+    }
+
+    slot_used[slot / 32] |= BIT(slot % 32);
+    remap[c] = slot;
+    remap_done[c / 32] |= BIT(c % 32);
+}
+
+/* Work out how the frame's palette maps onto the canvas LUT */
+static void remap_begin(const uint16_t *pal, const uint8_t *res)
+{
+    frame_pal = pal;
+    frame_res = res;
+
+    /* Equal colors may still differ in residual; the canvas keeps its own */
+    if (memcmp(pal, canvas_lut, sizeof(canvas_lut)) == 0) {
+        remap_identity = true;
+        return;
+    }
+
+    /* An opaque frame over the whole panel replaces everything */
+    if (!(cur.flags & GIF_DESC_TRANSPARENT) && cur_x0 <= 0 && cur_y0 <= 0 &&
+        cur_x0 + cur.w >= DISPLAY_WIDTH && cur_y0 + cur.h >= DISPLAY_HEIGHT) {
+        memcpy(canvas_lut, pal, sizeof(canvas_lut));
+        memcpy(canvas_res, res, sizeof(canvas_res));
+        remap_identity = true;
+        return;
+    }
+
+    remap_identity = false;
+    memset(remap_done, 0, sizeof(remap_done));
+    memset(slot_used, 0, sizeof(slot_used));
+    for (size_t i = 0; i < sizeof(canvas); i++) {
+        slot_used[canvas[i] / 32] |= BIT(canvas[i] % 32);
+    }
+}
+
+/* Canvas slot for the background color after the LUT may have changed */
+static uint8_t background_slot(void)
+{
+    uint8_t bg = index_hdr.bg_index;
+
+    if (canvas_lut[bg] == global_lut[bg]) {
+        return bg;
+    }
+    return nearest_slot(global_lut[bg]);
+}
+
+/* Interlaced rows come in passes: every 8th from 0, every 8th from 4,
+ * every 4th from 2, then every 2nd from 1 */
+static void next_row(void)
+{
+    static const uint8_t start[] = {0, 4, 2, 1};
+    static const uint8_t step[] = {8, 8, 4, 2};
+
+    if (!(cur.flags & GIF_DESC_INTERLACED)) {
+        cur_row++;
+        return;
+    }
+
+    cur_row += step[cur_pass];
+    while (cur_row >= cur.h && cur_pass < 3) {
+        cur_pass++;
+        cur_row = start[cur_pass];
+    }
+}
+
+static inline void put_pixels(const uint8_t *px, size_t count)
+{
+    while (count-- > 0 && cur_left > 0) {
+        uint8_t c = *px++;
+        int x = cur_x0 + cur_col;
+        int y = cur_y0 + cur_row;
+
+        if (!((cur.flags & GIF_DESC_TRANSPARENT) && c == cur.transparent) &&
+            x >= 0 && x < DISPLAY_WIDTH && y >= 0 && y < DISPLAY_HEIGHT) {
+            if (!remap_identity) {
+                if (!(remap_done[c / 32] & BIT(c % 32))) {
+                    map_color(c);
+                }
+                c = remap[c];
+            }
+            canvas[y * DISPLAY_WIDTH + x] = c;
+        }
+
+        cur_left--;
+        if (++cur_col >= cur.w) {
+            cur_col = 0;
+            next_row();
+        }
+    }
+}
+
+static OPENDOTT_RAMFUNC int lzw_decode(void)
+{
+    uint8_t min_size = rd_byte();
+    uint8_t block_left = 0;
+    uint32_t bits = 0;
+    uint8_t bit_count = 0;
+    int prev = -1;
+    uint8_t first = 0;
+
+    if (min_size < 2 || min_size > 8) {
+        return OPENDOTT_ERR_DECODE_FAILED;
+    }
+
+    const uint16_t clear = 1U << min_size;
+    const uint16_t eoi = clear + 1;
+    uint16_t next = clear + 2;
+    uint8_t code_size = min_size + 1;
+
+    while (cur_left > 0) {
+        while (bit_count < code_size) {
+            if (block_left == 0) {
+                block_left = rd_byte();
+                if (block_left == 0) {
+                    /* Data ended early: keep what we have */
+                    return rd.err;
+                }
+            }
+            bits |= (uint32_t)rd_byte() << bit_count;
+            bit_count += 8;
+            block_left--;
+        }
+
+        if (rd.err) {
+            return rd.err;
+        }
+
+        uint16_t code = bits & ((1U << code_size) - 1);
+        bits >>= code_size;
+        bit_count -= code_size;
+
+        if (code == clear) {
+            next = clear + 2;
+            code_size = min_size + 1;
+            prev = -1;
+            continue;
+        }
+        if (code == eoi) {
+            break;
+        }
+
+        if (prev < 0) {
+            if (code >= clear) {
+                return OPENDOTT_ERR_DECODE_FAILED;
+            }
+            first = code;
+            prev = code;
+            put_pixels(&first, 1);
+            continue;
+        }
+
+        uint16_t in_code = code;
+        size_t sp = sizeof(lzw_stack);
+
+        if (code >= next) {
+            if (code > next) {
+                return OPENDOTT_ERR_DECODE_FAILED;
+            }
+            lzw_stack[--sp] = first;
+            code = prev;
+        }
+
+        while (code >= clear) {
+            if (sp == 0) {
+                return OPENDOTT_ERR_DECODE_FAILED;
+            }
+            lzw_stack[--sp] = lzw_suffix[code];
+            code = lzw_prefix[code];
+        }
+
+        first = code;
+        lzw_stack[--sp] = first;
+
+        if (next < GIF_LZW_MAX_CODES) {
+            lzw_prefix[next] = prev;
+            lzw_suffix[next] = first;
+            next++;
+            if (next == (1U << code_size) && code_size < 12) {
+                code_size++;
+            }
+        }
+
+        prev = in_code;
+        put_pixels(&lzw_stack[sp], sizeof(lzw_stack) - sp);
+    }
+
+    /* Skip the rest of the sub-blocks (and the terminator) */
+    rd_skip(block_left);
+    rd_skip_blocks();
+    return rd.err;
+}
+
+static int decode_frame(uint16_t index)
+{
+    struct gif_frame_info prev;
+    uint8_t desc[10];
+    int ret;
+
+    if (index > 0) {
+        ret = gif_decoder_frame_info(index - 1, &prev);
+        if (ret < 0) {
+            return ret;
+        }
+        if (prev.disposal == GIF_DISPOSE_BACKGROUND) {
+            canvas_fill_rect(screen_x0() + prev.x, screen_y0() + prev.y,
+                             prev.w, prev.h, background_slot());
+        }
+    }
+
+    ret = gif_decoder_frame_info(index, &cur);
+    if (ret < 0) {
+        return ret;
+    }
+
+    rd_seek(cur.offset);
+    rd_bytes(desc, sizeof(desc));
+    if (rd.err || desc[0] != 0x2C) {
+        return OPENDOTT_ERR_DECODE_FAILED;
+    }
+
+    if (cur.lct_bits) {
+        read_palette(local_lut, local_res, cur.lct_bits);
+    }
+
+    cur_x0 = screen_x0() + cur.x;
+    cur_y0 = screen_y0() + cur.y;
+    if (cur.lct_bits) {
+        remap_begin(local_lut, local_res);
+    } else {
+        remap_begin(global_lut, global_res);
+    }
+    cur_col = 0;
+    cur_row = 0;
+    cur_pass = 0;
+    cur_left = (uint32_t)cur.w * cur.h;
+
+    ret = lzw_decode();
+    if (ret < 0) {
+        LOG_ERR("%s: frame %u decode failed (%d)", gif_name, index, ret);
+        return OPENDOTT_ERR_DECODE_FAILED;
+    }
+
+    next_frame = index + 1;
+    return 0;
+}
+
+/* Caller holds gif_lock */
+static int open_locked(struct media_source *src)
+{
+    const char *key = src->name ? src->name : GIF_MEM_INDEX_KEY;
+
+    rd.src = src;
+    rd_seek(0);
+
+    int ret = index_load(key, src->size, src->name == NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    strncpy(gif_name, key, sizeof(gif_name) - 1);
+    gif_name[sizeof(gif_name) - 1] = '\0';
+
+    uint16_t flags = 0;
+
+    dither = src->name && storage_get_flags(src->name, &flags) == 0 &&
+             (flags & MEDIA_FLAG_DITHER);
+
+    info.width = index_hdr.width;
+    info.height = index_hdr.height;
+    /* Frames that change nothing are never decoded or waited for */
+    info.frame_count = (index_hdr.flags & GIF_INDEX_STILL) ? 1 : index_hdr.frame_count;
+    info.loop_count = index_hdr.loop_count;
+
+    canvas_reset();
+    gif_open = true;
+    return 0;
+}
+
+int gif_decoder_open_source(struct media_source *src, k_timeout_t timeout)
+{
+    if (k_mutex_lock(&gif_lock, timeout) < 0) {
+        return -EBUSY;
+    }
+
+    int ret = open_locked(src);
+    if (ret < 0) {
+        k_mutex_unlock(&gif_lock);
+        return ret;
+    }
+
+    owns_src = false;
+    return 0;
+}
+
+int gif_decoder_open(const char *name, k_timeout_t timeout)
+{
+    if (k_mutex_lock(&gif_lock, timeout) < 0) {
+        return -EBUSY;
+    }
+
+    int ret = media_source_file_open(&file_src, name);
+    if (ret == 0) {
+        ret = open_locked(&file_src);
+        if (ret < 0) {
+            media_source_close(&file_src);
+        }
+    }
+
+    if (ret < 0) {
+        k_mutex_unlock(&gif_lock);
+        return ret;
+    }
+
+    owns_src = true;
+    return 0;
+}
+
+void gif_decoder_close(void)
+{
+    if (!gif_open) {
+        return;
+    }
+
+    if (owns_src) {
+        media_source_close(&file_src);
+    }
+    gif_open = false;
+    k_mutex_unlock(&gif_lock);
+}
+
+const struct gif_info *gif_decoder_info(void)
+{
+    return gif_open ? &info : NULL;
+}
+
+int gif_decoder_frame_info(uint16_t index, struct gif_frame_info *frame)
+{
+    if (!gif_open || index >= index_hdr.frame_count) {
+        return -EINVAL;
+    }
+
+    int ret = storage_meta_read(gif_name, GIF_INDEX_EXT,
+                                GIF_INDEX_FRAMES_OFFSET + index * sizeof(*frame),
+                                frame, sizeof(*frame));
+    if (ret != sizeof(*frame)) {
+        return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    return 0;
+}
+
+int gif_decoder_decode(uint16_t index)
+{
+    if (!gif_open || index >= index_hdr.frame_count) {
+        return -EINVAL;
+    }
+
+    /* Frames build on each other: going backwards means starting over */
+    if (index < next_frame) {
+        canvas_reset();
+    }
+
+    while (next_frame <= index) {
+        int ret = decode_frame(next_frame);
+        if (ret < 0) {
+            canvas_reset();
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+uint16_t gif_decoder_position(void)
+{
+    return next_frame;
+}
+
+/* The caller restored the canvas after frame NEXT-1 (e.g. from a frame
+ * cache) and passes the LUT and residuals that went with it, so decoding
+ * can continue from NEXT. Without RESIDUALS the canvas is not dithered */
+int gif_decoder_resume(uint16_t next, const uint16_t *lut, const uint8_t *residuals)
+{
+    if (!gif_open || next == 0 || next > index_hdr.frame_count) {
+        return -EINVAL;
+    }
+
+    memcpy(canvas_lut, lut, sizeof(canvas_lut));
+    if (residuals) {
+        memcpy(canvas_res, residuals, sizeof(canvas_res));
+    } else {
+        memset(canvas_res, 0, sizeof(canvas_res));
+    }
+    next_frame = next;
+    return 0;
+}
+
+uint8_t *gif_decoder_canvas(void)
+{
+    return canvas;
+}
+
+const uint16_t *gif_decoder_lut(void)
+{
+    return canvas_lut;
+}
+
+const uint8_t *gif_decoder_residuals(void)
+{
+    return canvas_res;
+}
+
+/* Media pipeline decoder stage */
+static int gif_media_open(struct media_source *src, struct media_info *media,
+                          k_timeout_t timeout)
+{
+    int ret = gif_decoder_open_source(src, timeout);
+    if (ret < 0) {
+        return ret;
+    }
+
+    media->width = info.width;
+    media->height = info.height;
+    media->frame_count = info.frame_count;
+    media->loop_count = info.loop_count;
+    return 0;
+}
+
+static int gif_media_decode_frame(uint16_t index, uint16_t *delay_ms)
+{
+    int ret = gif_decoder_decode(index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    *delay_ms = cur.delay_ms;
+    return 0;
+}
+
+static OPENDOTT_RAMFUNC int gif_media_read_strip(struct media_strip *strip)
+{
+    const uint8_t *in = &canvas[strip->y * DISPLAY_WIDTH];
+    size_t count = (size_t)strip->lines * DISPLAY_WIDTH;
+
+    if (dither) {
+        for (uint16_t line = 0; line < strip->lines; line++) {
+            color_dither_row(&strip->pixels[line * DISPLAY_WIDTH], &in[line * DISPLAY_WIDTH],
+                             canvas_lut, canvas_res, DISPLAY_WIDTH, strip->y + line);
+        }
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        strip->pixels[i] = canvas_lut[in[i]];
+    }
+    return 0;
+}
+
+const struct media_decoder_api media_decoder_gif = {
+    .name = "gif",
+    .open = gif_media_open,
+    .decode_frame = gif_media_decode_frame,
+    .read_strip = gif_media_read_strip,
+    .close = gif_decoder_close,
+};
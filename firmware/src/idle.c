@@ -0,0 +1,66 @@
+/*
+ * OpenDOTT - Idle Job Runner
+ * SPDX-License-Identifier: MIT
+ *
+ * Low-priority work queue for background maintenance (compaction, scrubbing,
+ * pre-decoding). Jobs run in small steps and check idle_is_idle() between
+ * steps, so foreground work (BLE uploads, playback) always wins.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(idle, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* No foreground activity for this long counts as idle */
+#define IDLE_THRESHOLD_MS    2000
+
+#define IDLE_STACK_SIZE      2048
+#define IDLE_PRIORITY        K_LOWEST_APPLICATION_THREAD_PRIO
+
+K_THREAD_STACK_DEFINE(idle_stack, IDLE_STACK_SIZE);
+static struct k_work_q idle_work_q;
+
+static int64_t last_busy_time;
+static bool idle_started = false;
+
+int idle_init(void)
+{
+    const struct k_work_queue_config cfg = {
+        .name = "idle",
+        .no_yield = false,
+    };
+
+    k_work_queue_init(&idle_work_q);
+    k_work_queue_start(&idle_work_q, idle_stack, K_THREAD_STACK_SIZEOF(idle_stack),
+                       IDLE_PRIORITY, &cfg);
+
+    idle_started = true;
+    LOG_INF("Idle job queue started");
+    return 0;
+}
+
+void idle_mark_busy(void)
+{
+    last_busy_time = k_uptime_get();
+}
+
+bool idle_is_idle(void)
+{
+    if (IS_ENABLED(CONFIG_BT) && ble_get_transfer_state() == TRANSFER_RECEIVING) {
+        return false;
+    }
+
+    return (k_uptime_get() - last_busy_time) >= IDLE_THRESHOLD_MS;
+}
+
+int idle_submit(struct k_work_delayable *work, k_timeout_t delay)
+{
+    if (!idle_started) {
+        return -ENODEV;
+    }
+
+    return k_work_reschedule_for_queue(&idle_work_q, work, delay);
+}
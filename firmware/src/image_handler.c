@@ -2,7 +2,7 @@
  * OpenDOTT - Image Handler
  * SPDX-License-Identifier: MIT
  * 
- * Image format detection, validation, and decoding.
+ * Image format detection and validation.
  * 
  * THIS IS THE KEY DIFFERENCE FROM THE ORIGINAL FIRMWARE:
  * We actually validate images BEFORE writing them to flash.
@@ -22,7 +22,7 @@ static bool validate_gif(const uint8_t *data, size_t size);
 static bool validate_png(const uint8_t *data, size_t size);
 static bool validate_jpeg(const uint8_t *data, size_t size);
 static bool validate_bmp(const uint8_t *data, size_t size);
-static int decode_and_display_gif(const uint8_t *data, size_t size);
+static bool validate_native(const uint8_t *data, size_t size);
 
 /* Magic byte sequences for format detection */
 static const uint8_t gif89a_magic[] = {0x47, 0x49, 0x46, 0x38, 0x39, 0x61}; /* GIF89a */
@@ -30,6 +30,7 @@ static const uint8_t gif87a_magic[] = {0x47, 0x49, 0x46, 0x38, 0x37, 0x61}; /* G
 static const uint8_t png_magic[]    = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
 static const uint8_t jpeg_magic[]   = {0xFF, 0xD8, 0xFF};
 static const uint8_t bmp_magic[]    = {0x42, 0x4D}; /* BM */
+static const uint8_t native_magic[] = {0x4F, 0x35, 0x36, 0x35}; /* O565 */
 
 /**
  * Detect image format from magic bytes
@@ -66,6 +67,11 @@ image_format_t image_detect_format(const uint8_t *data, size_t size)
         return IMAGE_FORMAT_BMP;
     }
 
+    /* Check native (pre-rendered RGB565) */
+    if (size >= 4 && memcmp(data, native_magic, 4) == 0) {
+        return IMAGE_FORMAT_NATIVE;
+    }
+
     LOG_WRN("Unknown format, magic: %02x %02x %02x %02x",
             data[0], data[1], data[2], data[3]);
     return IMAGE_FORMAT_UNKNOWN;
@@ -78,6 +84,7 @@ const char *image_format_to_string(image_format_t format)
     case IMAGE_FORMAT_PNG:     return "PNG";
     case IMAGE_FORMAT_JPEG:    return "JPEG";
     case IMAGE_FORMAT_BMP:     return "BMP";
+    case IMAGE_FORMAT_NATIVE:  return "NATIVE";
     default:                   return "UNKNOWN";
     }
 }
@@ -122,6 +129,8 @@ bool image_validate(const uint8_t *data, size_t size)
         return validate_jpeg(data, size);
     case IMAGE_FORMAT_BMP:
         return validate_bmp(data, size);
+    case IMAGE_FORMAT_NATIVE:
+        return validate_native(data, size);
     default:
         return false;
     }
@@ -239,65 +248,23 @@ static bool validate_bmp(const uint8_t *data, size_t size)
     return true;
 }
 
-/**
- * Decode and display an image
- * 
- * This handles the actual image decoding and rendering to the display.
- */
-int image_decode_and_display(const uint8_t *data, size_t size)
+/* Native validation: panel-sized, and every frame present */
+static bool validate_native(const uint8_t *data, size_t size)
 {
-    /* First, validate */
-    if (!image_validate(data, size)) {
-        LOG_ERR("Image validation failed - NOT displaying");
-        LOG_ERR("(This is what the original firmware should have done)");
-        return OPENDOTT_ERR_INVALID_FORMAT;
-    }
+    struct media_native_header hdr;
 
-    image_format_t format = image_detect_format(data, size);
-
-    switch (format) {
-    case IMAGE_FORMAT_GIF:
-        return decode_and_display_gif(data, size);
-    case IMAGE_FORMAT_PNG:
-        LOG_WRN("PNG decoding not yet implemented");
-        return OPENDOTT_ERR_DECODE_FAILED;
-    case IMAGE_FORMAT_JPEG:
-        LOG_WRN("JPEG decoding not yet implemented");
-        return OPENDOTT_ERR_DECODE_FAILED;
-    case IMAGE_FORMAT_BMP:
-        LOG_WRN("BMP decoding not yet implemented");
-        return OPENDOTT_ERR_DECODE_FAILED;
-    default:
-        return OPENDOTT_ERR_INVALID_FORMAT;
+    if (size < sizeof(hdr)) {
+        LOG_ERR("Native image too small: %zu bytes", size);
+        return false;
     }
-}
-
-/* GIF decoder (simplified - needs full implementation) */
-static int decode_and_display_gif(const uint8_t *data, size_t size)
-{
-    LOG_INF("Decoding GIF (%zu bytes)...", size);
-
-    /* TODO: Implement proper GIF decoder
-     * Options:
-     * 1. Port AnimatedGIF library (what original uses)
-     * 2. Use gifdec or similar lightweight decoder
-     * 3. Write our own minimal decoder
-     * 
-     * For now, this is a placeholder
-     */
-
-    /* Read basic GIF info */
-    uint16_t width = data[6] | (data[7] << 8);
-    uint16_t height = data[8] | (data[9] << 8);
-    uint8_t packed = data[10];
-    bool has_gct = (packed & 0x80) != 0;
-    int gct_size = 1 << ((packed & 0x07) + 1);
-
-    LOG_INF("GIF: %dx%d, global color table: %s (%d colors)",
-            width, height, has_gct ? "yes" : "no", gct_size);
 
-    /* TODO: Actually decode frames and display them */
-    LOG_WRN("Full GIF decoding not yet implemented");
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.width != DISPLAY_WIDTH || hdr.height != DISPLAY_HEIGHT ||
+        size < sizeof(hdr) + (size_t)hdr.frame_count * DISPLAY_WIDTH * DISPLAY_HEIGHT * DISPLAY_BPP) {
+        LOG_ERR("Invalid native image: %ux%u, %u frames in %zu bytes",
+                hdr.width, hdr.height, hdr.frame_count, size);
+        return false;
+    }
 
-    return 0;
+    return true;
 }
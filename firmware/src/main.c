@@ -1,21 +1,140 @@
 /*
  * OpenDOTT - Main Application
  * SPDX-License-Identifier: MIT
- * 
- * MINIMAL TEST VERSION - just boot and loop
- * If the display stays black after flash, this firmware booted successfully!
+ *
+ * Brings the modules up in dependency order: the panel first so the boot
+ * snapshot appears quickly, then storage and the idle jobs built on it,
+ * then the player, the button and BLE. A failed step is logged and
+ * skipped, so a bad flash or a missing asset pack still leaves BLE up for
+ * recovery.
+ *
+ * The main thread then watches BLE uploads: the protocol has no end
+ * marker, so an upload is complete once data stops arriving.
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(main, CONFIG_LOG_DEFAULT_LEVEL);
+
+BUILD_ASSERT(OPENDOTT_SIZED_RAM_BYTES <= CONFIG_OPENDOTT_RAM_BUDGET_KB * 1024,
+             "Buffer sizing exceeds CONFIG_OPENDOTT_RAM_BUDGET_KB");
+
+#define BLE_RX_BUFFER_SIZE      (CONFIG_OPENDOTT_BLE_RX_BUFFER_KB * 1024)  /* Largest GIF accepted */
+#define UPLOAD_POLL_MS          100
+#define UPLOAD_QUIET_MS         1000           /* No data this long ends an upload */
+
+/* Switch on press, not release: the next slot is prefetched */
+static void on_button(button_event_t event)
+{
+    switch (event) {
+    case BUTTON_EVENT_DOWN:
+        player_step(1);
+        break;
+    default:
+        LOG_DBG("Button event %d", event);
+        break;
+    }
+}
+
+#ifdef CONFIG_BT
+static uint8_t ble_rx_buffer[BLE_RX_BUFFER_SIZE];
+
+/* End an upload once data has stopped for UPLOAD_QUIET_MS */
+static void upload_poll(void)
+{
+    static size_t last_size;
+    static int64_t last_change;
+
+    size_t size = ble_get_received_size();
+
+    if (ble_get_transfer_state() != TRANSFER_RECEIVING) {
+        last_size = 0;
+        return;
+    }
+
+    if (size != last_size) {
+        last_size = size;
+        last_change = k_uptime_get();
+        return;
+    }
+
+    if (k_uptime_get() - last_change < UPLOAD_QUIET_MS) {
+        return;
+    }
+
+    if (size > sizeof(ble_rx_buffer)) {
+        LOG_ERR("Upload too large: %u bytes", size);
+        ble_transfer_complete(false);
+        return;
+    }
+
+    /* The upload replaces slot0.gif, which may be playing */
+    player_pause();
+    ble_transfer_complete(true);
+    player_play(ble_get_transfer_state() == TRANSFER_COMPLETE ? "slot0.gif" : NULL);
+}
+#endif
 
 int main(void)
 {
-    /* If we reach here, the nRF52840 boots with our config! */
-    /* The display will go black (no display init) but that proves we're running */
-    
+    int ret;
+
+    LOG_INF("OpenDOTT starting");
+
+    ret = display_init();
+    if (ret < 0) {
+        LOG_ERR("Display init failed: %d", ret);
+    } else {
+        display_clear(0x0000);
+    }
+
+    idle_init();
+
+    ret = storage_init();
+    if (ret < 0) {
+        LOG_ERR("Storage init failed: %d", ret);
+    } else {
+        storage_scrub_init();
+        /* Measure and pre-erase once the device first goes idle, so the
+         * first upload after boot already finds erased blocks */
+        storage_compact_start();
+        predecode_init();
+        display_load_settings();
+        color_init();
+        transition_init();
+
+        /* The snapshot is up at once; the player then takes over */
+        predecode_show_boot_snapshot();
+        player_play("slot0.gif");
+    }
+
+#ifdef CONFIG_NORDIC_QSPI_NOR
+    ret = assets_init();
+    if (ret < 0) {
+        LOG_WRN("Assets unavailable: %d", ret);
+    }
+#endif
+
+    ret = button_init(on_button);
+    if (ret < 0) {
+        LOG_ERR("Button init failed: %d", ret);
+    }
+
+#ifdef CONFIG_BT
+    ret = ble_service_init(ble_rx_buffer, sizeof(ble_rx_buffer));
+    if (ret < 0) {
+        LOG_ERR("BLE init failed: %d", ret);
+        return ret;
+    }
+
     while (1) {
-        k_sleep(K_SECONDS(1));
+        k_sleep(K_MSEC(UPLOAD_POLL_MS));
+        upload_poll();
     }
-    
+#endif
+
     return 0;
 }
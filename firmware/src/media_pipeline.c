@@ -0,0 +1,730 @@
+/*
+ * OpenDOTT - Media Pipeline
+ * SPDX-License-Identifier: MIT
+ *
+ * Runs media through source -> decoder -> compositor -> sink. The calling
+ * thread decodes and composites one strip at a time into buffers taken from
+ * a fixed pool; a sink thread drains them in order and hands them back.
+ * Both queues are bounded by the pool, so a slow sink throttles the decoder
+ * instead of growing memory, and nothing is copied between stages.
+ *
+ * Every stage is timed per call, so a decoder can be measured against the
+ * null sink, or a sink against native media that needs no decoding.
+ *
+ * While playing, each frame has to be on the panel before its own delay
+ * runs out. Frames that miss that deadline are kept in a small ring with
+ * their per-stage times, so a slow animation shows which stage to work on.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(media_pipeline, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define MEDIA_SINK_STACK_SIZE   1536
+#define MEDIA_SINK_PRIORITY     5
+#define MEDIA_OPEN_TIMEOUT      K_SECONDS(1)
+#define MEDIA_LATE_FRAMES       8       /* Late frames kept */
+#define MEDIA_LATE_DUMP_VERSION 1
+
+enum strip_msg_type {
+    STRIP_MSG_FRAME_BEGIN,
+    STRIP_MSG_STRIP,
+    STRIP_MSG_FRAME_END,
+};
+
+struct strip_msg {
+    struct media_pipeline *pipeline;
+    struct media_strip strip;
+    uint16_t frame;
+    uint8_t type;
+};
+
+/* Each strip starts on its own RAM bank, so the SPI reading one strip and
+ * the decoder filling the next don't share a bank */
+#define STRIP_POOL_STRIDE \
+    (ROUND_UP(MEDIA_STRIP_BYTES, OPENDOTT_STRIP_ALIGN) / DISPLAY_BPP)
+
+static uint16_t strip_pool[MEDIA_STRIP_COUNT][STRIP_POOL_STRIDE]
+    __aligned(OPENDOTT_STRIP_ALIGN) OPENDOTT_STRIP_RAM;
+
+K_MSGQ_DEFINE(strip_free_q, sizeof(uint16_t *), MEDIA_STRIP_COUNT, 4);
+K_MSGQ_DEFINE(strip_ready_q, sizeof(struct strip_msg), MEDIA_STRIP_COUNT + 2, 4);
+static K_SEM_DEFINE(frame_done, 0, 1);
+
+/* Only one pipeline owns the strip pool at a time */
+static K_MUTEX_DEFINE(media_lock);
+static bool pool_ready = false;
+static int sink_err;
+
+/* Ring of the most recent late frames, across pipelines */
+static struct {
+    struct media_late_frame frames[MEDIA_LATE_FRAMES];
+    uint8_t head;
+    uint8_t count;
+    uint32_t played;
+    uint32_t late;
+} late_ring;
+static struct k_spinlock late_lock;
+
+static void stage_record(struct media_pipeline *p, enum media_stage stage, uint32_t start)
+{
+    struct media_stage_stats *st = &p->stats[stage];
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+    st->count++;
+    st->total_us += us;
+    if (us > st->max_us) {
+        st->max_us = us;
+    }
+    p->frame_us[stage] += us;
+}
+
+static void sink_thread(void *p1, void *p2, void *p3)
+{
+    struct strip_msg msg;
+
+    while (1) {
+        k_msgq_get(&strip_ready_q, &msg, K_FOREVER);
+
+        struct media_pipeline *p = msg.pipeline;
+        struct media_sink *sink = p->sink;
+        int ret = 0;
+
+        switch (msg.type) {
+        case STRIP_MSG_FRAME_BEGIN:
+            ret = sink->api->frame_begin(sink, msg.frame);
+            break;
+        case STRIP_MSG_STRIP: {
+            uint32_t start = k_cycle_get_32();
+            if (sink_err == 0) {
+                ret = sink->api->write_strip(sink, &msg.strip);
+            }
+            stage_record(p, MEDIA_STAGE_SINK, start);
+            k_msgq_put(&strip_free_q, &msg.strip.pixels, K_FOREVER);
+            break;
+        }
+        case STRIP_MSG_FRAME_END:
+            ret = sink->api->frame_end(sink);
+            k_sem_give(&frame_done);
+            break;
+        }
+
+        if (ret < 0 && sink_err == 0) {
+            sink_err = ret;
+        }
+    }
+}
+
+K_THREAD_DEFINE(media_sink_tid, MEDIA_SINK_STACK_SIZE, sink_thread, NULL, NULL, NULL,
+                MEDIA_SINK_PRIORITY, 0, 0);
+
+/* Native media: frames are stored exactly as the panel wants them, less
+ * color correction */
+static struct {
+    struct media_source *src;
+    struct media_native_header hdr;
+    uint16_t frame;
+} native;
+
+static int native_open(struct media_source *src, struct media_info *info, k_timeout_t timeout)
+{
+    ssize_t ret = media_source_read(src, 0, &native.hdr, sizeof(native.hdr));
+
+    if (ret != sizeof(native.hdr) || native.hdr.magic != MEDIA_NATIVE_MAGIC ||
+        native.hdr.width != DISPLAY_WIDTH || native.hdr.height != DISPLAY_HEIGHT ||
+        src->size < sizeof(native.hdr) +
+                    (size_t)native.hdr.frame_count * DISPLAY_WIDTH * DISPLAY_HEIGHT * DISPLAY_BPP) {
+        return OPENDOTT_ERR_INVALID_FORMAT;
+    }
+
+    native.src = src;
+    info->width = DISPLAY_WIDTH;
+    info->height = DISPLAY_HEIGHT;
+    info->frame_count = native.hdr.frame_count;
+    info->loop_count = 0;
+    return 0;
+}
+
+static int native_decode_frame(uint16_t index, uint16_t *delay_ms)
+{
+    native.frame = index;
+    *delay_ms = native.hdr.delay_ms;
+    return 0;
+}
+
+static int native_read_strip(struct media_strip *strip)
+{
+    const size_t line = DISPLAY_WIDTH * DISPLAY_BPP;
+    size_t offset = sizeof(native.hdr) +
+                    ((size_t)native.frame * DISPLAY_HEIGHT + strip->y) * line;
+    size_t len = strip->lines * line;
+
+    ssize_t ret = media_source_read(native.src, offset, strip->pixels, len);
+    if (ret != len) {
+        return ret < 0 ? ret : OPENDOTT_ERR_FLASH_READ;
+    }
+
+    color_correct_rgb565(strip->pixels, (size_t)strip->lines * DISPLAY_WIDTH);
+    return 0;
+}
+
+static void native_close(void)
+{
+    native.src = NULL;
+}
+
+const struct media_decoder_api media_decoder_native = {
+    .name = "native",
+    .open = native_open,
+    .decode_frame = native_decode_frame,
+    .read_strip = native_read_strip,
+    .close = native_close,
+};
+
+const struct media_decoder_api *media_decoder_find(struct media_source *src)
+{
+    uint8_t magic[8];
+
+    if (media_source_read(src, 0, magic, sizeof(magic)) != sizeof(magic)) {
+        return NULL;
+    }
+
+    switch (image_detect_format(magic, sizeof(magic))) {
+    case IMAGE_FORMAT_GIF:
+        return &media_decoder_gif;
+    case IMAGE_FORMAT_NATIVE:
+        return &media_decoder_native;
+    default:
+        /* PNG, JPEG and BMP plug in here once they have decoders */
+        return NULL;
+    }
+}
+
+int media_pipeline_open(struct media_pipeline *p, struct media_source *src,
+                        struct media_sink *sink, k_timeout_t timeout)
+{
+    const struct media_decoder_api *decoder = media_decoder_find(src);
+    if (!decoder) {
+        memset(p, 0, sizeof(*p));
+        return OPENDOTT_ERR_INVALID_FORMAT;
+    }
+
+    return media_pipeline_open_decoder(p, src, decoder, sink, timeout);
+}
+
+/* As media_pipeline_open(), with a decoder chosen by the caller rather than
+ * by the media's magic (e.g. a transition that reads frame caches). The
+ * owner of the pool may open a second pipeline while its first is idle */
+int media_pipeline_open_decoder(struct media_pipeline *p, struct media_source *src,
+                                const struct media_decoder_api *decoder,
+                                struct media_sink *sink, k_timeout_t timeout)
+{
+    memset(p, 0, sizeof(*p));
+
+    if (k_mutex_lock(&media_lock, timeout) < 0) {
+        return -EBUSY;
+    }
+
+    if (!pool_ready) {
+        for (int i = 0; i < MEDIA_STRIP_COUNT; i++) {
+            uint16_t *buf = strip_pool[i];
+            k_msgq_put(&strip_free_q, &buf, K_NO_WAIT);
+        }
+        pool_ready = true;
+    }
+
+    int ret = decoder->open(src, &p->info, timeout);
+    if (ret < 0) {
+        k_mutex_unlock(&media_lock);
+        return ret;
+    }
+
+    p->source = src;
+    p->decoder = decoder;
+    p->sink = sink;
+    p->open = true;
+    return 0;
+}
+
+int media_pipeline_add_overlay(struct media_pipeline *p, media_overlay_t fn, void *user_data)
+{
+    if (p->overlay_count >= MEDIA_MAX_OVERLAYS) {
+        return -ENOMEM;
+    }
+
+    p->overlays[p->overlay_count].fn = fn;
+    p->overlays[p->overlay_count].user_data = user_data;
+    p->overlay_count++;
+    return 0;
+}
+
+static void post(struct media_pipeline *p, uint8_t type, uint16_t frame,
+                 const struct media_strip *strip)
+{
+    struct strip_msg msg = {
+        .pipeline = p,
+        .frame = frame,
+        .type = type,
+    };
+
+    if (strip) {
+        msg.strip = *strip;
+    }
+    k_msgq_put(&strip_ready_q, &msg, K_FOREVER);
+}
+
+/* Decode FRAME and push it through to the sink; returns once the sink has
+ * taken the last strip */
+int media_pipeline_render(struct media_pipeline *p, uint16_t frame, uint16_t *delay_ms)
+{
+    uint16_t delay = 0;
+    int ret;
+
+    if (!p->open || frame >= p->info.frame_count) {
+        return -EINVAL;
+    }
+
+    memset(p->frame_us, 0, sizeof(p->frame_us));
+    uint32_t read_start = p->source->read_us;
+
+    OPENDOTT_TRACE("frame_start", frame, 0);
+    OPENDOTT_TRACE("decode_frame_start", frame, 0);
+    uint32_t start = k_cycle_get_32();
+    ret = p->decoder->decode_frame(frame, &delay);
+    stage_record(p, MEDIA_STAGE_DECODE, start);
+    OPENDOTT_TRACE("decode_frame_end", frame, ret);
+    if (ret < 0) {
+        OPENDOTT_TRACE("frame_end", frame, ret);
+        return ret;
+    }
+
+    sink_err = 0;
+    post(p, STRIP_MSG_FRAME_BEGIN, frame, NULL);
+
+    for (uint16_t y = 0; y < DISPLAY_HEIGHT && ret == 0; y += MEDIA_STRIP_LINES) {
+        struct media_strip strip = {
+            .y = y,
+            .lines = MIN(MEDIA_STRIP_LINES, DISPLAY_HEIGHT - y),
+        };
+
+        k_msgq_get(&strip_free_q, &strip.pixels, K_FOREVER);
+
+        OPENDOTT_TRACE("decode_strip_start", frame, y);
+        start = k_cycle_get_32();
+        ret = p->decoder->read_strip(&strip);
+        stage_record(p, MEDIA_STAGE_CONVERT, start);
+        OPENDOTT_TRACE("decode_strip_end", frame, y);
+
+        if (ret == 0 && p->overlay_count > 0) {
+            start = k_cycle_get_32();
+            for (int i = 0; i < p->overlay_count; i++) {
+                p->overlays[i].fn(&strip, frame, p->overlays[i].user_data);
+            }
+            stage_record(p, MEDIA_STAGE_COMPOSITE, start);
+        }
+
+        if (ret < 0) {
+            k_msgq_put(&strip_free_q, &strip.pixels, K_NO_WAIT);
+            break;
+        }
+
+        post(p, STRIP_MSG_STRIP, frame, &strip);
+    }
+
+    post(p, STRIP_MSG_FRAME_END, frame, NULL);
+    k_sem_take(&frame_done, K_FOREVER);
+    p->frame_read_us = p->source->read_us - read_start;
+    OPENDOTT_TRACE("frame_end", frame, ret ? ret : sink_err);
+
+    if (ret == 0) {
+        ret = sink_err;
+    }
+    if (delay_ms) {
+        *delay_ms = delay;
+    }
+    return ret;
+}
+
+static void late_record(struct media_pipeline *p, uint16_t frame, uint16_t budget_ms,
+                        int64_t late_ms)
+{
+    uint32_t decode_us = p->frame_us[MEDIA_STAGE_DECODE] + p->frame_us[MEDIA_STAGE_CONVERT];
+    struct media_late_frame rec = {
+        .uptime_ms = k_uptime_get_32(),
+        .frame = frame,
+        .budget_ms = budget_ms,
+        .late_ms = MIN(late_ms, UINT16_MAX),
+        .read_us = p->frame_read_us,
+        .decode_us = decode_us - MIN(decode_us, p->frame_read_us),
+        .composite_us = p->frame_us[MEDIA_STAGE_COMPOSITE],
+        .sink_us = p->frame_us[MEDIA_STAGE_SINK],
+    };
+
+    k_spinlock_key_t key = k_spin_lock(&late_lock);
+    late_ring.frames[late_ring.head] = rec;
+    late_ring.head = (late_ring.head + 1) % MEDIA_LATE_FRAMES;
+    late_ring.count = MIN(late_ring.count + 1, MEDIA_LATE_FRAMES);
+    late_ring.late++;
+    k_spin_unlock(&late_lock, key);
+
+    LOG_DBG("Frame %u late by %lld ms (budget %u ms)", frame, late_ms, budget_ms);
+}
+
+/* Play every frame with its own delay, LOOPS times (0 = the media's own
+ * loop count, where 0 means until media_pipeline_stop()). Each frame is
+ * due on the panel before its own delay has passed since it was scheduled;
+ * a late frame is recorded and the schedule restarts from it instead of
+ * making every following frame late too */
+int media_pipeline_play(struct media_pipeline *p, uint16_t loops)
+{
+    return media_pipeline_play_from(p, 0, loops);
+}
+
+/* As media_pipeline_play(), but the first loop starts at frame FIRST: the
+ * frames before it are already on the panel and the decoder is positioned
+ * after them (e.g. predecode_resume_first()) */
+int media_pipeline_play_from(struct media_pipeline *p, uint16_t first, uint16_t loops)
+{
+    uint16_t delay;
+    int ret = 0;
+
+    if (first >= p->info.frame_count) {
+        return 0;
+    }
+
+    if (loops == 0) {
+        loops = p->info.loop_count;
+    }
+
+    p->play_tid = k_current_get();
+    int64_t scheduled = k_uptime_get();
+
+    for (uint32_t loop = 0; loops == 0 || loop < loops; loop++) {
+        for (uint16_t frame = first; frame < p->info.frame_count; frame++) {
+            if (p->stop) {
+                goto out;
+            }
+
+            ret = media_pipeline_render(p, frame, &delay);
+            if (ret < 0) {
+                goto out;
+            }
+
+            /* A single frame stays up; there is nothing to animate */
+            if (p->info.frame_count == 1) {
+                goto out;
+            }
+
+            int64_t deadline = scheduled + delay;
+            int64_t now = k_uptime_get();
+
+            k_spinlock_key_t key = k_spin_lock(&late_lock);
+            late_ring.played++;
+            k_spin_unlock(&late_lock, key);
+
+            if (now > deadline) {
+                late_record(p, frame, delay, now - deadline);
+                deadline = now;
+            }
+
+            scheduled = deadline;
+            if (deadline > now) {
+                k_sleep(K_MSEC(deadline - now));
+            }
+        }
+        first = 0;
+    }
+
+out:
+    p->play_tid = NULL;
+    return ret;
+}
+
+/* Playback ends after the frame being rendered; a frame delay in progress
+ * is cut short */
+void media_pipeline_stop(struct media_pipeline *p)
+{
+    p->stop = true;
+    if (p->play_tid) {
+        k_wakeup(p->play_tid);
+    }
+}
+
+void media_pipeline_close(struct media_pipeline *p)
+{
+    if (!p->open) {
+        return;
+    }
+
+    p->decoder->close();
+    p->open = false;
+    k_mutex_unlock(&media_lock);
+}
+
+/* Put the first frame of SRC on the panel */
+int media_show(struct media_source *src)
+{
+    struct media_pipeline p;
+    struct media_sink panel;
+
+    media_sink_panel_init(&panel);
+
+    int ret = media_pipeline_open(&p, src, &panel, MEDIA_OPEN_TIMEOUT);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = media_pipeline_render(&p, 0, NULL);
+    media_pipeline_close(&p);
+    return ret;
+}
+
+void media_late_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&late_lock);
+    memset(&late_ring, 0, sizeof(late_ring));
+    k_spin_unlock(&late_lock, key);
+}
+
+/* Copy the late frames out oldest first; returns how many */
+static int late_snapshot(struct media_late_frame *out, uint32_t *played, uint32_t *late)
+{
+    k_spinlock_key_t key = k_spin_lock(&late_lock);
+    int count = late_ring.count;
+    int first = (late_ring.head + MEDIA_LATE_FRAMES - count) % MEDIA_LATE_FRAMES;
+
+    for (int i = 0; i < count; i++) {
+        out[i] = late_ring.frames[(first + i) % MEDIA_LATE_FRAMES];
+    }
+    *played = late_ring.played;
+    *late = late_ring.late;
+    k_spin_unlock(&late_lock, key);
+
+    return count;
+}
+
+/*
+ * Binary dump for the Command characteristic (little-endian):
+ *   u8 version, u8 count, u32 frames_played, u32 frames_late
+ *   per late frame, oldest first: u32 uptime_ms, u16 frame, u16 budget_ms,
+ *           u16 late_ms, u32 read_us, u32 decode_us, u32 composite_us,
+ *           u32 sink_us
+ */
+int media_late_dump(uint8_t *buf, size_t size)
+{
+    struct media_late_frame frames[MEDIA_LATE_FRAMES];
+    uint32_t played, late;
+    const size_t per_frame = 26;
+
+    if (size < 10 + MEDIA_LATE_FRAMES * per_frame) {
+        return -ENOMEM;
+    }
+
+    int count = late_snapshot(frames, &played, &late);
+
+    uint8_t *p = buf;
+    *p++ = MEDIA_LATE_DUMP_VERSION;
+    *p++ = count;
+    sys_put_le32(played, p);
+    sys_put_le32(late, p + 4);
+    p += 8;
+
+    for (int i = 0; i < count; i++) {
+        const struct media_late_frame *f = &frames[i];
+
+        sys_put_le32(f->uptime_ms, p);
+        sys_put_le16(f->frame, p + 4);
+        sys_put_le16(f->budget_ms, p + 6);
+        sys_put_le16(f->late_ms, p + 8);
+        sys_put_le32(f->read_us, p + 10);
+        sys_put_le32(f->decode_us, p + 14);
+        sys_put_le32(f->composite_us, p + 18);
+        sys_put_le32(f->sink_us, p + 22);
+        p += per_frame;
+    }
+
+    return p - buf;
+}
+
+#ifdef CONFIG_SHELL
+static const char *const stage_names[MEDIA_STAGE_COUNT] = {
+    "decode", "convert", "composite", "sink",
+};
+
+static int cmd_media_show(const struct shell *sh, size_t argc, char **argv)
+{
+    struct media_source src;
+
+    int ret = media_source_file_open(&src, argv[1]);
+    if (ret == 0) {
+        ret = media_show(&src);
+        media_source_close(&src);
+    }
+
+    if (ret < 0) {
+        shell_error(sh, "Failed to show %s: %d", argv[1], ret);
+    }
+    return ret;
+}
+
+/* Decode every frame into the null sink (or the panel) and report per-stage
+ * times, so each stage can be measured on its own */
+static int cmd_media_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    struct media_pipeline p;
+    struct media_source src;
+    struct media_sink sink;
+
+    if (argc > 2 && strcmp(argv[2], "panel") == 0) {
+        media_sink_panel_init(&sink);
+    } else {
+        media_sink_null_init(&sink);
+    }
+
+    int ret = media_source_file_open(&src, argv[1]);
+    if (ret < 0) {
+        shell_error(sh, "Failed to open %s: %d", argv[1], ret);
+        return ret;
+    }
+
+    ret = media_pipeline_open(&p, &src, &sink, MEDIA_OPEN_TIMEOUT);
+    if (ret < 0) {
+        shell_error(sh, "Failed to open pipeline: %d", ret);
+        media_source_close(&src);
+        return ret;
+    }
+
+    int64_t start = k_uptime_get();
+    for (uint16_t frame = 0; frame < p.info.frame_count && ret == 0; frame++) {
+        ret = media_pipeline_render(&p, frame, NULL);
+    }
+    int64_t elapsed = MAX(k_uptime_get() - start, 1);
+    uint32_t fps10 = (uint32_t)(p.info.frame_count * 10000LL / elapsed);
+
+    shell_print(sh, "%s (%s): %u frames in %lld ms (%u.%u fps), ret %d", argv[1],
+                p.decoder->name, p.info.frame_count, elapsed, fps10 / 10, fps10 % 10, ret);
+    for (int i = 0; i < MEDIA_STAGE_COUNT; i++) {
+        const struct media_stage_stats *st = &p.stats[i];
+        shell_print(sh, "  %-9s %6u calls  avg %6u us  max %6u us", stage_names[i],
+                    st->count, st->count ? st->total_us / st->count : 0, st->max_us);
+    }
+
+    media_pipeline_close(&p);
+    media_source_close(&src);
+    return ret;
+}
+
+static int cmd_media_play(const struct shell *sh, size_t argc, char **argv)
+{
+    struct media_pipeline p;
+    struct media_source src;
+    struct media_sink panel;
+    uint16_t loops = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1;
+
+    media_sink_panel_init(&panel);
+
+    int ret = media_source_file_open(&src, argv[1]);
+    if (ret < 0) {
+        shell_error(sh, "Failed to open %s: %d", argv[1], ret);
+        return ret;
+    }
+
+    ret = media_pipeline_open(&p, &src, &panel, MEDIA_OPEN_TIMEOUT);
+    if (ret == 0) {
+        ret = media_pipeline_play(&p, loops);
+        media_pipeline_close(&p);
+    }
+    media_source_close(&src);
+
+    if (ret < 0) {
+        shell_error(sh, "Failed to play %s: %d", argv[1], ret);
+    }
+    return ret;
+}
+
+/* Per-file dither flag; the player redraws so the change shows at once */
+static int cmd_media_dither(const struct shell *sh, size_t argc, char **argv)
+{
+    uint16_t flags;
+
+    int ret = storage_get_flags(argv[1], &flags);
+    if (ret < 0) {
+        shell_error(sh, "Failed to read flags of %s: %d", argv[1], ret);
+        return ret;
+    }
+
+    if (argc > 2) {
+        if (strcmp(argv[2], "on") == 0) {
+            flags |= MEDIA_FLAG_DITHER;
+        } else if (strcmp(argv[2], "off") == 0) {
+            flags &= ~MEDIA_FLAG_DITHER;
+        } else {
+            shell_error(sh, "Expected on or off");
+            return -EINVAL;
+        }
+
+        ret = storage_set_flags(argv[1], flags);
+        if (ret < 0) {
+            shell_error(sh, "Failed to set flags of %s: %d", argv[1], ret);
+            return ret;
+        }
+        player_play(NULL);
+    }
+
+    shell_print(sh, "%s: dither %s", argv[1], (flags & MEDIA_FLAG_DITHER) ? "on" : "off");
+    return 0;
+}
+
+static int cmd_media_late_show(const struct shell *sh, size_t argc, char **argv)
+{
+    struct media_late_frame frames[MEDIA_LATE_FRAMES];
+    uint32_t played, late;
+
+    int count = late_snapshot(frames, &played, &late);
+
+    shell_print(sh, "%u of %u frames late", late, played);
+    for (int i = 0; i < count; i++) {
+        const struct media_late_frame *f = &frames[i];
+        shell_print(sh, "  @%u ms frame %u: +%u ms over %u ms  read %u  decode %u  "
+                    "composite %u  sink %u us", f->uptime_ms, f->frame, f->late_ms,
+                    f->budget_ms, f->read_us, f->decode_us, f->composite_us, f->sink_us);
+    }
+
+    return 0;
+}
+
+static int cmd_media_late_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    media_late_reset();
+    shell_print(sh, "Late frames cleared");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(media_late_cmds,
+    SHELL_CMD(show, NULL, "Show recent late frames", cmd_media_late_show),
+    SHELL_CMD(reset, NULL, "Clear late frames", cmd_media_late_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(media_cmds,
+    SHELL_CMD_ARG(show, NULL, "Show the first frame: show <name>", cmd_media_show, 2, 0),
+    SHELL_CMD_ARG(play, NULL, "Play on the panel: play <name> [loops]", cmd_media_play, 2, 1),
+    SHELL_CMD_ARG(bench, NULL, "Time each stage: bench <name> [panel]", cmd_media_bench, 2, 1),
+    SHELL_CMD_ARG(dither, NULL, "Ordered dither when drawn: dither <name> [on|off]",
+                  cmd_media_dither, 2, 1),
+    SHELL_CMD(late, &media_late_cmds, "Frames that missed their deadline", NULL),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(media, &media_cmds, "Media pipeline", NULL);
+#endif /* CONFIG_SHELL */
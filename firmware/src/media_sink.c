@@ -0,0 +1,66 @@
+/*
+ * OpenDOTT - Media Sinks
+ * SPDX-License-Identifier: MIT
+ *
+ * Last pipeline stage, run on the pipeline's sink thread:
+ *  - panel:    strips go straight to the GC9A01 window
+ *  - null:     drops everything, for timing the stages before it
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(media_sink, CONFIG_LOG_DEFAULT_LEVEL);
+
+static int panel_frame_begin(struct media_sink *sink, uint16_t frame)
+{
+    return 0;
+}
+
+static int panel_write_strip(struct media_sink *sink, const struct media_strip *strip)
+{
+    return display_draw_buffer(0, strip->y, DISPLAY_WIDTH, strip->lines,
+                               (const uint8_t *)strip->pixels);
+}
+
+static int panel_frame_end(struct media_sink *sink)
+{
+    display_frame_end();
+    return 0;
+}
+
+static const struct media_sink_api panel_api = {
+    .frame_begin = panel_frame_begin,
+    .write_strip = panel_write_strip,
+    .frame_end = panel_frame_end,
+};
+
+void media_sink_panel_init(struct media_sink *sink)
+{
+    sink->api = &panel_api;
+    sink->ctx = NULL;
+}
+
+static int null_write_strip(struct media_sink *sink, const struct media_strip *strip)
+{
+    return 0;
+}
+
+static int null_frame_end(struct media_sink *sink)
+{
+    return 0;
+}
+
+static const struct media_sink_api null_api = {
+    .frame_begin = panel_frame_begin,
+    .write_strip = null_write_strip,
+    .frame_end = null_frame_end,
+};
+
+void media_sink_null_init(struct media_sink *sink)
+{
+    sink->api = &null_api;
+    sink->ctx = NULL;
+}
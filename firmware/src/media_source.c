@@ -0,0 +1,128 @@
+/*
+ * OpenDOTT - Media Byte Sources
+ * SPDX-License-Identifier: MIT
+ *
+ * First pipeline stage: random-access reads from wherever the media lives.
+ * Memory sources cover RAM, XIP-mapped QSPI and the BLE receive buffer
+ * without a copy; file sources read stored media (or derived files) from
+ * LittleFS through an open handle.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(media_source, CONFIG_LOG_DEFAULT_LEVEL);
+
+static ssize_t mem_read(struct media_source *src, size_t offset, void *buf, size_t len)
+{
+    if (offset >= src->size) {
+        return 0;
+    }
+
+    len = MIN(len, src->size - offset);
+    memcpy(buf, src->mem + offset, len);
+    return len;
+}
+
+static void mem_close(struct media_source *src)
+{
+    src->mem = NULL;
+}
+
+static const struct media_source_api mem_api = {
+    .read = mem_read,
+    .close = mem_close,
+};
+
+static ssize_t file_read(struct media_source *src, size_t offset, void *buf, size_t len)
+{
+    return storage_file_read(&src->file, offset, buf, len);
+}
+
+static void file_close(struct media_source *src)
+{
+    storage_file_close(&src->file);
+}
+
+static const struct media_source_api file_api = {
+    .read = file_read,
+    .close = file_close,
+};
+
+int media_source_mem_init(struct media_source *src, const void *data, size_t size)
+{
+    if (!data || size == 0) {
+        return -EINVAL;
+    }
+
+    src->api = &mem_api;
+    src->name = NULL;
+    src->size = size;
+    src->read_us = 0;
+    src->mem = data;
+    return 0;
+}
+
+int media_source_file_open(struct media_source *src, const char *name)
+{
+    size_t size;
+
+    int ret = storage_get_info(name, &size, NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_open(name, &src->file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    src->api = &file_api;
+    src->name = name;
+    src->size = size;
+    src->read_us = 0;
+    return 0;
+}
+
+/* Derived files have no entry in the metadata cache, so size them by seeking */
+int media_source_meta_open(struct media_source *src, const char *name, const char *ext)
+{
+    int ret = storage_meta_open(name, ext, false, &src->file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = fs_seek(&src->file, 0, FS_SEEK_END);
+    off_t size = (ret < 0) ? ret : fs_tell(&src->file);
+    if (size <= 0) {
+        storage_file_close(&src->file);
+        return size < 0 ? (int)size : -ENODATA;
+    }
+
+    src->api = &file_api;
+    src->name = NULL;
+    src->size = size;
+    src->read_us = 0;
+    return 0;
+}
+
+ssize_t media_source_read(struct media_source *src, size_t offset, void *buf, size_t len)
+{
+    uint32_t start = k_cycle_get_32();
+    ssize_t ret = src->api->read(src, offset, buf, len);
+
+    src->read_us += k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    return ret;
+}
+
+void media_source_close(struct media_source *src)
+{
+    if (src->api) {
+        src->api->close(src);
+        src->api = NULL;
+    }
+}
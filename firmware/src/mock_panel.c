@@ -0,0 +1,245 @@
+/*
+ * OpenDOTT - Mock GC9A01 Panel (native_sim)
+ * SPDX-License-Identifier: MIT
+ *
+ * Stands in for the SPI panel when CONFIG_OPENDOTT_MOCK_PANEL is set.
+ * display.c sends the exact byte stream it would put on the wire; this
+ * models the parts of the GC9A01 that decide where pixels land (CASET,
+ * RASET, RAMWR with column/row wrap, MADCTL MV/MX/MY relative to the
+ * driver's default) into a 240x240 framebuffer.
+ *
+ * On every display_frame_end() the framebuffer is written out as
+ * frame_NNNNN.ppm and the frame's commands are appended to trace.txt, one
+ * line per command with its data byte count, plus totals and the SPI time
+ * they would take at CONFIG_OPENDOTT_MOCK_PANEL_SPI_HZ. NNNNN wraps at
+ * CONFIG_OPENDOTT_MOCK_PANEL_FRAMES, and trace.txt restarts with it. Files
+ * are written by mock_panel_host.c, which runs on the host side of
+ * native_sim.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(mock_panel, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define GC9A01_CASET   0x2A
+#define GC9A01_RASET   0x2B
+#define GC9A01_RAMWR   0x2C
+#define GC9A01_MADCTL  0x36
+
+#define MADCTL_MY      BIT(7)
+#define MADCTL_MX      BIT(6)
+#define MADCTL_MV      BIT(5)
+#define MADCTL_DEFAULT 0x48     /* What display_init() sets: MX + BGR */
+
+#define MOCK_TRACE_SIZE 8192
+
+/* Host side (mock_panel_host.c) */
+int mock_panel_host_write(const char *dir, const char *file, const void *data,
+                          size_t len, int append);
+
+static uint16_t fb[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+static uint8_t ppm_rgb[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+static char trace[MOCK_TRACE_SIZE];
+static size_t trace_len;
+
+static struct {
+    uint8_t cmd;
+    bool have_cmd;
+    uint8_t params[4];
+    uint32_t data_len;          /* Data bytes since the last command */
+    uint16_t xs, xe, ys, ye;
+    uint16_t x, y;
+    uint8_t madctl;
+    uint8_t half;               /* First byte of a split pixel */
+    bool have_half;
+} panel = {
+    .xe = DISPLAY_WIDTH - 1,
+    .ye = DISPLAY_HEIGHT - 1,
+    .madctl = MADCTL_DEFAULT,
+};
+
+static struct {
+    uint32_t frame;
+    uint32_t cmds;
+    uint32_t bytes;
+    uint32_t windows;
+    uint32_t pixels;
+} stats;
+
+static void trace_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (trace_len >= sizeof(trace)) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    int n = vsnprintf(&trace[trace_len], sizeof(trace) - trace_len, fmt, ap);
+    va_end(ap);
+
+    trace_len = MIN(trace_len + MAX(n, 0), sizeof(trace));
+}
+
+/* Close the trace line of the previous command */
+static void trace_flush_cmd(void)
+{
+    if (panel.have_cmd) {
+        trace_printf("  %02X %u\n", panel.cmd, panel.data_len);
+    }
+}
+
+static void put_pixel(uint16_t color)
+{
+    uint8_t rel = panel.madctl ^ MADCTL_DEFAULT;
+    uint16_t x = panel.x;
+    uint16_t y = panel.y;
+
+    if (rel & MADCTL_MV) {
+        uint16_t t = x;
+        x = y;
+        y = t;
+    }
+    if (rel & MADCTL_MX) {
+        x = DISPLAY_WIDTH - 1 - x;
+    }
+    if (rel & MADCTL_MY) {
+        y = DISPLAY_HEIGHT - 1 - y;
+    }
+
+    if (x < DISPLAY_WIDTH && y < DISPLAY_HEIGHT) {
+        fb[y * DISPLAY_WIDTH + x] = color;
+    }
+    stats.pixels++;
+
+    /* Column first, then row, wrapping inside the window like the panel */
+    if (++panel.x > panel.xe) {
+        panel.x = panel.xs;
+        if (++panel.y > panel.ye) {
+            panel.y = panel.ys;
+        }
+    }
+}
+
+int mock_panel_cmd(uint8_t cmd)
+{
+    trace_flush_cmd();
+
+    panel.cmd = cmd;
+    panel.have_cmd = true;
+    panel.data_len = 0;
+    panel.have_half = false;
+
+    if (cmd == GC9A01_RAMWR) {
+        panel.x = panel.xs;
+        panel.y = panel.ys;
+        stats.windows++;
+    }
+
+    stats.cmds++;
+    stats.bytes++;
+    return 0;
+}
+
+int mock_panel_data(const uint8_t *data, size_t len)
+{
+    stats.bytes += len;
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t n = panel.data_len++;
+
+        switch (panel.cmd) {
+        case GC9A01_RAMWR:
+            if (panel.have_half) {
+                put_pixel((panel.half << 8) | data[i]);
+                panel.have_half = false;
+            } else {
+                panel.half = data[i];
+                panel.have_half = true;
+            }
+            break;
+        case GC9A01_CASET:
+        case GC9A01_RASET:
+            if (n < 4) {
+                panel.params[n] = data[i];
+            }
+            if (n == 3) {
+                uint16_t s = (panel.params[0] << 8) | panel.params[1];
+                uint16_t e = (panel.params[2] << 8) | panel.params[3];
+                if (panel.cmd == GC9A01_CASET) {
+                    panel.xs = s;
+                    panel.xe = e;
+                } else {
+                    panel.ys = s;
+                    panel.ye = e;
+                }
+            }
+            break;
+        case GC9A01_MADCTL:
+            if (n == 0) {
+                panel.madctl = data[i];
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* RGB888 pixels of the last frame, as written to its PPM */
+const uint8_t *mock_panel_rgb(void)
+{
+    return ppm_rgb;
+}
+
+void mock_panel_frame_end(void)
+{
+    char name[32];
+    char hdr[32];
+    int n;
+
+    trace_flush_cmd();
+    panel.have_cmd = false;
+
+    uint64_t spi_us = (uint64_t)stats.bytes * 8 * 1000000 / CONFIG_OPENDOTT_MOCK_PANEL_SPI_HZ;
+    trace_printf("  total: %u cmds, %u bytes, %u windows, %u pixels, %llu us SPI\n",
+                 stats.cmds, stats.bytes, stats.windows, stats.pixels,
+                 (unsigned long long)spi_us);
+
+    for (size_t i = 0; i < ARRAY_SIZE(fb); i++) {
+        uint16_t c = fb[i];
+        ppm_rgb[i * 3] = (c >> 11) << 3;
+        ppm_rgb[i * 3 + 1] = ((c >> 5) & 0x3F) << 2;
+        ppm_rgb[i * 3 + 2] = (c & 0x1F) << 3;
+    }
+
+    if (CONFIG_OPENDOTT_MOCK_PANEL_FRAMES > 0) {
+        uint32_t slot = stats.frame % MAX(CONFIG_OPENDOTT_MOCK_PANEL_FRAMES, 1);
+
+        snprintf(name, sizeof(name), "frame_%05u.ppm", slot);
+        n = snprintf(hdr, sizeof(hdr), "P6\n%d %d\n255\n", DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        mock_panel_host_write(CONFIG_OPENDOTT_MOCK_PANEL_DIR, name, hdr, n, 0);
+        mock_panel_host_write(CONFIG_OPENDOTT_MOCK_PANEL_DIR, name, ppm_rgb, sizeof(ppm_rgb), 1);
+
+        n = snprintf(hdr, sizeof(hdr), "frame %u\n", stats.frame);
+        mock_panel_host_write(CONFIG_OPENDOTT_MOCK_PANEL_DIR, "trace.txt", hdr, n, slot > 0);
+        mock_panel_host_write(CONFIG_OPENDOTT_MOCK_PANEL_DIR, "trace.txt", trace, trace_len, 1);
+    }
+
+    LOG_DBG("Frame %u: %u bytes, %llu us SPI", stats.frame, stats.bytes,
+            (unsigned long long)spi_us);
+
+    uint32_t frame = stats.frame;
+
+    trace_len = 0;
+    memset(&stats, 0, sizeof(stats));
+    stats.frame = frame + 1;
+}
@@ -0,0 +1,31 @@
+/*
+ * OpenDOTT - Mock Panel, host side (native_sim)
+ * SPDX-License-Identifier: MIT
+ *
+ * Built into the native_sim runner against the host C library, so the
+ * mock panel can write its frames and trace to the host file system.
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+int mock_panel_host_write(const char *dir, const char *file, const void *data,
+                          size_t len, int append)
+{
+    char path[256];
+    FILE *f;
+
+    mkdir(dir, 0755);
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    f = fopen(path, append ? "ab" : "wb");
+    if (!f) {
+        return -1;
+    }
+
+    size_t written = fwrite(data, 1, len, f);
+    fclose(f);
+
+    return written == len ? 0 : -1;
+}
@@ -0,0 +1,535 @@
+/*
+ * OpenDOTT - OTA Receive Paths
+ * SPDX-License-Identifier: MIT
+ *
+ * MCUmgr group for firmware updates that are not a plain byte copy of the
+ * new slot1 content (the standard img group handles those). A compressed
+ * upload is an LZSS stream that is expanded into slot1 as it arrives. The
+ * only RAM it needs is a 4KB history window, a small staging buffer and the
+ * flash_img write buffer. Once the last byte is written, slot1 is checked
+ * against the SHA256 of the uncompressed image and then marked for a test
+ * boot.
+ *
+ * A delta upload is a patch against the confirmed slot0 image, which the
+ * first chunk identifies by SHA256 ("base", over its first "blen" bytes).
+ * The patch is spooled into the MCUboot scratch partition, which is unused
+ * while the app runs. After the last chunk it is applied in one streaming
+ * pass: COPY ops read from slot0 and ADD ops read from scratch, both into
+ * slot1. Scratch is erased again afterwards so MCUboot never sees stale
+ * data there.
+ *
+ * Requests look like img group uploads and can be pipelined the same way:
+ * {off, data}, plus {len, ulen, sha} on the first chunk (and {base, blen}
+ * for deltas). Every response carries the next expected offset, and a chunk
+ * at any other offset is dropped. Resending the first chunk with the same
+ * sha resumes an interrupted upload, as long as the device has not
+ * rebooted in between.
+ *
+ * The LZSS and patch formats, and their decoders, are in ota_codec.c.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/mgmt/mcumgr/mgmt/mgmt.h>
+#include <zephyr/mgmt/mcumgr/mgmt/handlers.h>
+#include <zephyr/mgmt/mcumgr/smp/smp.h>
+#include <zephyr/logging/log.h>
+#include <zcbor_common.h>
+#include <zcbor_decode.h>
+#include <zcbor_encode.h>
+#include <mgmt/mcumgr/util/zcbor_bulk.h>
+#include <string.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(ota, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define OTA_MGMT_GROUP_ID        (MGMT_GROUP_ID_PERUSER + 0)
+#define OTA_MGMT_ID_UPLOAD_LZ    0
+#define OTA_MGMT_ID_UPLOAD_DELTA 1
+
+#define OTA_SLOT_ID              FIXED_PARTITION_ID(slot1_partition)
+#define OTA_SLOT_SIZE            FIXED_PARTITION_SIZE(slot1_partition)
+#define OTA_BASE_ID              FIXED_PARTITION_ID(slot0_partition)
+#define OTA_BASE_SIZE            FIXED_PARTITION_SIZE(slot0_partition)
+#define OTA_SPOOL_ID             FIXED_PARTITION_ID(scratch_partition)
+#define OTA_SPOOL_SIZE           FIXED_PARTITION_SIZE(scratch_partition)
+#define OTA_PAGE_SIZE            4096
+#define OTA_SHA_LEN              32
+#define OTA_STAGE_SIZE           256
+
+enum ota_mode {
+    OTA_MODE_LZ,
+    OTA_MODE_DELTA,
+};
+
+struct ota_params {
+    uint32_t len;
+    uint32_t ulen;
+    uint32_t blen;
+    struct zcbor_string sha;
+    struct zcbor_string base;
+};
+
+static struct {
+    bool active;
+    enum ota_mode mode;
+    uint32_t in_size;
+    uint32_t in_off;
+    uint32_t out_size;
+    uint32_t out_off;
+    uint32_t base_len;
+    uint8_t sha[OTA_SHA_LEN];
+    uint8_t stage[OTA_STAGE_SIZE];
+    uint16_t stage_len;
+    /* Writes slot1, or the patch spool in scratch while a delta arrives */
+    struct flash_img_context img;
+} ota;
+
+static struct ota_lz lz;
+
+static int ota_flush_stage(void)
+{
+    int ret = flash_img_buffered_write(&ota.img, ota.stage, ota.stage_len, false);
+
+    ota.stage_len = 0;
+    return ret;
+}
+
+/* Append one byte of the reconstructed image */
+static int ota_emit(uint8_t b, void *user)
+{
+    ARG_UNUSED(user);
+
+    if (ota.out_off >= ota.out_size) {
+        return -EFBIG;
+    }
+
+    ota.stage[ota.stage_len++] = b;
+    ota.out_off++;
+
+    if (ota.stage_len == sizeof(ota.stage)) {
+        return ota_flush_stage();
+    }
+    return 0;
+}
+
+static int ota_emit_buf(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        int ret = ota_emit(data[i], NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/* Buffered reader over the patch spooled in scratch */
+static struct {
+    const struct flash_area *fa;
+    uint32_t off;
+    uint32_t end;
+    uint16_t pos;
+    uint16_t len;
+    uint8_t buf[OTA_STAGE_SIZE];
+} spool;
+
+static int spool_read_byte(void *user, uint8_t *b)
+{
+    ARG_UNUSED(user);
+
+    if (spool.pos == spool.len) {
+        if (spool.off >= spool.end) {
+            return -ENODATA;
+        }
+
+        spool.len = MIN(sizeof(spool.buf), spool.end - spool.off);
+        int ret = flash_area_read(spool.fa, spool.off, spool.buf, spool.len);
+        if (ret < 0) {
+            return ret;
+        }
+        spool.off += spool.len;
+        spool.pos = 0;
+    }
+
+    *b = spool.buf[spool.pos++];
+    return 0;
+}
+
+static int delta_copy(void *user, uint32_t src, uint32_t count)
+{
+    const struct flash_area *base = user;
+    uint8_t buf[OTA_STAGE_SIZE];
+
+    if (src + count > ota.base_len || src + count < src) {
+        return -EBADMSG;
+    }
+
+    while (count > 0) {
+        size_t n = MIN(sizeof(buf), count);
+        int ret = flash_area_read(base, src, buf, n);
+        if (ret == 0) {
+            ret = ota_emit_buf(buf, n);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        src += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+/* Rebuild the new image in slot1 from slot0 and the spooled patch */
+static int delta_apply(void)
+{
+    static const struct ota_delta_io delta_io = {
+        .read_byte = spool_read_byte,
+        .copy = delta_copy,
+        .emit = ota_emit,
+    };
+    const struct flash_area *base;
+    int ret;
+
+    ret = flash_img_buffered_write(&ota.img, NULL, 0, true);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = flash_img_init_id(&ota.img, OTA_SLOT_ID);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = flash_area_open(OTA_SPOOL_ID, &spool.fa);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = flash_area_open(OTA_BASE_ID, &base);
+    if (ret < 0) {
+        flash_area_close(spool.fa);
+        return ret;
+    }
+
+    spool.off = 0;
+    spool.end = ota.in_size;
+    spool.pos = 0;
+    spool.len = 0;
+
+    ret = ota_delta_apply(&delta_io, (void *)base, ota.out_size);
+
+    flash_area_close(base);
+
+    /* Leave scratch blank for MCUboot */
+    flash_area_erase(spool.fa, 0, ROUND_UP(ota.in_size, OTA_PAGE_SIZE));
+    flash_area_close(spool.fa);
+
+    if (ret < 0) {
+        LOG_ERR("Patch failed at image offset %u: %d", ota.out_off, ret);
+    }
+    return ret;
+}
+
+/* The patch only makes sense against the exact image it was made from */
+static int delta_check_base(const struct ota_params *p)
+{
+    const struct flash_area *fa;
+    uint8_t rbuf[OTA_STAGE_SIZE];
+
+    if (p->base.len != OTA_SHA_LEN || p->blen == 0 || p->blen > OTA_BASE_SIZE ||
+        p->len > OTA_SPOOL_SIZE) {
+        return -EINVAL;
+    }
+
+    if (!boot_is_img_confirmed()) {
+        LOG_ERR("Delta OTA needs a confirmed slot0 image");
+        return -EBUSY;
+    }
+
+    int ret = flash_area_open(OTA_BASE_ID, &fa);
+    if (ret < 0) {
+        return ret;
+    }
+
+    const struct flash_area_check fac = {
+        .match = p->base.value,
+        .clen = p->blen,
+        .off = 0,
+        .rbuf = rbuf,
+        .rblen = sizeof(rbuf),
+    };
+
+    ret = flash_area_check_int_sha256(fa, &fac);
+    flash_area_close(fa);
+
+    if (ret < 0) {
+        LOG_ERR("Delta base does not match slot0");
+        return -ENOENT;
+    }
+    return 0;
+}
+
+static int delta_begin_spool(uint32_t len)
+{
+    const struct flash_area *fa;
+
+    int ret = flash_area_open(OTA_SPOOL_ID, &fa);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = flash_area_erase(fa, 0, ROUND_UP(len, OTA_PAGE_SIZE));
+    flash_area_close(fa);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return flash_img_init_id(&ota.img, OTA_SPOOL_ID);
+}
+
+static int ota_begin(enum ota_mode mode, const struct ota_params *p)
+{
+    int ret;
+
+    if (p->len == 0 || p->ulen == 0 || p->ulen > OTA_SLOT_SIZE ||
+        p->sha.len != OTA_SHA_LEN) {
+        return -EINVAL;
+    }
+
+    if (ota.active && ota.mode == mode && ota.in_size == p->len &&
+        ota.out_size == p->ulen && memcmp(ota.sha, p->sha.value, OTA_SHA_LEN) == 0) {
+        LOG_INF("Resuming OTA at %u/%u", ota.in_off, p->len);
+        return 0;
+    }
+
+    ota.active = false;
+
+    if (mode == OTA_MODE_DELTA) {
+        ret = delta_check_base(p);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    ret = boot_erase_img_bank(OTA_SLOT_ID);
+    if (ret < 0) {
+        LOG_ERR("Failed to erase slot1: %d", ret);
+        return ret;
+    }
+
+    if (mode == OTA_MODE_DELTA) {
+        ret = delta_begin_spool(p->len);
+    } else {
+        ret = flash_img_init_id(&ota.img, OTA_SLOT_ID);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    ota.mode = mode;
+    ota.in_size = p->len;
+    ota.in_off = 0;
+    ota.out_size = p->ulen;
+    ota.out_off = 0;
+    ota.base_len = p->blen;
+    ota.stage_len = 0;
+    memcpy(ota.sha, p->sha.value, OTA_SHA_LEN);
+    ota_lz_init(&lz);
+    ota.active = true;
+
+    LOG_INF("OTA started: %u bytes in, %u bytes image", p->len, p->ulen);
+    return 0;
+}
+
+/* All input received: flush, verify the image hash and request a test boot */
+static int ota_finish(void)
+{
+    int ret;
+
+    ota.active = false;
+
+    if (ota.mode == OTA_MODE_DELTA) {
+        ret = delta_apply();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    ret = ota_flush_stage();
+    if (ret == 0) {
+        ret = flash_img_buffered_write(&ota.img, NULL, 0, true);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (ota.out_off != ota.out_size) {
+        LOG_ERR("Image is %u bytes, expected %u", ota.out_off, ota.out_size);
+        return -EMSGSIZE;
+    }
+
+    const struct flash_img_check fic = {
+        .match = ota.sha,
+        .clen = ota.out_size,
+    };
+
+    ret = flash_img_check(&ota.img, &fic, OTA_SLOT_ID);
+    if (ret < 0) {
+        LOG_ERR("Image hash mismatch");
+        return -EBADMSG;
+    }
+
+    ret = boot_request_upgrade(BOOT_UPGRADE_TEST);
+    if (ret < 0) {
+        return ret;
+    }
+
+    LOG_INF("OTA image verified, pending test boot");
+    return 0;
+}
+
+static int ota_feed(const uint8_t *data, size_t len)
+{
+    int ret;
+
+    if (ota.in_off + len > ota.in_size) {
+        return -EFBIG;
+    }
+
+    switch (ota.mode) {
+    case OTA_MODE_LZ:
+        ret = ota_lz_feed(&lz, data, len, ota_emit, NULL);
+        break;
+    case OTA_MODE_DELTA:
+        ret = flash_img_buffered_write(&ota.img, data, len, false);
+        break;
+    default:
+        ret = -ENOTSUP;
+        break;
+    }
+
+    if (ret < 0) {
+        ota.active = false;
+        return ret;
+    }
+
+    ota.in_off += len;
+    return 0;
+}
+
+static int ota_errno_to_mgmt(int err)
+{
+    switch (err) {
+    case -EINVAL:
+        return MGMT_ERR_EINVAL;
+    case -EFBIG:
+    case -EMSGSIZE:
+        return MGMT_ERR_EMSGSIZE;
+    case -EBADMSG:
+    case -EBUSY:
+        return MGMT_ERR_EBADSTATE;
+    case -ENOENT:
+        return MGMT_ERR_ENOENT;
+    case -ENOTSUP:
+        return MGMT_ERR_ENOTSUP;
+    default:
+        return MGMT_ERR_EUNKNOWN;
+    }
+}
+
+static int ota_handle_upload(struct smp_streamer *ctxt, enum ota_mode mode)
+{
+    zcbor_state_t *zsd = ctxt->reader->zs;
+    zcbor_state_t *zse = ctxt->writer->zs;
+    uint32_t off = UINT32_MAX;
+    struct ota_params params = { 0 };
+    struct zcbor_string data = { 0 };
+    size_t decoded;
+    bool done = false;
+    int ret = 0;
+
+    struct zcbor_map_decode_key_val upload_keys[] = {
+        ZCBOR_MAP_DECODE_KEY_DECODER("off", zcbor_uint32_decode, &off),
+        ZCBOR_MAP_DECODE_KEY_DECODER("data", zcbor_bstr_decode, &data),
+        ZCBOR_MAP_DECODE_KEY_DECODER("len", zcbor_uint32_decode, &params.len),
+        ZCBOR_MAP_DECODE_KEY_DECODER("ulen", zcbor_uint32_decode, &params.ulen),
+        ZCBOR_MAP_DECODE_KEY_DECODER("sha", zcbor_bstr_decode, &params.sha),
+        ZCBOR_MAP_DECODE_KEY_DECODER("base", zcbor_bstr_decode, &params.base),
+        ZCBOR_MAP_DECODE_KEY_DECODER("blen", zcbor_uint32_decode, &params.blen),
+    };
+
+    if (zcbor_map_decode_bulk(zsd, upload_keys, ARRAY_SIZE(upload_keys), &decoded) != 0 ||
+        off == UINT32_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    idle_mark_busy();
+
+    if (off == 0) {
+        ret = ota_begin(mode, &params);
+    } else if (!ota.active || ota.mode != mode) {
+        ret = -EINVAL;
+    }
+
+    /* Out-of-order chunks are dropped; the reply tells the client where to resume */
+    if (ret == 0 && off == ota.in_off && data.len > 0) {
+        ret = ota_feed(data.value, data.len);
+        if (ret == 0 && ota.in_off == ota.in_size) {
+            ret = ota_finish();
+            done = (ret == 0);
+        }
+    }
+
+    if (ret < 0) {
+        LOG_ERR("OTA upload failed at %u: %d", off, ret);
+        return ota_errno_to_mgmt(ret);
+    }
+
+    bool ok = zcbor_tstr_put_lit(zse, "rc") && zcbor_int32_put(zse, MGMT_ERR_EOK) &&
+              zcbor_tstr_put_lit(zse, "off") && zcbor_uint32_put(zse, ota.in_off);
+
+    if (ok && done) {
+        ok = zcbor_tstr_put_lit(zse, "match") && zcbor_bool_put(zse, true);
+    }
+
+    return ok ? MGMT_ERR_EOK : MGMT_ERR_EMSGSIZE;
+}
+
+static int ota_upload_lz(struct smp_streamer *ctxt)
+{
+    return ota_handle_upload(ctxt, OTA_MODE_LZ);
+}
+
+static int ota_upload_delta(struct smp_streamer *ctxt)
+{
+    return ota_handle_upload(ctxt, OTA_MODE_DELTA);
+}
+
+static const struct mgmt_handler ota_mgmt_handlers[] = {
+    [OTA_MGMT_ID_UPLOAD_LZ] = {
+        .mh_read = NULL,
+        .mh_write = ota_upload_lz,
+    },
+    [OTA_MGMT_ID_UPLOAD_DELTA] = {
+        .mh_read = NULL,
+        .mh_write = ota_upload_delta,
+    },
+};
+
+static struct mgmt_group ota_mgmt_group = {
+    .mg_handlers = ota_mgmt_handlers,
+    .mg_handlers_count = ARRAY_SIZE(ota_mgmt_handlers),
+    .mg_group_id = OTA_MGMT_GROUP_ID,
+};
+
+static void ota_mgmt_register(void)
+{
+    mgmt_register_group(&ota_mgmt_group);
+}
+
+MCUMGR_HANDLER_DEFINE(opendott_ota, ota_mgmt_register);
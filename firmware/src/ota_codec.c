@@ -0,0 +1,160 @@
+/*
+ * OpenDOTT - OTA Stream Decoders
+ * SPDX-License-Identifier: MIT
+ *
+ * The two upload encodings ota.c accepts, kept apart from MCUmgr and the
+ * flash so they build on every target and can be tested on native_sim.
+ * Both produce the image one byte at a time through a callback; where the
+ * bytes go (slot1 via flash_img, a test buffer) is up to the caller.
+ *
+ * LZSS stream: a flag byte followed by up to 8 items, LSB first. Flag bit 1
+ * is a literal byte; flag bit 0 is a 2-byte match [d_lo, d_hi:4 | n:4]
+ * copying n + 3 bytes from distance ((d_hi << 8) | d_lo) + 1. Must match
+ * lz_compress() in tools/dott_flash.py.
+ *
+ * Delta patch: a sequence of ops until the image is complete.
+ *   0x01 COPY  varint src_delta, varint n  - n bytes from the base image;
+ *                                            src_delta is zigzag, relative
+ *                                            to the end of the previous copy
+ *   0x02 ADD   varint n, n bytes           - literal bytes
+ * Varints are LEB128. Must match delta_encode() in tools/dott_flash.py.
+ */
+
+#include <zephyr/kernel.h>
+
+#include "opendott.h"
+
+#define LZ_MIN_MATCH             3
+
+#define DELTA_OP_COPY            0x01
+#define DELTA_OP_ADD             0x02
+
+void ota_lz_init(struct ota_lz *lz)
+{
+    memset(lz, 0, sizeof(*lz));
+}
+
+static int lz_put(struct ota_lz *lz, uint8_t b, ota_emit_t emit, void *user)
+{
+    lz->window[lz->pos] = b;
+    lz->pos = (lz->pos + 1) & (OTA_LZ_WINDOW_SIZE - 1);
+    return emit(b, user);
+}
+
+/* Expand the next LEN bytes of the stream; a match or a flag group may
+ * span calls */
+int ota_lz_feed(struct ota_lz *lz, const uint8_t *data, size_t len, ota_emit_t emit,
+                void *user)
+{
+    int ret = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = data[i];
+
+        if (lz->items == 0) {
+            lz->flags = b;
+            lz->items = 8;
+            continue;
+        }
+
+        if (lz->flags & 1) {
+            ret = lz_put(lz, b, emit, user);
+        } else if (!lz->have_lo) {
+            lz->lo = b;
+            lz->have_lo = true;
+            continue;
+        } else {
+            uint16_t dist = (lz->lo | ((b & 0xF0) << 4)) + 1;
+            uint8_t count = (b & 0x0F) + LZ_MIN_MATCH;
+
+            lz->have_lo = false;
+            for (uint8_t k = 0; k < count && ret == 0; k++) {
+                ret = lz_put(lz, lz->window[(lz->pos - dist) & (OTA_LZ_WINDOW_SIZE - 1)],
+                             emit, user);
+            }
+        }
+
+        if (ret < 0) {
+            return ret;
+        }
+
+        lz->flags >>= 1;
+        lz->items--;
+    }
+
+    return 0;
+}
+
+static int delta_read_varint(const struct ota_delta_io *io, void *user, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    for (int shift = 0; shift < 32; shift += 7) {
+        uint8_t b;
+        int ret = io->read_byte(user, &b);
+        if (ret < 0) {
+            return ret;
+        }
+
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return 0;
+        }
+    }
+
+    return -EBADMSG;
+}
+
+/* Run the patch read through IO until OUT_SIZE bytes have been produced */
+int ota_delta_apply(const struct ota_delta_io *io, void *user, uint32_t out_size)
+{
+    uint32_t src = 0;
+    uint32_t out = 0;
+    int ret = 0;
+
+    while (ret == 0 && out < out_size) {
+        uint8_t op;
+        uint32_t arg;
+        uint32_t count;
+
+        ret = io->read_byte(user, &op);
+        if (ret < 0) {
+            break;
+        }
+
+        switch (op) {
+        case DELTA_OP_COPY:
+            ret = delta_read_varint(io, user, &arg);
+            if (ret == 0) {
+                ret = delta_read_varint(io, user, &count);
+            }
+            if (ret == 0) {
+                /* Zigzag-decoded offset relative to the previous copy */
+                src += (arg & 1) ? -(int32_t)((arg + 1) >> 1) : (int32_t)(arg >> 1);
+                ret = io->copy(user, src, count);
+                src += count;
+                out += count;
+            }
+            break;
+
+        case DELTA_OP_ADD:
+            ret = delta_read_varint(io, user, &count);
+            for (uint32_t i = 0; ret == 0 && i < count; i++) {
+                uint8_t b;
+                ret = io->read_byte(user, &b);
+                if (ret == 0) {
+                    ret = io->emit(b, user);
+                }
+            }
+            out += count;
+            break;
+
+        default:
+            ret = -EBADMSG;
+            break;
+        }
+    }
+
+    return ret;
+}
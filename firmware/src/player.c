@@ -0,0 +1,515 @@
+/*
+ * OpenDOTT - Slot Player
+ * SPDX-License-Identifier: MIT
+ *
+ * Plays the stored GIFs ("slots", in name order) on its own thread and
+ * switches between them on request, e.g. on a button press.
+ *
+ * Frame 0 of the playing slot and of CONFIG_OPENDOTT_PREFETCH_DEPTH slots
+ * either side of it is kept ready to show: header and LUT in RAM, the
+ * composited index canvas in its predecode frame cache (predecode.c). A
+ * switch to a prefetched slot only streams that cache through the LUT to
+ * the panel, with no file parsing or LZW, and playback then continues from
+ * frame 1 on the restored canvas. The current frame is finished first, so
+ * the new slot is up within about one frame period of the request.
+ *
+ * Prefetching runs once the new slot is on screen, inside its frame 0
+ * delay. A slot seen for the first time has its frame 0 decoded and cached
+ * then; later switches to it are cache reads.
+ *
+ * A switch to a prefetched slot goes through a transition (transition.c)
+ * from whatever is on the panel: the last frame played, whose decoder is
+ * kept open for it, or a frame 0 that is still up. A request during a
+ * transition ends it, and the next switch cuts, so quick presses skip
+ * straight through.
+ *
+ * A slot with a single frame (or none that change anything, see
+ * gif_decoder.c) is drawn once and never played. Whenever nothing is left
+ * to animate, because of that, a finished loop count or a pause, the
+ * panel bus and the flash power down until the next request (power.c).
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(player, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define PLAYER_STACK_SIZE       2048
+#define PLAYER_PRIORITY         6       /* Behind the button and sink threads */
+#define PLAYER_OPEN_TIMEOUT     K_MSEC(500)
+#define PLAYER_NAME_MAX         32
+#define PLAYER_SLOT_EXT         ".gif"
+
+#define PLAYER_DEPTH            CONFIG_OPENDOTT_PREFETCH_DEPTH
+#define PLAYER_CACHE_SIZE       (2 * PLAYER_DEPTH + 1)
+
+static struct predecode_first cache[PLAYER_CACHE_SIZE];
+static char current[PLAYER_NAME_MAX];
+
+/* What the panel shows between slots: frame 0 of ON_PANEL from its cache, or
+ * the last frame of a playback left open for a transition out */
+static char on_panel[PLAYER_NAME_MAX];
+static bool held_open;
+
+static struct media_pipeline pipeline;
+static struct media_source source;
+static struct media_sink panel;
+
+static K_SEM_DEFINE(player_wake, 0, 1);
+static K_MUTEX_DEFINE(pass_lock);   /* Held while a slot is being played */
+
+/* Requests, from any thread */
+static struct k_spinlock req_lock;
+static struct {
+    char name[PLAYER_NAME_MAX];     /* Play this slot, or "" */
+    int step;                       /* Otherwise move this many slots */
+    bool pending;
+    bool paused;
+    int64_t time_ms;                /* When the request was made */
+} req;
+
+static bool is_slot(const char *name)
+{
+    size_t len = strlen(name);
+    size_t ext = sizeof(PLAYER_SLOT_EXT) - 1;
+
+    return len > ext && strcmp(name + len - ext, PLAYER_SLOT_EXT) == 0;
+}
+
+/* Next slot after AFTER, wrapping around */
+static bool slot_next(const char *after, char *out)
+{
+    char name[PLAYER_NAME_MAX];
+
+    strcpy(name, after);
+    for (int pass = 0; pass < 2; pass++) {
+        while (storage_next_file(name, name, sizeof(name))) {
+            if (is_slot(name)) {
+                strcpy(out, name);
+                return true;
+            }
+        }
+        name[0] = '\0';
+    }
+
+    return false;
+}
+
+/* Slot before BEFORE, wrapping around */
+static bool slot_prev(const char *before, char *out)
+{
+    char name[PLAYER_NAME_MAX] = "";
+    char last[PLAYER_NAME_MAX] = "";
+    char prev[PLAYER_NAME_MAX] = "";
+
+    while (storage_next_file(name, name, sizeof(name))) {
+        if (!is_slot(name)) {
+            continue;
+        }
+        if (strcmp(name, before) < 0) {
+            strcpy(prev, name);
+        }
+        strcpy(last, name);
+    }
+
+    if (prev[0] == '\0' && last[0] == '\0') {
+        return false;
+    }
+    strcpy(out, prev[0] != '\0' ? prev : last);
+    return true;
+}
+
+static bool slot_step(const char *from, int step, char *out)
+{
+    if (out != from) {
+        strcpy(out, from);
+    }
+    for (; step > 0; step--) {
+        if (!slot_next(out, out)) {
+            return false;
+        }
+    }
+    for (; step < 0; step++) {
+        if (!slot_prev(out, out)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Something for the thread to act on: a switch, or a pause */
+static bool request_pending(void)
+{
+    return req.pending || req.paused;
+}
+
+static void request(const char *name, int step)
+{
+    k_spinlock_key_t key = k_spin_lock(&req_lock);
+
+    if (name) {
+        strncpy(req.name, name, sizeof(req.name) - 1);
+        req.name[sizeof(req.name) - 1] = '\0';
+        req.step = 0;
+    } else if (req.pending && req.name[0] == '\0') {
+        req.step += step;
+    } else if (!req.pending) {
+        req.step = step;
+    }
+    req.pending = true;
+    req.time_ms = k_uptime_get();
+    k_spin_unlock(&req_lock, key);
+
+    /* The transition first: stopping playback can start one */
+    transition_stop();
+    media_pipeline_stop(&pipeline);
+    k_sem_give(&player_wake);
+}
+
+/* Turn the pending request into a new current slot */
+static bool take_request(int64_t *time_ms)
+{
+    char name[PLAYER_NAME_MAX];
+    size_t size;
+    int step;
+
+    k_spinlock_key_t key = k_spin_lock(&req_lock);
+    bool pending = req.pending && !req.paused;
+
+    if (pending) {
+        strcpy(name, req.name);
+        step = req.step;
+        *time_ms = req.time_ms;
+        req.name[0] = '\0';
+        req.step = 0;
+        req.pending = false;
+    }
+    k_spin_unlock(&req_lock, key);
+
+    if (!pending) {
+        return false;
+    }
+
+    if (name[0] != '\0' && storage_get_info(name, &size, NULL) == 0) {
+        strcpy(current, name);
+        return true;
+    }
+
+    /* A named slot that is gone, or no slot yet: the first one */
+    if (name[0] != '\0' || current[0] == '\0') {
+        return slot_next("", current);
+    }
+
+    return slot_step(current, step, current);
+}
+
+/* An entry whose LUT was built with another color profile is stale */
+static bool cache_stale(const struct predecode_first *entry)
+{
+    return entry->color_id != color_profile_id();
+}
+
+static struct predecode_first *cache_find(const char *name)
+{
+    for (int i = 0; i < PLAYER_CACHE_SIZE; i++) {
+        if (cache[i].name[0] != '\0' && strcmp(cache[i].name, name) == 0 &&
+            !cache_stale(&cache[i])) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Load the current slot and its neighbours, nearest first, reusing entries
+ * that are still in the window. Stops early for a new request */
+static void prefetch(void)
+{
+    char window[PLAYER_CACHE_SIZE][PLAYER_NAME_MAX];
+    int count = 0;
+
+    strcpy(window[count++], current);
+    for (int d = 1; d <= PLAYER_DEPTH; d++) {
+        if (slot_step(current, d, window[count])) {
+            count++;
+        }
+        if (slot_step(current, -d, window[count])) {
+            count++;
+        }
+    }
+
+    for (int i = 0; i < count && !request_pending(); i++) {
+        if (cache_find(window[i])) {
+            continue;
+        }
+
+        /* Evict an entry outside the window */
+        struct predecode_first *victim = NULL;
+        for (int e = 0; e < PLAYER_CACHE_SIZE && !victim; e++) {
+            bool in_window = false;
+            for (int w = 0; w < count; w++) {
+                in_window |= strcmp(cache[e].name, window[w]) == 0;
+            }
+            if (!in_window || cache_stale(&cache[e])) {
+                victim = &cache[e];
+            }
+        }
+        if (!victim) {
+            break;
+        }
+
+        int ret = predecode_load_first(window[i], victim, PLAYER_OPEN_TIMEOUT);
+        if (ret < 0) {
+            victim->name[0] = '\0';
+            LOG_WRN("%s: prefetch failed (%d)", window[i], ret);
+        }
+    }
+}
+
+/* Wait up to MS; false if a request came in first. A wake-up left over
+ * from a request that was already handled doesn't count */
+static bool wait_quiet(int64_t ms)
+{
+    int64_t end = k_uptime_get() + ms;
+
+    while (!request_pending()) {
+        int64_t left = end - k_uptime_get();
+
+        if (left <= 0 || k_sem_take(&player_wake, K_MSEC(left)) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void close_held(void)
+{
+    if (held_open) {
+        media_pipeline_close(&pipeline);
+        media_source_close(&source);
+        held_open = false;
+    }
+}
+
+static int play_current(const struct predecode_first *first)
+{
+    int ret = media_source_file_open(&source, current);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = media_pipeline_open(&pipeline, &source, &panel, PLAYER_OPEN_TIMEOUT);
+    if (ret < 0) {
+        media_source_close(&source);
+        return ret;
+    }
+
+    /* A request made while opening found no pipeline to stop */
+    if (request_pending()) {
+        media_pipeline_stop(&pipeline);
+    }
+
+    uint16_t start = (first && predecode_resume_first(first) == 0) ? 1 : 0;
+
+    ret = media_pipeline_play_from(&pipeline, start, 0);
+
+    /* Cut short by a switch with the decoder canvas matching the panel:
+     * keep it for the transition out */
+    if (ret == 0 && pipeline.stop && !req.paused &&
+        (start == 1 || pipeline.stats[MEDIA_STAGE_DECODE].count > 0)) {
+        held_open = true;
+        return 0;
+    }
+
+    media_pipeline_close(&pipeline);
+    media_source_close(&source);
+    return ret;
+}
+
+/* Put FIRST on the panel, through a transition from what is there now
+ * where possible. Closes the playback held open for it either way */
+static int show_first(const struct predecode_first *first)
+{
+    const struct predecode_first *from = held_open ? NULL : cache_find(on_panel);
+    int ret = -ENOENT;
+
+    if (held_open || from) {
+        ret = transition_run(from, first);
+    }
+    close_held();
+
+    if (ret == -ECANCELED && request_pending()) {
+        return ret;
+    }
+    return ret < 0 ? predecode_show_first(first) : 0;
+}
+
+static void play_slot(int64_t requested_ms)
+{
+    struct predecode_first *first = cache_find(current);
+    int ret = first ? show_first(first) : -ENOENT;
+
+    close_held();
+    on_panel[0] = '\0';
+
+    /* Superseded mid-transition; the next switch cuts */
+    if (ret == -ECANCELED) {
+        return;
+    }
+
+    if (ret < 0) {
+        first = NULL;
+        ret = display_show_image(current);
+        if (ret < 0) {
+            return;
+        }
+    }
+
+    int64_t shown = k_uptime_get();
+
+    OPENDOTT_TRACE("slot_shown", first != NULL, (uint32_t)(shown - requested_ms));
+    LOG_INF("%s up %lld ms after request%s", current, shown - requested_ms,
+            first ? " (prefetched)" : "");
+
+    prefetch();
+
+    /* Resuming from the cache needs its entry; without one, start over */
+    first = cache_find(current);
+    strcpy(on_panel, current);
+
+    if (first && first->frame_count <= 1) {
+        return;
+    }
+
+    /* Frame 0 stays up for its own delay */
+    int64_t remaining = first ? shown + first->delay_ms - k_uptime_get() : 0;
+    if (remaining > 0 && !wait_quiet(remaining)) {
+        return;
+    }
+
+    on_panel[0] = '\0';
+    ret = play_current(first);
+    if (ret < 0) {
+        LOG_ERR("%s: playback failed (%d)", current, ret);
+    }
+}
+
+static void player_thread(void *p1, void *p2, void *p3)
+{
+    int64_t requested_ms;
+
+    media_sink_panel_init(&panel);
+
+    while (1) {
+        k_sem_take(&player_wake, K_FOREVER);
+        power_still(false);
+
+        k_mutex_lock(&pass_lock, K_FOREVER);
+        while (take_request(&requested_ms)) {
+            play_slot(requested_ms);
+        }
+        close_held();
+        k_mutex_unlock(&pass_lock);
+
+        /* The decoder is closed and the panel stays as it is */
+        power_still(true);
+    }
+}
+
+K_THREAD_DEFINE(player_tid, PLAYER_STACK_SIZE, player_thread, NULL, NULL, NULL,
+                PLAYER_PRIORITY, 0, 0);
+
+/* Play slot NAME (NULL: the current one, or the first), resuming if paused */
+int player_play(const char *name)
+{
+    if (name && strlen(name) >= PLAYER_NAME_MAX) {
+        return -ENAMETOOLONG;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&req_lock);
+    req.paused = false;
+    k_spin_unlock(&req_lock, key);
+
+    request(name ? name : current, 0);
+    return 0;
+}
+
+/* Move STEP slots forward (negative: back) */
+void player_step(int step)
+{
+    request(NULL, step);
+}
+
+/* Stop playback and keep the player off storage until player_play(), e.g.
+ * while an upload replaces the file being played */
+void player_pause(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&req_lock);
+    req.paused = true;
+    k_spin_unlock(&req_lock, key);
+
+    /* The transition first: stopping playback can start one */
+    transition_stop();
+    media_pipeline_stop(&pipeline);
+    k_sem_give(&player_wake);
+
+    /* Wait for the pass in progress to end */
+    k_mutex_lock(&pass_lock, K_FOREVER);
+    k_mutex_unlock(&pass_lock);
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_player_play(const struct shell *sh, size_t argc, char **argv)
+{
+    return player_play(argc > 1 ? argv[1] : NULL);
+}
+
+static int cmd_player_next(const struct shell *sh, size_t argc, char **argv)
+{
+    player_step(1);
+    return 0;
+}
+
+static int cmd_player_prev(const struct shell *sh, size_t argc, char **argv)
+{
+    player_step(-1);
+    return 0;
+}
+
+static int cmd_player_pause(const struct shell *sh, size_t argc, char **argv)
+{
+    player_pause();
+    return 0;
+}
+
+static int cmd_player_status(const struct shell *sh, size_t argc, char **argv)
+{
+    shell_print(sh, "Playing: %s%s", current[0] ? current : "-",
+                req.paused ? " (paused)" : "");
+
+    for (int i = 0; i < PLAYER_CACHE_SIZE; i++) {
+        if (cache[i].name[0] != '\0') {
+            shell_print(sh, "  cached %s: %u frames, frame 0 %u ms", cache[i].name,
+                        cache[i].frame_count, cache[i].delay_ms);
+        }
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(player_cmds,
+    SHELL_CMD_ARG(play, NULL, "Play a slot: play [name]", cmd_player_play, 1, 1),
+    SHELL_CMD(next, NULL, "Switch to the next slot", cmd_player_next),
+    SHELL_CMD(prev, NULL, "Switch to the previous slot", cmd_player_prev),
+    SHELL_CMD(pause, NULL, "Stop playback", cmd_player_pause),
+    SHELL_CMD(status, NULL, "Show the playing slot and the prefetch cache", cmd_player_status),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(player, &player_cmds, "Slot player", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,180 @@
+/*
+ * OpenDOTT - Still-Image Power Down
+ * SPDX-License-Identifier: MIT
+ *
+ * Once nothing animates, nothing needs to run: the GC9A01 refreshes the
+ * panel from its own frame memory. While the player has a still on screen
+ * (power_still()), the panel SPI controller is suspended and the QSPI
+ * flash put into deep power-down. With both released the HF clock is no
+ * longer requested, and the CPU sleeps in the idle thread until a button
+ * press, BLE or a timer needs it.
+ *
+ * Code that uses the panel bus or the flash brackets it with power_get()
+ * and power_put(): display.c around each SPI write, storage.c around
+ * LittleFS block I/O and storage_lock() (which also covers XIP reads of
+ * the asset pack). A use wakes both devices; they go back down
+ * POWER_RESLEEP_MS after the last one for as long as the still is up, so
+ * an idle job or a BLE listing costs a short wake, not the rest of the
+ * day. While something plays, power_get() is two atomic operations.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/logging/log.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(power, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define POWER_RESLEEP_MS        2000
+
+#if defined(CONFIG_PM_DEVICE) && defined(CONFIG_NORDIC_QSPI_NOR)
+#define POWER_FLASH
+static const struct device *const flash_dev = DEVICE_DT_GET(DT_NODELABEL(gd25q128));
+#endif
+
+static K_MUTEX_DEFINE(power_lock);  /* Serializes suspend and resume */
+static atomic_t users;              /* power_get() calls not yet put */
+static atomic_t asleep;
+static bool still;
+
+static struct {
+    uint32_t sleeps;
+    int64_t since;                  /* When the devices last went down */
+    int64_t asleep_ms;              /* Total, not counting the current sleep */
+} stats;
+
+static void sleep_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(sleep_work, sleep_handler);
+
+/* Caller holds power_lock */
+static void devices_suspend(void)
+{
+#ifdef CONFIG_PM_DEVICE
+    int ret = display_bus_suspend(true);
+    if (ret < 0) {
+        LOG_WRN("Panel SPI suspend failed: %d", ret);
+    }
+#endif
+
+#ifdef POWER_FLASH
+    /* XIP keeps the QSPI peripheral running. The asset pack is only read
+     * under storage_lock(), which holds a use, so nobody reads it now */
+    assets_xip_enable(false);
+
+    ret = pm_device_action_run(flash_dev, PM_DEVICE_ACTION_SUSPEND);
+    if (ret < 0 && ret != -EALREADY) {
+        LOG_WRN("QSPI flash power-down failed: %d", ret);
+        assets_xip_enable(true);
+    }
+#endif
+
+    stats.sleeps++;
+    stats.since = k_uptime_get();
+}
+
+/* Caller holds power_lock */
+static void devices_resume(void)
+{
+#ifdef POWER_FLASH
+    int ret = pm_device_action_run(flash_dev, PM_DEVICE_ACTION_RESUME);
+    if (ret < 0 && ret != -EALREADY) {
+        LOG_ERR("QSPI flash wake-up failed: %d", ret);
+    }
+    assets_xip_enable(true);
+#endif
+
+#ifdef CONFIG_PM_DEVICE
+    display_bus_suspend(false);
+#endif
+
+    stats.asleep_ms += k_uptime_get() - stats.since;
+}
+
+static void sleep_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&power_lock, K_FOREVER);
+
+    /* Announce the sleep before looking for users: a power_get() racing
+     * with this either shows up in USERS, or sees ASLEEP and waits on the
+     * lock to wake the devices again */
+    if (still && !atomic_get(&asleep)) {
+        atomic_set(&asleep, 1);
+        if (atomic_get(&users) == 0) {
+            devices_suspend();
+        } else {
+            atomic_set(&asleep, 0);
+        }
+    }
+
+    k_mutex_unlock(&power_lock);
+}
+
+/* The panel bus and the flash are about to be used */
+void power_get(void)
+{
+    atomic_inc(&users);
+
+    if (atomic_get(&asleep)) {
+        k_mutex_lock(&power_lock, K_FOREVER);
+        if (atomic_get(&asleep)) {
+            devices_resume();
+            atomic_set(&asleep, 0);
+        }
+        k_mutex_unlock(&power_lock);
+    }
+}
+
+void power_put(void)
+{
+    if (atomic_dec(&users) == 1 && still) {
+        k_work_reschedule(&sleep_work, K_MSEC(POWER_RESLEEP_MS));
+    }
+}
+
+/* STILL: what is on the panel stays as it is until the next call, so the
+ * devices can go down. Otherwise keep them up, e.g. while playing */
+void power_still(bool on)
+{
+    still = on;
+
+    if (on) {
+        k_work_reschedule(&sleep_work, K_NO_WAIT);
+        return;
+    }
+
+    k_work_cancel_delayable(&sleep_work);
+    power_get();
+    power_put();
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_power_status(const struct shell *sh, size_t argc, char **argv)
+{
+    k_mutex_lock(&power_lock, K_FOREVER);
+
+    bool down = atomic_get(&asleep);
+    int64_t total = stats.asleep_ms + (down ? k_uptime_get() - stats.since : 0);
+
+    k_mutex_unlock(&power_lock);
+
+    shell_print(sh, "%s, devices %s; %u sleeps, %lld of %lld ms asleep",
+                still ? "Still" : "Playing", down ? "down" : "up", stats.sleeps,
+                total, k_uptime_get());
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(power_cmds,
+    SHELL_CMD(status, NULL, "Show the still-image power state", cmd_power_status),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(power, &power_cmds, "Still-image power down", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,619 @@
+/*
+ * OpenDOTT - Idle-Time Pre-Decode
+ * SPDX-License-Identifier: MIT
+ *
+ * After an upload, does the expensive part of playback ahead of time on the
+ * idle work queue: the GIF is indexed and its palette converted (see
+ * gif_decoder.c), then the first PREDECODE_FRAME_COUNT frames are decoded
+ * into /.meta/NAME.f<N>. Each cached frame is the composited 240x240 index
+ * canvas plus its RGB565 LUT, so showing it is a straight strip-wise LUT
+ * pass to the panel. The LUT's dither residuals are kept too, for decoding
+ * on from the cached frame; the cached frame itself is drawn undithered.
+ * Finally a boot snapshot records the file, so the next boot can put frame
+ * 0 on screen without touching the decoder. Writing a frame 0 cache, here
+ * or for the player, also writes the preview thumbnail (thumbnail.c). A
+ * thumbnail-only run for a file that is merely being browsed builds it from
+ * an existing frame 0 cache if there is one, else decodes only frame 0, and
+ * leaves the boot snapshot alone.
+ *
+ * Playback has priority: a step that needs the decoder while the player
+ * holds it waits for a later turn.
+ *
+ * Every step decodes at most one frame. When a step is preempted, the next
+ * one continues from the previous cached frame instead of starting over.
+ *
+ * The player (player.c) uses the same frame 0 caches to switch slots
+ * without decoding: predecode_load_first() creates one on demand.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(predecode, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define PREDECODE_FRAME_COUNT    CONFIG_OPENDOTT_PREDECODE_FRAMES
+#define PREDECODE_START_DELAY    K_SECONDS(1)
+#define PREDECODE_STEP_INTERVAL  K_MSEC(50)
+#define PREDECODE_BACKOFF        K_SECONDS(5)
+#define PREDECODE_STRIP_LINES    MEDIA_STRIP_LINES
+
+#define FRAME_CACHE_MAGIC        0x4D52464F  /* 'OFRM' */
+#define BOOT_SNAPSHOT_MAGIC      0x4E53424F  /* 'OBSN' */
+#define PREDECODE_VERSION        3
+
+/* Not a valid media name, so no upload can shadow it */
+#define BOOT_SNAPSHOT_NAME       ".boot"
+#define BOOT_SNAPSHOT_EXT        "snap"
+
+#define FRAME_CACHE_LUT_OFFSET   sizeof(struct frame_cache_header)
+#define FRAME_CACHE_RES_OFFSET \
+    (FRAME_CACHE_LUT_OFFSET + GIF_PALETTE_SIZE * sizeof(uint16_t))
+#define FRAME_CACHE_PIXEL_OFFSET (FRAME_CACHE_RES_OFFSET + GIF_PALETTE_SIZE)
+
+struct frame_cache_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t index;
+    uint16_t delay_ms;
+    uint16_t frame_count;
+    uint16_t color_id;          /* Color profile of the LUT */
+} __packed;
+
+struct boot_snapshot {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved[3];
+    char name[32];
+} __packed;
+
+enum predecode_state {
+    PREDECODE_STATE_IDLE = 0,
+    PREDECODE_STATE_INDEX,
+    PREDECODE_STATE_FRAMES,
+    PREDECODE_STATE_SNAPSHOT,
+};
+
+static struct k_work_delayable predecode_work;
+static bool predecode_ready = false;
+
+/* Shared with schedule(), which runs on other threads. A step works on a
+ * copy taken under pd_lock and only stores its progress back if no new
+ * schedule() bumped pd_generation meanwhile */
+static K_MUTEX_DEFINE(pd_lock);
+static uint32_t pd_generation;
+static enum predecode_state state;
+static char pd_name[32];
+static uint16_t pd_frame;
+static uint16_t pd_frame_count;
+static bool pd_thumbnail_only;
+
+/* LUT of a cached frame, and boot snapshot strips read one at a time */
+static uint16_t cache_lut[GIF_PALETTE_SIZE];
+static uint8_t cache_res[GIF_PALETTE_SIZE];
+static uint8_t snap_strip[DISPLAY_WIDTH * PREDECODE_STRIP_LINES];
+
+/* Canvas line of a frame cache, for thumbnails built on the work queue */
+static uint8_t thumb_line[DISPLAY_WIDTH];
+
+static void frame_ext(uint16_t index, char *ext, size_t len)
+{
+    snprintf(ext, len, "f%u", index);
+}
+
+static const uint8_t *canvas_line(void *user, uint16_t y)
+{
+    return (const uint8_t *)user + (size_t)y * DISPLAY_WIDTH;
+}
+
+static const uint8_t *cache_line(void *user, uint16_t y)
+{
+    int ret = storage_file_read(user, FRAME_CACHE_PIXEL_OFFSET + (size_t)y * DISPLAY_WIDTH,
+                                thumb_line, sizeof(thumb_line));
+    return ret == sizeof(thumb_line) ? thumb_line : NULL;
+}
+
+static int cache_write(const char *name, uint16_t index)
+{
+    struct gif_frame_info frame;
+    struct fs_file_t file;
+    char ext[8];
+
+    int ret = gif_decoder_frame_info(index, &frame);
+    if (ret < 0) {
+        return ret;
+    }
+
+    struct frame_cache_header hdr = {
+        .magic = FRAME_CACHE_MAGIC,
+        .version = PREDECODE_VERSION,
+        .index = index,
+        .delay_ms = frame.delay_ms,
+        .frame_count = gif_decoder_info()->frame_count,
+        .color_id = color_profile_id(),
+    };
+
+    frame_ext(index, ext, sizeof(ext));
+    ret = storage_meta_open(name, ext, true, &file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Header last, so a cut-short write never looks valid */
+    ret = storage_file_write(&file, FRAME_CACHE_LUT_OFFSET, gif_decoder_lut(),
+                             GIF_PALETTE_SIZE * sizeof(uint16_t));
+    if (ret >= 0) {
+        ret = storage_file_write(&file, FRAME_CACHE_RES_OFFSET, gif_decoder_residuals(),
+                                 GIF_PALETTE_SIZE);
+    }
+    if (ret >= 0) {
+        ret = storage_file_write(&file, FRAME_CACHE_PIXEL_OFFSET, gif_decoder_canvas(),
+                                 DISPLAY_WIDTH * DISPLAY_HEIGHT);
+    }
+    if (ret >= 0) {
+        ret = storage_file_write(&file, 0, &hdr, sizeof(hdr));
+    }
+
+    storage_file_close(&file);
+
+    if (ret < 0) {
+        storage_meta_delete(name, ext);
+        return ret;
+    }
+
+    if (index == 0) {
+        ret = thumbnail_generate(name, canvas_line, gif_decoder_canvas(), gif_decoder_lut());
+        if (ret < 0) {
+            LOG_WRN("%s: thumbnail failed (%d)", name, ret);
+        }
+    }
+    return 0;
+}
+
+static int cache_open(const char *name, uint16_t index, struct fs_file_t *file,
+                      struct frame_cache_header *hdr)
+{
+    char ext[8];
+
+    frame_ext(index, ext, sizeof(ext));
+    int ret = storage_meta_open(name, ext, false, file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_read(file, 0, hdr, sizeof(*hdr));
+    if (ret != sizeof(*hdr) || hdr->magic != FRAME_CACHE_MAGIC ||
+        hdr->version != PREDECODE_VERSION || hdr->index != index ||
+        hdr->color_id != color_profile_id()) {
+        storage_file_close(file);
+        return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    return 0;
+}
+
+static int predecode_frame(const char *name, uint16_t index)
+{
+    if (index > 0 && gif_decoder_position() != index) {
+        struct frame_cache_header hdr;
+        struct fs_file_t file;
+
+        /* Continue from the cached previous frame; if that fails,
+         * gif_decoder_decode() simply starts over from frame 0 */
+        if (cache_open(name, index - 1, &file, &hdr) == 0) {
+            int ret = storage_file_read(&file, FRAME_CACHE_LUT_OFFSET, cache_lut,
+                                        sizeof(cache_lut));
+            if (ret == sizeof(cache_lut)) {
+                ret = storage_file_read(&file, FRAME_CACHE_RES_OFFSET, cache_res,
+                                        sizeof(cache_res));
+            }
+            if (ret == sizeof(cache_res)) {
+                ret = storage_file_read(&file, FRAME_CACHE_PIXEL_OFFSET, gif_decoder_canvas(),
+                                        DISPLAY_WIDTH * DISPLAY_HEIGHT);
+            }
+            storage_file_close(&file);
+            if (ret == DISPLAY_WIDTH * DISPLAY_HEIGHT) {
+                gif_decoder_resume(index, cache_lut, cache_res);
+            }
+        }
+    }
+
+    int ret = gif_decoder_decode(index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return cache_write(name, index);
+}
+
+/* Thumbnail from a valid frame 0 cache, without the decoder */
+static int thumbnail_from_cache(const char *name)
+{
+    struct frame_cache_header hdr;
+    struct fs_file_t file;
+
+    int ret = cache_open(name, 0, &file, &hdr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_read(&file, FRAME_CACHE_LUT_OFFSET, cache_lut, sizeof(cache_lut));
+    if (ret == sizeof(cache_lut)) {
+        ret = thumbnail_generate(name, cache_line, &file, cache_lut);
+    } else {
+        ret = ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    storage_file_close(&file);
+    return ret;
+}
+
+static int snapshot_write(const char *name)
+{
+    struct boot_snapshot snap = {
+        .magic = BOOT_SNAPSHOT_MAGIC,
+        .version = PREDECODE_VERSION,
+    };
+    struct fs_file_t file;
+
+    strncpy(snap.name, name, sizeof(snap.name) - 1);
+
+    int ret = storage_meta_open(BOOT_SNAPSHOT_NAME, BOOT_SNAPSHOT_EXT, true, &file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_write(&file, 0, &snap, sizeof(snap));
+    storage_file_close(&file);
+    return ret < 0 ? ret : 0;
+}
+
+static void predecode_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    char name[sizeof(pd_name)];
+    enum predecode_state st;
+    uint16_t frame, frame_count;
+    bool thumbnail_only;
+    uint32_t generation;
+
+    k_mutex_lock(&pd_lock, K_FOREVER);
+    st = state;
+    strcpy(name, pd_name);
+    frame = pd_frame;
+    frame_count = pd_frame_count;
+    thumbnail_only = pd_thumbnail_only;
+    generation = pd_generation;
+    k_mutex_unlock(&pd_lock);
+
+    if (st == PREDECODE_STATE_IDLE) {
+        return;
+    }
+
+    if (!idle_is_idle()) {
+        idle_submit(&predecode_work, PREDECODE_BACKOFF);
+        return;
+    }
+
+    int ret;
+
+    if (st == PREDECODE_STATE_SNAPSHOT) {
+        /* Only needs the frame 0 cache */
+        ret = snapshot_write(name);
+        if (ret == 0) {
+            LOG_INF("%s: %u frames pre-decoded", name, frame_count);
+            st = PREDECODE_STATE_IDLE;
+        }
+    } else if (st == PREDECODE_STATE_INDEX && thumbnail_only &&
+               thumbnail_from_cache(name) == 0) {
+        /* Frame 0 is cached already, e.g. by the player */
+        ret = 0;
+        st = PREDECODE_STATE_IDLE;
+    } else {
+        /* Playback owns the decoder: try again later */
+        ret = gif_decoder_open(name, K_NO_WAIT);
+        if (ret == -EBUSY) {
+            idle_submit(&predecode_work, PREDECODE_BACKOFF);
+            return;
+        }
+
+        if (ret == 0) {
+            if (st == PREDECODE_STATE_INDEX) {
+                /* Opening built (or validated) the index */
+                frame = 0;
+                frame_count = MIN(thumbnail_only ? 1 : PREDECODE_FRAME_COUNT,
+                                  gif_decoder_info()->frame_count);
+                st = PREDECODE_STATE_FRAMES;
+            } else {
+                ret = predecode_frame(name, frame);
+                if (ret == 0 && ++frame >= frame_count) {
+                    st = thumbnail_only ? PREDECODE_STATE_IDLE : PREDECODE_STATE_SNAPSHOT;
+                }
+            }
+
+            gif_decoder_close();
+        }
+    }
+
+    if (ret < 0) {
+        LOG_ERR("%s: pre-decode failed (%d)", name, ret);
+        st = PREDECODE_STATE_IDLE;
+    }
+
+    k_mutex_lock(&pd_lock, K_FOREVER);
+    if (generation == pd_generation) {
+        state = st;
+        pd_frame = frame;
+        pd_frame_count = frame_count;
+    }
+    /* Rescheduled meanwhile: the new run was already submitted */
+    if (generation == pd_generation && state != PREDECODE_STATE_IDLE) {
+        idle_submit(&predecode_work, PREDECODE_STEP_INTERVAL);
+    }
+    k_mutex_unlock(&pd_lock);
+}
+
+int predecode_init(void)
+{
+    k_work_init_delayable(&predecode_work, predecode_work_handler);
+    predecode_ready = true;
+    return 0;
+}
+
+static int schedule(const char *name, bool thumbnail_only)
+{
+    if (!predecode_ready) {
+        return -ENODEV;
+    }
+
+    if (strlen(name) >= sizeof(pd_name)) {
+        return -ENAMETOOLONG;
+    }
+
+    k_mutex_lock(&pd_lock, K_FOREVER);
+
+    /* Browsing never displaces the pre-decode of an upload */
+    if (thumbnail_only && state != PREDECODE_STATE_IDLE) {
+        k_mutex_unlock(&pd_lock);
+        return -EBUSY;
+    }
+
+    /* A new upload restarts from scratch; save already dropped old caches */
+    strcpy(pd_name, name);
+    pd_thumbnail_only = thumbnail_only;
+    state = PREDECODE_STATE_INDEX;
+    pd_generation++;
+
+    int ret = idle_submit(&predecode_work, PREDECODE_START_DELAY);
+    k_mutex_unlock(&pd_lock);
+    return ret;
+}
+
+/* Index NAME, cache its first frames and make it the boot snapshot */
+int predecode_schedule(const char *name)
+{
+    return schedule(name, false);
+}
+
+/* Only index NAME and decode frame 0, for its thumbnail and frame cache */
+int predecode_schedule_thumbnail(const char *name)
+{
+    return schedule(name, true);
+}
+
+/* Stream the index canvas of an open frame cache to the panel through LUT */
+static int cache_draw(struct fs_file_t *file, const uint16_t *lut)
+{
+    for (uint16_t y = 0; y < DISPLAY_HEIGHT; y += PREDECODE_STRIP_LINES) {
+        uint16_t lines = MIN(PREDECODE_STRIP_LINES, DISPLAY_HEIGHT - y);
+        size_t len = (size_t)lines * DISPLAY_WIDTH;
+
+        int ret = storage_file_read(file, FRAME_CACHE_PIXEL_OFFSET + (size_t)y * DISPLAY_WIDTH,
+                                    snap_strip, len);
+        if (ret != len) {
+            return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+        }
+
+        ret = display_draw_indexed(y, lines, snap_strip, lut);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/* Draw frame 0 of the last pre-decoded upload, if its cache is still valid */
+int predecode_show_boot_snapshot(void)
+{
+    struct boot_snapshot snap;
+    struct frame_cache_header hdr;
+    struct fs_file_t file;
+    int ret;
+
+    ret = storage_meta_read(BOOT_SNAPSHOT_NAME, BOOT_SNAPSHOT_EXT, 0, &snap, sizeof(snap));
+    if (ret != sizeof(snap) || snap.magic != BOOT_SNAPSHOT_MAGIC ||
+        snap.version != PREDECODE_VERSION) {
+        return -ENOENT;
+    }
+    snap.name[sizeof(snap.name) - 1] = '\0';
+
+    ret = cache_open(snap.name, 0, &file, &hdr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_read(&file, FRAME_CACHE_LUT_OFFSET, cache_lut, sizeof(cache_lut));
+    if (ret != sizeof(cache_lut)) {
+        ret = ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+        goto out;
+    }
+
+    ret = cache_draw(&file, cache_lut);
+    if (ret == 0) {
+        LOG_INF("Boot snapshot: %s", snap.name);
+    }
+
+out:
+    storage_file_close(&file);
+    return ret;
+}
+
+/* Fill FIRST from the frame 0 cache of NAME, decoding and caching frame 0
+ * first if there is no valid cache yet */
+int predecode_load_first(const char *name, struct predecode_first *first, k_timeout_t timeout)
+{
+    struct frame_cache_header hdr;
+    struct fs_file_t file;
+
+    if (strlen(name) >= sizeof(first->name)) {
+        return -ENAMETOOLONG;
+    }
+
+    int ret = cache_open(name, 0, &file, &hdr);
+    if (ret < 0) {
+        ret = gif_decoder_open(name, timeout);
+        if (ret < 0) {
+            return ret;
+        }
+
+        ret = gif_decoder_decode(0);
+        if (ret == 0) {
+            ret = cache_write(name, 0);
+        }
+        gif_decoder_close();
+
+        if (ret == 0) {
+            ret = cache_open(name, 0, &file, &hdr);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    ret = storage_file_read(&file, FRAME_CACHE_LUT_OFFSET, first->lut, sizeof(first->lut));
+    storage_file_close(&file);
+    if (ret != sizeof(first->lut)) {
+        return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    strcpy(first->name, name);
+    first->delay_ms = hdr.delay_ms;
+    first->frame_count = hdr.frame_count;
+    first->color_id = hdr.color_id;
+    return 0;
+}
+
+/* Draw a frame loaded by predecode_load_first() (one caller at a time) */
+int predecode_show_first(const struct predecode_first *first)
+{
+    struct frame_cache_header hdr;
+    struct fs_file_t file;
+
+    int ret = cache_open(first->name, 0, &file, &hdr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cache_draw(&file, first->lut);
+    storage_file_close(&file);
+    return ret;
+}
+
+/* Open the frame 0 cache of FIRST as a media source, for reading its index
+ * canvas a strip at a time; the canvas starts at *PIXELS */
+int predecode_first_source(const struct predecode_first *first, struct media_source *src,
+                           size_t *pixels)
+{
+    struct frame_cache_header hdr;
+    char ext[8];
+
+    frame_ext(0, ext, sizeof(ext));
+    int ret = media_source_meta_open(src, first->name, ext);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = media_source_read(src, 0, &hdr, sizeof(hdr));
+    if (ret != sizeof(hdr) || hdr.magic != FRAME_CACHE_MAGIC ||
+        hdr.version != PREDECODE_VERSION || hdr.index != 0 ||
+        hdr.color_id != first->color_id ||
+        src->size < FRAME_CACHE_PIXEL_OFFSET + DISPLAY_WIDTH * DISPLAY_HEIGHT) {
+        media_source_close(src);
+        return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    *pixels = FRAME_CACHE_PIXEL_OFFSET;
+    return 0;
+}
+
+/* Restore the open decoder to just after frame 0 of FIRST, so playback
+ * continues from frame 1 */
+int predecode_resume_first(const struct predecode_first *first)
+{
+    struct frame_cache_header hdr;
+    struct fs_file_t file;
+
+    int ret = cache_open(first->name, 0, &file, &hdr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_read(&file, FRAME_CACHE_RES_OFFSET, cache_res, sizeof(cache_res));
+    if (ret == sizeof(cache_res)) {
+        ret = storage_file_read(&file, FRAME_CACHE_PIXEL_OFFSET, gif_decoder_canvas(),
+                                DISPLAY_WIDTH * DISPLAY_HEIGHT);
+    }
+    storage_file_close(&file);
+    if (ret != DISPLAY_WIDTH * DISPLAY_HEIGHT) {
+        return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    return gif_decoder_resume(1, first->lut, cache_res);
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_predecode_run(const struct shell *sh, size_t argc, char **argv)
+{
+    int ret = predecode_schedule(argv[1]);
+
+    if (ret < 0) {
+        shell_error(sh, "Failed to schedule pre-decode: %d", ret);
+        return ret;
+    }
+
+    shell_print(sh, "Pre-decode of %s scheduled (runs while idle)", argv[1]);
+    return 0;
+}
+
+static int cmd_predecode_status(const struct shell *sh, size_t argc, char **argv)
+{
+    k_mutex_lock(&pd_lock, K_FOREVER);
+    if (state == PREDECODE_STATE_IDLE) {
+        shell_print(sh, "idle");
+    } else {
+        shell_print(sh, "%s: state %d, frame %u/%u", pd_name, state, pd_frame,
+                    pd_frame_count);
+    }
+    k_mutex_unlock(&pd_lock);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(predecode_cmds,
+    SHELL_CMD_ARG(run, NULL, "Pre-decode a stored GIF: run <name>", cmd_predecode_run, 2, 0),
+    SHELL_CMD(status, NULL, "Show pre-decode progress", cmd_predecode_status),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(predecode, &predecode_cmds, "Idle-time GIF pre-decoding", NULL);
+#endif /* CONFIG_SHELL */
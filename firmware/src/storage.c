@@ -11,6 +11,8 @@
 #include <string.h>
 #include <zephyr/fs/littlefs.h>
 #include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 
 #include "opendott.h"
@@ -21,19 +23,774 @@ LOG_MODULE_REGISTER(storage, CONFIG_LOG_DEFAULT_LEVEL);
 #define STORAGE_MOUNT_POINT "/lfs"
 #define STORAGE_PARTITION lfs_partition
 #define STORAGE_PARTITION_ID FIXED_PARTITION_ID(STORAGE_PARTITION)
+#define STORAGE_PATH_MAX 64     /* Mount point, .meta/, file name and extension */
 
 /* LittleFS configuration */
 FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(storage_lfs);
 
+/* Formatting is up to storage_init(), after the layout check */
 static struct fs_mount_t storage_mount_cfg = {
     .type = FS_LITTLEFS,
     .fs_data = &storage_lfs,
     .storage_dev = (void *)STORAGE_PARTITION_ID,
     .mnt_point = STORAGE_MOUNT_POINT,
+    .flags = FS_MOUNT_FLAG_NO_FORMAT,
 };
 
 static bool storage_mounted = false;
 
+/*
+ * Held across anything that may program or erase the QSPI flash. While the
+ * chip is busy erasing, XIP reads return garbage, so XIP readers (the asset
+ * pack) take the same lock before touching memory-mapped flash. Holding it
+ * also keeps the flash out of deep power-down (power.c).
+ */
+static K_MUTEX_DEFINE(storage_flash_lock);
+
+void storage_lock(void)
+{
+    k_mutex_lock(&storage_flash_lock, K_FOREVER);
+    power_get();
+}
+
+void storage_unlock(void)
+{
+    power_put();
+    k_mutex_unlock(&storage_flash_lock);
+}
+
+/*
+ * Blocks erased ahead of time by the idle compaction job. LittleFS always
+ * erases a block before programming it; our erase hook skips the physical
+ * erase for blocks already known to be blank, which moves erase latency off
+ * the upload path. The map lives in RAM only, so after a power loss LittleFS
+ * simply erases as usual.
+ */
+#define STORAGE_BLOCK_SIZE   4096
+#define STORAGE_MAX_BLOCKS   (FIXED_PARTITION_SIZE(STORAGE_PARTITION) / STORAGE_BLOCK_SIZE)
+
+static uint8_t pre_erased[STORAGE_MAX_BLOCKS / 8];
+static bool pre_erase_enabled;          /* LittleFS geometry matches the map */
+
+/* Bumped by every operation that may allocate or free blocks, and by every
+ * program or erase that reaches the block device hooks below */
+static uint32_t storage_generation;
+
+/* Running average size of saved files in blocks; compaction only rewrites
+ * when no free extent is this large */
+static uint32_t upload_blocks = 16;
+
+static int (*lfs_read_orig)(const struct lfs_config *c, lfs_block_t block,
+                            lfs_off_t off, void *buffer, lfs_size_t size);
+static int (*lfs_prog_orig)(const struct lfs_config *c, lfs_block_t block,
+                            lfs_off_t off, const void *buffer, lfs_size_t size);
+static int (*lfs_erase_orig)(const struct lfs_config *c, lfs_block_t block);
+
+static bool pre_erased_test_and_clear(lfs_block_t block)
+{
+    if (!pre_erase_enabled || block >= STORAGE_MAX_BLOCKS) {
+        return false;
+    }
+
+    uint8_t mask = BIT(block % 8);
+    bool was_set = (pre_erased[block / 8] & mask) != 0;
+
+    pre_erased[block / 8] &= ~mask;
+    return was_set;
+}
+
+static int storage_lfs_read(const struct lfs_config *c, lfs_block_t block,
+                            lfs_off_t off, void *buffer, lfs_size_t size)
+{
+    OPENDOTT_TRACE("flash_read_start", block, size);
+    power_get();
+    uint32_t start = storage_trace_start();
+    int ret = lfs_read_orig(c, block, off, buffer, size);
+
+    storage_trace_record(STORAGE_OP_FLASH_READ, start, size);
+    power_put();
+    OPENDOTT_TRACE("flash_read_end", block, ret);
+    return ret;
+}
+
+static int storage_lfs_prog(const struct lfs_config *c, lfs_block_t block,
+                            lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+    pre_erased_test_and_clear(block);
+    storage_generation++;
+
+    power_get();
+    uint32_t start = storage_trace_start();
+    int ret = lfs_prog_orig(c, block, off, buffer, size);
+
+    storage_trace_record(STORAGE_OP_FLASH_PROG, start, size);
+    power_put();
+    return ret;
+}
+
+static int storage_lfs_erase(const struct lfs_config *c, lfs_block_t block)
+{
+    storage_generation++;
+
+    if (pre_erased_test_and_clear(block)) {
+        return 0;
+    }
+
+    power_get();
+    uint32_t start = storage_trace_start();
+    int ret = lfs_erase_orig(c, block);
+
+    storage_trace_record(STORAGE_OP_FLASH_ERASE, start, c->block_size);
+    power_put();
+    return ret;
+}
+
+/* Interpose on the block device ops Zephyr installed during fs_mount().
+ * Always: besides pre-erase they time flash I/O and wake the flash for it */
+static void storage_install_hooks(void)
+{
+    memset(pre_erased, 0, sizeof(pre_erased));
+
+    pre_erase_enabled = storage_lfs.cfg.block_size == STORAGE_BLOCK_SIZE &&
+                        storage_lfs.cfg.block_count <= STORAGE_MAX_BLOCKS;
+    if (!pre_erase_enabled) {
+        LOG_WRN("Unexpected LittleFS geometry, pre-erase disabled");
+    }
+
+    lfs_read_orig = storage_lfs.cfg.read;
+    lfs_prog_orig = storage_lfs.cfg.prog;
+    lfs_erase_orig = storage_lfs.cfg.erase;
+    storage_lfs.cfg.read = storage_lfs_read;
+    storage_lfs.cfg.prog = storage_lfs_prog;
+    storage_lfs.cfg.erase = storage_lfs_erase;
+}
+
+/* Traced wrappers around the fs calls; see storage_trace.c */
+static int traced_open(struct fs_file_t *file, const char *path, fs_mode_t flags)
+{
+    uint32_t start = storage_trace_start();
+    int ret = fs_open(file, path, flags);
+
+    storage_trace_record(STORAGE_OP_OPEN, start, 0);
+    return ret;
+}
+
+static ssize_t traced_read(struct fs_file_t *file, void *buf, size_t size)
+{
+    uint32_t start = storage_trace_start();
+    ssize_t ret = fs_read(file, buf, size);
+
+    storage_trace_record(STORAGE_OP_READ, start, ret > 0 ? ret : 0);
+    return ret;
+}
+
+static ssize_t traced_write(struct fs_file_t *file, const void *buf, size_t size)
+{
+    OPENDOTT_TRACE("storage_write_start", size, 0);
+    uint32_t start = storage_trace_start();
+    ssize_t ret = fs_write(file, buf, size);
+
+    storage_trace_record(STORAGE_OP_WRITE, start, ret > 0 ? ret : 0);
+    OPENDOTT_TRACE("storage_write_end", size, ret);
+    return ret;
+}
+
+static int traced_close(struct fs_file_t *file)
+{
+    uint32_t start = storage_trace_start();
+    int ret = fs_close(file);
+
+    storage_trace_record(STORAGE_OP_CLOSE, start, 0);
+    return ret;
+}
+
+static int traced_stat(const char *path, struct fs_dirent *entry)
+{
+    uint32_t start = storage_trace_start();
+    int ret = fs_stat(path, entry);
+
+    storage_trace_record(STORAGE_OP_STAT, start, 0);
+    return ret;
+}
+
+static void storage_compact_forget(const char *name);
+static void storage_compact_cleanup(void);
+
+/*
+ * Metadata cache
+ * ==============
+ *
+ * Remembers the size and content CRC of recently used files so a load of a
+ * known file needs only the fs_open() metadata walk, not a second fs_stat().
+ * Kept coherent by every storage.c function that writes, deletes or formats.
+ * (The LittleFS first-block pointer is private to Zephyr's littlefs glue and
+ * is not cached.)
+ */
+#define META_CACHE_SIZE      8
+#define META_NAME_MAX        32
+
+struct meta_cache_entry {
+    uint32_t name_hash;
+    char name[META_NAME_MAX];
+    size_t size;
+    uint32_t crc;
+    bool crc_valid;
+    uint16_t flags;
+    bool flags_valid;
+    uint32_t last_used;
+};
+
+static struct meta_cache_entry meta_cache[META_CACHE_SIZE];
+static uint32_t meta_clock;
+static K_MUTEX_DEFINE(meta_lock);
+
+/* FNV-1a, only used to make cache misses cheap */
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    while (*name) {
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    }
+
+    return h ? h : 1;  /* 0 marks a free entry */
+}
+
+static struct meta_cache_entry *meta_find(const char *name, uint32_t hash)
+{
+    for (int i = 0; i < META_CACHE_SIZE; i++) {
+        struct meta_cache_entry *e = &meta_cache[i];
+
+        if (e->name_hash == hash && strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+static void meta_update(const char *name, size_t size, const uint32_t *crc)
+{
+    uint32_t hash = name_hash(name);
+
+    if (strlen(name) >= META_NAME_MAX) {
+        return;
+    }
+
+    k_mutex_lock(&meta_lock, K_FOREVER);
+
+    struct meta_cache_entry *e = meta_find(name, hash);
+    if (!e) {
+        e = &meta_cache[0];
+        for (int i = 1; i < META_CACHE_SIZE; i++) {
+            if (meta_cache[i].last_used < e->last_used) {
+                e = &meta_cache[i];
+            }
+        }
+        e->name_hash = hash;
+        strcpy(e->name, name);
+        e->crc_valid = false;
+        e->flags_valid = false;
+    }
+
+    e->size = size;
+    if (crc) {
+        e->crc = *crc;
+        e->crc_valid = true;
+    }
+    e->last_used = ++meta_clock;
+
+    k_mutex_unlock(&meta_lock);
+}
+
+/* NULL drops every entry */
+static void meta_invalidate(const char *name)
+{
+    k_mutex_lock(&meta_lock, K_FOREVER);
+
+    if (!name) {
+        memset(meta_cache, 0, sizeof(meta_cache));
+    } else {
+        struct meta_cache_entry *e = meta_find(name, name_hash(name));
+        if (e) {
+            memset(e, 0, sizeof(*e));
+        }
+    }
+
+    k_mutex_unlock(&meta_lock);
+}
+
+static void meta_set_flags(const char *name, uint16_t flags)
+{
+    k_mutex_lock(&meta_lock, K_FOREVER);
+
+    struct meta_cache_entry *e = meta_find(name, name_hash(name));
+    if (e) {
+        e->flags = flags;
+        e->flags_valid = true;
+    }
+
+    k_mutex_unlock(&meta_lock);
+}
+
+static bool meta_get_flags(const char *name, uint16_t *flags)
+{
+    bool hit = false;
+
+    k_mutex_lock(&meta_lock, K_FOREVER);
+
+    struct meta_cache_entry *e = meta_find(name, name_hash(name));
+    if (e && e->flags_valid) {
+        *flags = e->flags;
+        hit = true;
+    }
+
+    k_mutex_unlock(&meta_lock);
+    return hit;
+}
+
+static bool meta_lookup(const char *name, size_t *size, uint32_t *crc)
+{
+    bool hit = false;
+
+    k_mutex_lock(&meta_lock, K_FOREVER);
+
+    struct meta_cache_entry *e = meta_find(name, name_hash(name));
+    if (e) {
+        e->last_used = ++meta_clock;
+        *size = e->size;
+        if (crc) {
+            *crc = e->crc_valid ? e->crc : 0;
+        }
+        hit = true;
+    }
+
+    k_mutex_unlock(&meta_lock);
+    return hit;
+}
+
+/*
+ * Per-extent CRC sidecars
+ * =======================
+ *
+ * Every saved file gets /lfs/.meta/NAME.crc holding a CRC32 per 4KB extent
+ * plus media flags. The scrubber (storage_scrub.c) verifies extents against
+ * it during idle time and flags corrupt files, which loads then refuse
+ * without handing the data to a decoder.
+ */
+#define STORAGE_META_DIR     STORAGE_MOUNT_POINT "/.meta"
+#define SIDECAR_MAGIC        0x4352434F  /* "OCRC" */
+#define SIDECAR_VERSION      1
+#define SIDECAR_BATCH        16
+
+struct sidecar_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t file_size;
+    uint32_t extent_size;
+    uint32_t extent_count;
+} __packed;
+
+static void sidecar_path(const char *name, char *path, size_t len)
+{
+    snprintf(path, len, "%s/%s.crc", STORAGE_META_DIR, name);
+}
+
+/* Caller holds storage_lock */
+static int sidecar_write(const char *name, const uint8_t *data, size_t size)
+{
+    char path[STORAGE_PATH_MAX];
+    struct fs_file_t file;
+    struct sidecar_header hdr = {
+        .magic = SIDECAR_MAGIC,
+        .version = SIDECAR_VERSION,
+        .flags = 0,
+        .file_size = size,
+        .extent_size = STORAGE_EXTENT_SIZE,
+        .extent_count = DIV_ROUND_UP(size, STORAGE_EXTENT_SIZE),
+    };
+
+    sidecar_path(name, path, sizeof(path));
+    fs_file_t_init(&file);
+
+    int ret = traced_open(&file, path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (traced_write(&file, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        ret = OPENDOTT_ERR_FLASH_WRITE;
+        goto out;
+    }
+
+    uint32_t crcs[SIDECAR_BATCH];
+    uint32_t n = 0;
+
+    for (size_t off = 0; off < size; off += STORAGE_EXTENT_SIZE) {
+        crcs[n++] = crc32_ieee(data + off, MIN(STORAGE_EXTENT_SIZE, size - off));
+
+        if (n == SIDECAR_BATCH || off + STORAGE_EXTENT_SIZE >= size) {
+            if (traced_write(&file, crcs, n * sizeof(uint32_t)) != n * sizeof(uint32_t)) {
+                ret = OPENDOTT_ERR_FLASH_WRITE;
+                goto out;
+            }
+            n = 0;
+        }
+    }
+
+out:
+    traced_close(&file);
+    if (ret < 0) {
+        fs_unlink(path);
+    }
+    return ret;
+}
+
+static int sidecar_read_header(const char *name, struct fs_file_t *file,
+                               struct sidecar_header *hdr, fs_mode_t mode)
+{
+    char path[STORAGE_PATH_MAX];
+
+    sidecar_path(name, path, sizeof(path));
+    fs_file_t_init(file);
+
+    int ret = traced_open(file, path, mode);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (traced_read(file, hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+        hdr->magic != SIDECAR_MAGIC || hdr->version != SIDECAR_VERSION) {
+        traced_close(file);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int storage_get_extent_crc(const char *name, uint32_t index, uint32_t *crc,
+                           uint32_t *count)
+{
+    struct fs_file_t file;
+    struct sidecar_header hdr;
+
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    int ret = sidecar_read_header(name, &file, &hdr, FS_O_READ);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (count) {
+        *count = hdr.extent_count;
+    }
+
+    if (index >= hdr.extent_count) {
+        traced_close(&file);
+        return -ERANGE;
+    }
+
+    ret = fs_seek(&file, sizeof(hdr) + index * sizeof(uint32_t), FS_SEEK_SET);
+    if (ret == 0 && traced_read(&file, crc, sizeof(*crc)) != sizeof(*crc)) {
+        ret = OPENDOTT_ERR_FLASH_READ;
+    }
+
+    traced_close(&file);
+    return ret;
+}
+
+int storage_get_flags(const char *name, uint16_t *flags)
+{
+    struct fs_file_t file;
+    struct sidecar_header hdr;
+
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    if (meta_get_flags(name, flags)) {
+        return 0;
+    }
+
+    int ret = sidecar_read_header(name, &file, &hdr, FS_O_READ);
+    if (ret < 0) {
+        /* Files saved before sidecars existed carry no flags */
+        *flags = 0;
+        return 0;
+    }
+
+    traced_close(&file);
+    *flags = hdr.flags;
+    meta_set_flags(name, hdr.flags);
+    return 0;
+}
+
+int storage_set_flags(const char *name, uint16_t flags)
+{
+    struct fs_file_t file;
+    struct sidecar_header hdr;
+
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    storage_lock();
+
+    int ret = sidecar_read_header(name, &file, &hdr, FS_O_RDWR);
+    if (ret == 0) {
+        hdr.flags = flags;
+        ret = fs_seek(&file, 0, FS_SEEK_SET);
+        if (ret == 0 && traced_write(&file, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+            ret = OPENDOTT_ERR_FLASH_WRITE;
+        }
+        traced_close(&file);
+    }
+
+    storage_unlock();
+
+    if (ret == 0) {
+        meta_set_flags(name, flags);
+    }
+    return ret;
+}
+
+/*
+ * Derived media files
+ * ===================
+ *
+ * Data derived from a stored file (GIF index, decoded frame cache) lives
+ * next to its CRC sidecar as /lfs/.meta/NAME.EXT, where EXT never holds a
+ * '.'. Saving or deleting NAME drops all of them, so they can never describe
+ * older content.
+ *
+ * Writes through these helpers take storage_lock() per call, like every
+ * other flash write, so they never program under an XIP reader or race a
+ * compaction pass; a writer keeps no lock between calls.
+ */
+static void derived_path(const char *name, const char *ext, char *path, size_t len)
+{
+    snprintf(path, len, "%s/%s.%s", STORAGE_META_DIR, name, ext);
+}
+
+/* True if ENTRY is NAME.EXT for some EXT without a '.'. A prefix match
+ * would let "cat" claim "cat.gif.idx", which belongs to "cat.gif" */
+static bool derived_owned_by(const char *entry, const char *name, size_t name_len)
+{
+    return strncmp(entry, name, name_len) == 0 && entry[name_len] == '.' &&
+           entry[name_len + 1] != '\0' && strchr(&entry[name_len + 1], '.') == NULL;
+}
+
+/* Caller holds storage_lock */
+static void derived_delete_all(const char *name)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    char path[STORAGE_PATH_MAX];
+    size_t name_len = strlen(name);
+
+    fs_dir_t_init(&dir);
+    if (fs_opendir(&dir, STORAGE_META_DIR) < 0) {
+        return;
+    }
+
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+        if (entry.type == FS_DIR_ENTRY_FILE && derived_owned_by(entry.name, name, name_len)) {
+            snprintf(path, sizeof(path), "%s/%s", STORAGE_META_DIR, entry.name);
+            fs_unlink(path);
+        }
+    }
+
+    fs_closedir(&dir);
+}
+
+int storage_meta_open(const char *name, const char *ext, bool write, struct fs_file_t *file)
+{
+    char path[STORAGE_PATH_MAX];
+
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    derived_path(name, ext, path, sizeof(path));
+    fs_file_t_init(file);
+
+    if (!write) {
+        return traced_open(file, path, FS_O_READ);
+    }
+
+    /* Truncating frees the old blocks */
+    storage_lock();
+    int ret = traced_open(file, path, FS_O_CREATE | FS_O_RDWR | FS_O_TRUNC);
+    storage_unlock();
+    return ret;
+}
+
+int storage_meta_read(const char *name, const char *ext, size_t offset, void *buf, size_t len)
+{
+    struct fs_file_t file;
+
+    int ret = storage_meta_open(name, ext, false, &file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_read(&file, offset, buf, len);
+    traced_close(&file);
+    return ret;
+}
+
+void storage_meta_delete(const char *name, const char *ext)
+{
+    char path[STORAGE_PATH_MAX];
+
+    derived_path(name, ext, path, sizeof(path));
+
+    storage_lock();
+    fs_unlink(path);
+    storage_unlock();
+}
+
+/* Open a stored file for random-access reads; flagged files are refused */
+int storage_file_open(const char *name, struct fs_file_t *file)
+{
+    char path[STORAGE_PATH_MAX];
+    uint16_t flags;
+
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    if (storage_get_flags(name, &flags) == 0 && (flags & MEDIA_FLAG_CORRUPT)) {
+        return OPENDOTT_ERR_CORRUPT;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, name);
+    fs_file_t_init(file);
+
+    return traced_open(file, path, FS_O_READ);
+}
+
+ssize_t storage_file_read(struct fs_file_t *file, size_t offset, void *buf, size_t len)
+{
+    int ret = fs_seek(file, offset, FS_SEEK_SET);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return traced_read(file, buf, len);
+}
+
+ssize_t storage_file_write(struct fs_file_t *file, size_t offset, const void *buf, size_t len)
+{
+    storage_lock();
+
+    ssize_t ret = fs_seek(file, offset, FS_SEEK_SET);
+    if (ret == 0) {
+        ret = traced_write(file, buf, len);
+    }
+
+    storage_unlock();
+    return ret;
+}
+
+/* Closing a written file flushes its cache and commits the metadata */
+int storage_file_close(struct fs_file_t *file)
+{
+    if (!(file->flags & FS_O_WRITE)) {
+        return traced_close(file);
+    }
+
+    storage_lock();
+    int ret = traced_close(file);
+    storage_unlock();
+    return ret;
+}
+
+/* Read LEN bytes at OFFSET without loading the whole file */
+int storage_read_at(const char *name, size_t offset, uint8_t *buf, size_t len)
+{
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    char path[STORAGE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, name);
+
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+
+    int ret = traced_open(&file, path, FS_O_READ);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = fs_seek(&file, offset, FS_SEEK_SET);
+    if (ret == 0) {
+        ret = traced_read(&file, buf, len);
+    }
+
+    traced_close(&file);
+    return ret;
+}
+
+/*
+ * Flash layout versions:
+ *
+ *   1 - LittleFS on the whole QSPI flash
+ *   2 - LittleFS on all but the last 1MB, which holds the asset pack
+ *
+ * The layout of an existing file system shows in the block count of its
+ * superblock: the "littlefs" name entry at offset 8 of block 0 or 1 is
+ * followed by a tag and the superblock struct (version, block_size,
+ * block_count, ...). One larger than our partition is from layout 1.
+ */
+#define STORAGE_LAYOUT_VERSION     2
+#define LFS_SUPERBLOCK_NAME_OFFSET 8
+#define LFS_SUPERBLOCK_COUNT_OFFSET 28
+
+/* Block count of the LittleFS superblock on the partition, or 0 if none */
+static uint32_t storage_lfs_blocks(const struct flash_area *fa)
+{
+    for (int block = 0; block < 2; block++) {
+        off_t base = (off_t)block * STORAGE_BLOCK_SIZE;
+        uint8_t name[8];
+        uint32_t count;
+
+        if (flash_area_read(fa, base + LFS_SUPERBLOCK_NAME_OFFSET, name, sizeof(name)) == 0 &&
+            memcmp(name, "littlefs", sizeof(name)) == 0 &&
+            flash_area_read(fa, base + LFS_SUPERBLOCK_COUNT_OFFSET, &count,
+                            sizeof(count)) == 0) {
+            return sys_le32_to_cpu(count);
+        }
+    }
+    return 0;
+}
+
+/* A mount failed: format, unless that would wipe a file system from an
+ * older layout that we were told to keep */
+static int storage_reformat(const struct flash_area *fa, int mount_err)
+{
+    uint32_t blocks = storage_lfs_blocks(fa);
+
+    if (blocks > fa->fa_size / STORAGE_BLOCK_SIZE) {
+        if (!IS_ENABLED(CONFIG_OPENDOTT_STORAGE_LAYOUT_WIPE)) {
+            LOG_ERR("File system of %u blocks is from an older flash layout "
+                    "(now %d); leaving it unmounted", blocks, STORAGE_LAYOUT_VERSION);
+            return -EROFS;
+        }
+        LOG_WRN("File system of %u blocks is from an older flash layout "
+                "(now %d); reformatting, stored files are lost", blocks,
+                STORAGE_LAYOUT_VERSION);
+    } else {
+        LOG_WRN("Mount failed (%d), formatting...", mount_err);
+    }
+
+    return fs_mkfs(FS_LITTLEFS, (uintptr_t)STORAGE_PARTITION_ID, NULL, 0);
+}
+
 int storage_init(void)
 {
     int ret;
@@ -48,28 +805,36 @@ int storage_init(void)
     
     LOG_INF("Flash area: offset=0x%lx, size=%zu KB", 
             (unsigned long)fa->fa_off, fa->fa_size / 1024);
-    flash_area_close(fa);
 
     /* Try to mount */
     ret = fs_mount(&storage_mount_cfg);
     if (ret < 0) {
-        LOG_WRN("Mount failed (%d), formatting...", ret);
-        
         /* Format and retry */
-        ret = fs_mkfs(FS_LITTLEFS, (uintptr_t)STORAGE_PARTITION_ID, NULL, 0);
+        ret = storage_reformat(fa, ret);
         if (ret < 0) {
+            flash_area_close(fa);
             LOG_ERR("Format failed: %d", ret);
             return ret;
         }
 
         ret = fs_mount(&storage_mount_cfg);
         if (ret < 0) {
+            flash_area_close(fa);
             LOG_ERR("Mount after format failed: %d", ret);
             return ret;
         }
     }
 
+    flash_area_close(fa);
     storage_mounted = true;
+    storage_install_hooks();
+    storage_compact_cleanup();
+
+    ret = fs_mkdir(STORAGE_META_DIR);
+    if (ret < 0 && ret != -EEXIST) {
+        LOG_WRN("Failed to create %s: %d", STORAGE_META_DIR, ret);
+    }
+
     LOG_INF("Storage mounted at %s", STORAGE_MOUNT_POINT);
 
     return 0;
@@ -86,26 +851,52 @@ int storage_save_image(const uint8_t *data, size_t size, const char *name)
         return OPENDOTT_ERR_FILE_TOO_LARGE;
     }
 
-    char path[64];
+    char path[STORAGE_PATH_MAX];
     snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, name);
 
     struct fs_file_t file;
     fs_file_t_init(&file);
 
-    int ret = fs_open(&file, path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
+    storage_lock();
+    storage_compact_forget(name);
+    storage_generation++;
+    meta_invalidate(name);
+
+    /* Drop the old CRCs and derived files first so they can never describe
+     * the new content */
+    derived_delete_all(name);
+
+    int ret = traced_open(&file, path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
     if (ret < 0) {
+        storage_unlock();
         LOG_ERR("Failed to open file for writing: %d", ret);
         return OPENDOTT_ERR_FLASH_WRITE;
     }
 
-    ssize_t written = fs_write(&file, data, size);
-    fs_close(&file);
+    ssize_t written = traced_write(&file, data, size);
+    traced_close(&file);
+
+    if (written == size) {
+        ret = sidecar_write(name, data, size);
+        if (ret < 0) {
+            LOG_WRN("Failed to write CRC sidecar for %s: %d", name, ret);
+        }
+    }
+
+    storage_unlock();
+    storage_compact_schedule();
 
     if (written != size) {
         LOG_ERR("Write incomplete: %zd != %zu", written, size);
         return OPENDOTT_ERR_FLASH_WRITE;
     }
 
+    upload_blocks = MAX((3 * upload_blocks + DIV_ROUND_UP(size, STORAGE_BLOCK_SIZE)) / 4, 1);
+
+    uint32_t crc = crc32_ieee(data, size);
+    meta_update(name, size, &crc);
+    meta_set_flags(name, 0);
+
     LOG_INF("Saved %zu bytes to %s", size, path);
     return 0;
 }
@@ -116,42 +907,51 @@ int storage_load_image(const char *name, uint8_t **data, size_t *size)
         return -ENODEV;
     }
 
-    char path[64];
+    /* Files flagged by the scrubber never reach a decoder */
+    uint16_t flags;
+    if (storage_get_flags(name, &flags) == 0 && (flags & MEDIA_FLAG_CORRUPT)) {
+        LOG_WRN("Skipping corrupt %s", name);
+        return OPENDOTT_ERR_CORRUPT;
+    }
+
+    char path[STORAGE_PATH_MAX];
     snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, name);
 
     struct fs_file_t file;
     fs_file_t_init(&file);
 
-    int ret = fs_open(&file, path, FS_O_READ);
+    int ret = traced_open(&file, path, FS_O_READ);
     if (ret < 0) {
         LOG_ERR("Failed to open file for reading: %d", ret);
         return OPENDOTT_ERR_FLASH_READ;
     }
 
-    /* Get file size */
-    struct fs_dirent entry;
-    ret = fs_stat(path, &entry);
-    if (ret < 0) {
-        fs_close(&file);
-        return OPENDOTT_ERR_FLASH_READ;
+    /* Get file size: cached, else from the open handle (no second walk) */
+    if (!meta_lookup(name, size, NULL)) {
+        off_t end = fs_seek(&file, 0, FS_SEEK_END) == 0 ? fs_tell(&file) : -1;
+        if (end < 0 || fs_seek(&file, 0, FS_SEEK_SET) < 0) {
+            traced_close(&file);
+            return OPENDOTT_ERR_FLASH_READ;
+        }
+        *size = end;
+        meta_update(name, *size, NULL);
     }
 
-    *size = entry.size;
-
     /* Allocate buffer */
     *data = k_malloc(*size);
     if (!*data) {
-        fs_close(&file);
+        traced_close(&file);
         return OPENDOTT_ERR_NO_MEMORY;
     }
 
     /* Read file */
-    ssize_t read = fs_read(&file, *data, *size);
-    fs_close(&file);
+    ssize_t read = traced_read(&file, *data, *size);
+    traced_close(&file);
 
     if (read != *size) {
         k_free(*data);
         *data = NULL;
+        meta_invalidate(name);
         LOG_ERR("Read incomplete: %zd != %zu", read, *size);
         return OPENDOTT_ERR_FLASH_READ;
     }
@@ -166,19 +966,55 @@ int storage_delete_image(const char *name)
         return -ENODEV;
     }
 
-    char path[64];
+    char path[STORAGE_PATH_MAX];
     snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, name);
 
+    storage_lock();
+    storage_compact_forget(name);
+    storage_generation++;
+    meta_invalidate(name);
     int ret = fs_unlink(path);
+    derived_delete_all(name);
+    storage_unlock();
     if (ret < 0) {
         LOG_ERR("Failed to delete %s: %d", path, ret);
         return ret;
     }
 
+    storage_compact_schedule();
+
     LOG_INF("Deleted %s", path);
     return 0;
 }
 
+/* Size (and content CRC if known, else 0) without reading the file */
+int storage_get_info(const char *name, size_t *size, uint32_t *crc)
+{
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    if (meta_lookup(name, size, crc)) {
+        return 0;
+    }
+
+    char path[STORAGE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, name);
+
+    struct fs_dirent entry;
+    int ret = traced_stat(path, &entry);
+    if (ret < 0) {
+        return ret;
+    }
+
+    *size = entry.size;
+    if (crc) {
+        *crc = 0;
+    }
+    meta_update(name, entry.size, NULL);
+    return 0;
+}
+
 int storage_get_free_space(size_t *free_bytes)
 {
     if (!storage_mounted) {
@@ -199,6 +1035,11 @@ int storage_format(void)
 {
     LOG_WRN("Formatting storage...");
 
+    storage_lock();
+    storage_compact_forget(NULL);
+    storage_generation++;
+    meta_invalidate(NULL);
+
     if (storage_mounted) {
         fs_unmount(&storage_mount_cfg);
         storage_mounted = false;
@@ -206,17 +1047,22 @@ int storage_format(void)
 
     int ret = fs_mkfs(FS_LITTLEFS, (uintptr_t)STORAGE_PARTITION_ID, NULL, 0);
     if (ret < 0) {
+        storage_unlock();
         LOG_ERR("Format failed: %d", ret);
         return ret;
     }
 
     ret = fs_mount(&storage_mount_cfg);
     if (ret < 0) {
+        storage_unlock();
         LOG_ERR("Mount after format failed: %d", ret);
         return ret;
     }
 
     storage_mounted = true;
+    storage_install_hooks();
+    fs_mkdir(STORAGE_META_DIR);
+    storage_unlock();
     LOG_INF("Storage formatted and mounted");
     return 0;
 }
@@ -252,3 +1098,439 @@ int storage_load_gif(uint8_t *data, size_t max_size, uint8_t slot)
     
     return (int)loaded_size;
 }
+
+/*
+ * Idle-time compaction
+ * ====================
+ *
+ * Runs on the idle work queue in small steps, one chunk or one block per
+ * step, and backs off whenever the device stops being idle:
+ *
+ *   MEASURE   - walk LittleFS to build a used-block map and count free extents
+ *   REWRITE   - if free space is fragmented and no free extent holds a
+ *               typical upload, copy files to NAME.cmp and rename each over
+ *               the original. The copy lands in freshly allocated blocks and
+ *               the old scattered ones are released together. LittleFS
+ *               renames are atomic, so a power loss leaves either the old or
+ *               the new file plus a stray .cmp that is removed at the next
+ *               mount. A pass stops once an upload fits or after
+ *               COMPACT_MAX_FILES / COMPACT_MAX_BYTES, and the next pass
+ *               carries on from the same file.
+ *   PRE_ERASE - erase free blocks not already blank and mark them in
+ *               pre_erased[] so the next upload skips those erases.
+ */
+#define COMPACT_DELAY_MS         (60 * 1000)
+#define COMPACT_INTERVAL_MS      (30 * 60 * 1000)   /* Between scheduled passes */
+#define COMPACT_BACKOFF          K_SECONDS(5)
+#define COMPACT_FRAGMENT_LIMIT   8
+#define COMPACT_MAX_FILES        4                  /* Rewritten per pass */
+#define COMPACT_MAX_BYTES        (512 * 1024)
+#define COMPACT_TMP_SUFFIX       ".cmp"
+#define COMPACT_CHUNK_SIZE       1024
+
+static struct k_work_delayable compact_work;
+static bool compact_work_ready = false;
+
+static struct storage_compact_status compact;
+static uint8_t used_blocks[STORAGE_MAX_BLOCKS / 8];
+static uint32_t used_generation;
+static lfs_block_t pre_erase_next;
+static uint32_t compact_bytes;          /* Rewritten in this pass */
+static int64_t compact_last_pass = -COMPACT_INTERVAL_MS;
+
+static struct fs_file_t compact_src;
+static struct fs_file_t compact_dst;
+static bool compact_copying = false;
+static char compact_name[32];
+static uint8_t compact_chunk[COMPACT_CHUNK_SIZE];
+
+static bool is_compact_tmp(const char *name)
+{
+    size_t len = strlen(name);
+    size_t suffix = strlen(COMPACT_TMP_SUFFIX);
+
+    return len > suffix && strcmp(name + len - suffix, COMPACT_TMP_SUFFIX) == 0;
+}
+
+static int mark_used_block(void *data, lfs_block_t block)
+{
+    if (block < STORAGE_MAX_BLOCKS) {
+        used_blocks[block / 8] |= BIT(block % 8);
+    }
+    return 0;
+}
+
+/* Rebuild the used-block map and free-extent stats. Caller holds storage_lock */
+static int compact_measure(void)
+{
+    memset(used_blocks, 0, sizeof(used_blocks));
+
+    k_mutex_lock(&storage_lfs.mutex, K_FOREVER);
+    int ret = lfs_fs_traverse(&storage_lfs.lfs, mark_used_block, NULL);
+    k_mutex_unlock(&storage_lfs.mutex);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    uint32_t extents = 0, largest = 0, run = 0;
+
+    for (lfs_block_t b = 0; b < storage_lfs.cfg.block_count; b++) {
+        if (used_blocks[b / 8] & BIT(b % 8)) {
+            run = 0;
+            continue;
+        }
+        if (run++ == 0) {
+            extents++;
+        }
+        largest = MAX(largest, run);
+    }
+
+    compact.free_extents = extents;
+    compact.largest_free_extent = largest;
+    used_generation = storage_generation;
+    return 0;
+}
+
+/* Abandon an in-progress copy. Caller holds storage_lock */
+static void compact_abort_copy(void)
+{
+    if (!compact_copying) {
+        return;
+    }
+
+    char path[STORAGE_PATH_MAX];
+
+    traced_close(&compact_src);
+    traced_close(&compact_dst);
+    snprintf(path, sizeof(path), "%s/%s%s", STORAGE_MOUNT_POINT, compact_name,
+             COMPACT_TMP_SUFFIX);
+    fs_unlink(path);
+    compact_copying = false;
+}
+
+/* A foreground write/delete of NAME (NULL = everything) supersedes our copy */
+static void storage_compact_forget(const char *name)
+{
+    if (compact_copying && (!name || strcmp(name, compact_name) == 0)) {
+        LOG_INF("Compaction of %s superseded", compact_name);
+        compact_abort_copy();
+    }
+    if (!name) {
+        memset(pre_erased, 0, sizeof(pre_erased));
+    }
+}
+
+/* Remove temp files left behind by a compaction interrupted by power loss */
+static void storage_compact_cleanup(void)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    char path[STORAGE_PATH_MAX];
+
+    fs_dir_t_init(&dir);
+    if (fs_opendir(&dir, STORAGE_MOUNT_POINT) < 0) {
+        return;
+    }
+
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+        if (entry.type == FS_DIR_ENTRY_FILE && is_compact_tmp(entry.name)) {
+            snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, entry.name);
+            fs_unlink(path);
+            LOG_INF("Removed stale %s", entry.name);
+        }
+    }
+
+    fs_closedir(&dir);
+}
+
+/*
+ * Find the first file whose name sorts after AFTER ("" for the first), so
+ * background jobs can walk the store without keeping a list
+ */
+bool storage_next_file(const char *after, char *out, size_t out_size)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    char prev[META_NAME_MAX];
+    bool found = false;
+
+    strncpy(prev, after, sizeof(prev) - 1);
+    prev[sizeof(prev) - 1] = '\0';
+
+    fs_dir_t_init(&dir);
+    if (fs_opendir(&dir, STORAGE_MOUNT_POINT) < 0) {
+        return false;
+    }
+
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+        if (entry.type != FS_DIR_ENTRY_FILE || is_compact_tmp(entry.name) ||
+            strlen(entry.name) >= out_size) {
+            continue;
+        }
+        if (strcmp(entry.name, prev) <= 0) {
+            continue;
+        }
+        if (!found || strcmp(entry.name, out) < 0) {
+            strcpy(out, entry.name);
+            found = true;
+        }
+    }
+
+    fs_closedir(&dir);
+    return found;
+}
+
+static int compact_begin_copy(void)
+{
+    char path[STORAGE_PATH_MAX];
+    char tmp_path[STORAGE_PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, compact_name);
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, COMPACT_TMP_SUFFIX);
+
+    fs_file_t_init(&compact_src);
+    fs_file_t_init(&compact_dst);
+
+    int ret = traced_open(&compact_src, path, FS_O_READ);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = traced_open(&compact_dst, tmp_path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
+    if (ret < 0) {
+        traced_close(&compact_src);
+        return ret;
+    }
+
+    compact_copying = true;
+    return 0;
+}
+
+/* Copy one chunk; returns 1 when the file has been fully rewritten */
+static int compact_copy_step(void)
+{
+    ssize_t n = traced_read(&compact_src, compact_chunk, sizeof(compact_chunk));
+    if (n < 0) {
+        compact_abort_copy();
+        return n;
+    }
+
+    if (n > 0) {
+        ssize_t written = traced_write(&compact_dst, compact_chunk, n);
+        if (written != n) {
+            compact_abort_copy();
+            return OPENDOTT_ERR_FLASH_WRITE;
+        }
+        compact_bytes += n;
+        return 0;
+    }
+
+    char path[STORAGE_PATH_MAX];
+    char tmp_path[STORAGE_PATH_MAX];
+
+    traced_close(&compact_src);
+    traced_close(&compact_dst);
+    compact_copying = false;
+
+    snprintf(path, sizeof(path), "%s/%s", STORAGE_MOUNT_POINT, compact_name);
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, COMPACT_TMP_SUFFIX);
+
+    int ret = fs_rename(tmp_path, path);
+    if (ret < 0) {
+        fs_unlink(tmp_path);
+        return ret;
+    }
+
+    compact.files_done++;
+    return 1;
+}
+
+static int compact_pre_erase_step(void)
+{
+    /* Any program or erase since the last measure may have put live data
+     * on a block the map still shows as free */
+    if (used_generation != storage_generation) {
+        int ret = compact_measure();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    /* Find the next free block that is not already blank */
+    while (pre_erase_next < storage_lfs.cfg.block_count) {
+        lfs_block_t b = pre_erase_next++;
+
+        if ((used_blocks[b / 8] & BIT(b % 8)) || (pre_erased[b / 8] & BIT(b % 8))) {
+            continue;
+        }
+
+        const struct flash_area *fa;
+        int ret = flash_area_open(STORAGE_PARTITION_ID, &fa);
+        if (ret < 0) {
+            return ret;
+        }
+
+        uint32_t start = storage_trace_start();
+        ret = flash_area_erase(fa, (off_t)b * STORAGE_BLOCK_SIZE, STORAGE_BLOCK_SIZE);
+        storage_trace_record(STORAGE_OP_FLASH_ERASE, start, STORAGE_BLOCK_SIZE);
+        flash_area_close(fa);
+        if (ret < 0) {
+            return ret;
+        }
+
+        pre_erased[b / 8] |= BIT(b % 8);
+        compact.blocks_pre_erased++;
+        return 0;
+    }
+
+    return 1;
+}
+
+static void compact_work_handler(struct k_work *work)
+{
+    int ret = 0;
+
+    if (!storage_mounted || compact.state == STORAGE_COMPACT_IDLE) {
+        return;
+    }
+
+    if (!idle_is_idle()) {
+        idle_submit(&compact_work, COMPACT_BACKOFF);
+        return;
+    }
+
+    storage_lock();
+
+    switch (compact.state) {
+    case STORAGE_COMPACT_MEASURE:
+        ret = compact_measure();
+        if (ret < 0) {
+            break;
+        }
+        LOG_INF("Compaction: %u free extents, largest %u blocks",
+                compact.free_extents, compact.largest_free_extent);
+
+        if (compact.free_extents > COMPACT_FRAGMENT_LIMIT &&
+            compact.largest_free_extent < upload_blocks) {
+            compact.state = STORAGE_COMPACT_REWRITE;
+            compact_bytes = 0;
+        } else {
+            compact.state = STORAGE_COMPACT_PRE_ERASE;
+            pre_erase_next = 0;
+        }
+        break;
+
+    case STORAGE_COMPACT_REWRITE:
+        if (!compact_copying) {
+            /* COMPACT_NAME is kept, so the next pass resumes after it */
+            if (compact.files_done >= COMPACT_MAX_FILES || compact_bytes >= COMPACT_MAX_BYTES) {
+                compact.state = STORAGE_COMPACT_PRE_ERASE;
+                pre_erase_next = 0;
+                break;
+            }
+            if (!storage_next_file(compact_name, compact_name, sizeof(compact_name))) {
+                compact_name[0] = '\0';
+                compact.state = STORAGE_COMPACT_PRE_ERASE;
+                pre_erase_next = 0;
+                break;
+            }
+            storage_generation++;
+            ret = compact_begin_copy();
+            if (ret < 0) {
+                LOG_WRN("Compaction: skipping %s (%d)", compact_name, ret);
+                ret = 0;
+            }
+            break;
+        }
+        ret = compact_copy_step();
+        if (ret > 0) {
+            LOG_INF("Compaction: rewrote %s", compact_name);
+            ret = compact_measure();
+            if (ret == 0 && compact.largest_free_extent >= upload_blocks) {
+                compact.state = STORAGE_COMPACT_PRE_ERASE;
+                pre_erase_next = 0;
+            }
+        }
+        break;
+
+    case STORAGE_COMPACT_PRE_ERASE:
+        ret = compact_pre_erase_step();
+        if (ret > 0) {
+            compact.state = STORAGE_COMPACT_IDLE;
+            ret = compact_measure();
+            LOG_INF("Compaction done: %u files rewritten, %u blocks pre-erased, "
+                    "%u free extents", compact.files_done, compact.blocks_pre_erased,
+                    compact.free_extents);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    storage_unlock();
+
+    if (ret < 0) {
+        LOG_ERR("Compaction failed: %d", ret);
+        compact.state = STORAGE_COMPACT_IDLE;
+    }
+
+    if (compact.state == STORAGE_COMPACT_IDLE) {
+        compact_last_pass = k_uptime_get();
+        return;
+    }
+
+    idle_submit(&compact_work, K_NO_WAIT);
+}
+
+static void compact_arm(void)
+{
+    if (!compact_work_ready) {
+        k_work_init_delayable(&compact_work, compact_work_handler);
+        compact_work_ready = true;
+    }
+
+    if (compact.state == STORAGE_COMPACT_IDLE) {
+        compact.state = STORAGE_COMPACT_MEASURE;
+        compact.files_done = 0;
+        compact.blocks_pre_erased = 0;
+    }
+}
+
+/* A pass as soon as the device is idle; main() runs one after boot */
+int storage_compact_start(void)
+{
+    if (!storage_mounted) {
+        return -ENODEV;
+    }
+
+    compact_arm();
+    return idle_submit(&compact_work, K_NO_WAIT);
+}
+
+/* Debounced: each write or delete pushes the next compaction further out,
+ * and never closer than COMPACT_INTERVAL_MS to the end of the last pass.
+ * storage_compact_start() is not rate limited */
+void storage_compact_schedule(void)
+{
+    int64_t delay = MAX(COMPACT_DELAY_MS,
+                        compact_last_pass + COMPACT_INTERVAL_MS - k_uptime_get());
+
+    compact_arm();
+    idle_submit(&compact_work, K_MSEC(delay));
+}
+
+/* Stop the pass in progress and drop its copy, e.g. when an upload starts */
+void storage_compact_cancel(void)
+{
+    storage_lock();
+    compact_abort_copy();
+    compact.state = STORAGE_COMPACT_IDLE;
+    storage_unlock();
+}
+
+void storage_compact_get_status(struct storage_compact_status *status)
+{
+    *status = compact;
+}
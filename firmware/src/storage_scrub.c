@@ -0,0 +1,231 @@
+/*
+ * OpenDOTT - Background Integrity Scrubbing
+ * SPDX-License-Identifier: MIT
+ *
+ * Walks the stored media one 4KB extent at a time on the idle work queue and
+ * checks each extent against the CRC recorded in its sidecar at save time.
+ * A mismatch marks the file MEDIA_FLAG_CORRUPT so playback skips it instead
+ * of feeding bad data to the decoder. Files without a sidecar (saved by older
+ * firmware) are skipped.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(storage_scrub, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Pace: one extent per step keeps flash reads out of the way of playback */
+#define SCRUB_STEP_INTERVAL  K_SECONDS(1)
+#define SCRUB_BACKOFF        K_SECONDS(10)
+#define SCRUB_START_DELAY    K_MINUTES(5)
+#define SCRUB_PASS_INTERVAL  K_HOURS(24)
+#define SCRUB_READ_SIZE      1024
+#define SCRUB_ATTEMPTS       3
+
+static struct k_work_delayable scrub_work;
+static bool scrub_ready = false;
+
+static struct storage_scrub_status scrub;
+static char scrub_name[32];
+static uint32_t scrub_extent;
+static uint8_t scrub_buf[SCRUB_READ_SIZE];
+
+static void scrub_pass_done(void)
+{
+    scrub.passes++;
+    scrub.running = false;
+    scrub_name[0] = '\0';
+    scrub_extent = 0;
+
+    LOG_INF("Scrub pass %u done: %u files, %u extents, %u corrupt",
+            scrub.passes, scrub.files_checked, scrub.extents_checked,
+            scrub.corrupt_files);
+
+    idle_submit(&scrub_work, SCRUB_PASS_INTERVAL);
+}
+
+static bool scrub_advance_file(void)
+{
+    scrub_extent = 0;
+    if (!storage_next_file(scrub_name, scrub_name, sizeof(scrub_name))) {
+        return false;
+    }
+    scrub.files_checked++;
+    return true;
+}
+
+/* CRC of the extent at OFFSET. Caller holds storage_lock */
+static int scrub_extent_crc(size_t offset, uint32_t *crc)
+{
+    size_t done = 0;
+
+    *crc = 0;
+    while (done < STORAGE_EXTENT_SIZE) {
+        int ret = storage_read_at(scrub_name, offset + done, scrub_buf, sizeof(scrub_buf));
+        if (ret < 0) {
+            return ret;
+        }
+        *crc = crc32_ieee_update(*crc, scrub_buf, ret);
+        done += ret;
+        if (ret < sizeof(scrub_buf)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* Returns true when the current file has been fully checked */
+static bool scrub_check_extent(void)
+{
+    uint32_t expected;
+    uint32_t count;
+    uint32_t crc = 0;
+    uint16_t flags = 0;
+    bool corrupt = false;
+
+    /* Held across the sidecar lookup, the reads and the flagging: every
+     * save writes the file and its sidecar under the lock, so neither can
+     * change underneath us and a rewrite is never mistaken for corruption */
+    storage_lock();
+
+    if (storage_get_flags(scrub_name, &flags) < 0) {
+        flags = 0;
+    }
+    if (flags & MEDIA_FLAG_CORRUPT) {
+        storage_unlock();
+        return true;
+    }
+
+    int ret = storage_get_extent_crc(scrub_name, scrub_extent, &expected, &count);
+    if (ret < 0) {
+        /* No sidecar, or past the last extent */
+        storage_unlock();
+        return true;
+    }
+
+    size_t offset = (size_t)scrub_extent * STORAGE_EXTENT_SIZE;
+
+    /* Only a CRC that mismatches on every attempt counts; a read that
+     * fails says nothing about the data and is retried next pass */
+    for (int attempt = 0; attempt < SCRUB_ATTEMPTS; attempt++) {
+        ret = scrub_extent_crc(offset, &crc);
+        corrupt = ret == 0 && crc != expected;
+        if (ret == 0 && !corrupt) {
+            break;
+        }
+    }
+
+    if (corrupt) {
+        storage_set_flags(scrub_name, flags | MEDIA_FLAG_CORRUPT);
+    }
+
+    storage_unlock();
+
+    scrub.extents_checked++;
+
+    if (corrupt) {
+        LOG_ERR("%s: extent %u CRC mismatch (0x%08x != 0x%08x)", scrub_name,
+                scrub_extent, crc, expected);
+        scrub.corrupt_files++;
+        return true;
+    }
+
+    if (ret < 0) {
+        LOG_WRN("%s: extent %u unreadable (%d), skipped", scrub_name, scrub_extent, ret);
+    }
+
+    return ++scrub_extent >= count;
+}
+
+static void scrub_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    if (!idle_is_idle()) {
+        idle_submit(&scrub_work, SCRUB_BACKOFF);
+        return;
+    }
+
+    if (!scrub.running) {
+        scrub.running = true;
+        scrub.files_checked = 0;
+        scrub.extents_checked = 0;
+        scrub.corrupt_files = 0;
+        scrub_name[0] = '\0';
+        if (!scrub_advance_file()) {
+            scrub_pass_done();
+            return;
+        }
+    }
+
+    if (scrub_check_extent() && !scrub_advance_file()) {
+        scrub_pass_done();
+        return;
+    }
+
+    idle_submit(&scrub_work, SCRUB_STEP_INTERVAL);
+}
+
+int storage_scrub_init(void)
+{
+    k_work_init_delayable(&scrub_work, scrub_work_handler);
+    scrub_ready = true;
+
+    return idle_submit(&scrub_work, SCRUB_START_DELAY);
+}
+
+int storage_scrub_start(void)
+{
+    if (!scrub_ready) {
+        return -ENODEV;
+    }
+
+    scrub.running = false;
+    return idle_submit(&scrub_work, K_NO_WAIT);
+}
+
+void storage_scrub_get_status(struct storage_scrub_status *status)
+{
+    *status = scrub;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_scrub_status(const struct shell *sh, size_t argc, char **argv)
+{
+    shell_print(sh, "%s, %u passes; files=%u extents=%u corrupt=%u",
+                scrub.running ? "running" : "waiting", scrub.passes,
+                scrub.files_checked, scrub.extents_checked, scrub.corrupt_files);
+    return 0;
+}
+
+static int cmd_scrub_start(const struct shell *sh, size_t argc, char **argv)
+{
+    int ret = storage_scrub_start();
+
+    if (ret < 0) {
+        shell_error(sh, "Failed to start scrub: %d", ret);
+        return ret;
+    }
+
+    shell_print(sh, "Scrub scheduled (runs while idle)");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(scrub_cmds,
+    SHELL_CMD(status, NULL, "Show scrub progress", cmd_scrub_status),
+    SHELL_CMD(start, NULL, "Start a scrub pass now", cmd_scrub_start),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(storage_scrub, &scrub_cmds, "Media integrity scrubbing", NULL);
+#endif /* CONFIG_SHELL */
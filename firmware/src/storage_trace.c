@@ -0,0 +1,168 @@
+/*
+ * OpenDOTT - Storage I/O Tracing
+ * SPDX-License-Identifier: MIT
+ *
+ * Per-operation latency histograms for the filesystem calls in storage.c
+ * and the raw flash read/program/erase calls LittleFS makes underneath.
+ * Bucket i counts operations that took [2^i, 2^(i+1)) microseconds
+ * (bucket 0 also holds sub-microsecond calls).
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(storage_trace, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define TRACE_DUMP_VERSION   1
+
+struct trace_hist {
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t total_us;
+    uint32_t max_us;
+    uint32_t buckets[STORAGE_TRACE_BUCKETS];
+};
+
+static struct trace_hist hist[STORAGE_OP_COUNT];
+static struct k_spinlock trace_lock;
+
+static const char *const op_names[STORAGE_OP_COUNT] = {
+    [STORAGE_OP_OPEN]        = "open",
+    [STORAGE_OP_READ]        = "read",
+    [STORAGE_OP_WRITE]       = "write",
+    [STORAGE_OP_CLOSE]       = "close",
+    [STORAGE_OP_STAT]        = "stat",
+    [STORAGE_OP_FLASH_READ]  = "flash_read",
+    [STORAGE_OP_FLASH_PROG]  = "flash_prog",
+    [STORAGE_OP_FLASH_ERASE] = "flash_erase",
+};
+
+void storage_trace_record(enum storage_trace_op op, uint32_t start, size_t bytes)
+{
+    if (op >= STORAGE_OP_COUNT) {
+        return;
+    }
+
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    int bucket = us ? 31 - __builtin_clz(us) : 0;
+
+    if (bucket >= STORAGE_TRACE_BUCKETS) {
+        bucket = STORAGE_TRACE_BUCKETS - 1;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    struct trace_hist *h = &hist[op];
+    h->count++;
+    h->bytes += bytes;
+    h->total_us += us;
+    h->max_us = MAX(h->max_us, us);
+    h->buckets[bucket]++;
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+void storage_trace_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    memset(hist, 0, sizeof(hist));
+    k_spin_unlock(&trace_lock, key);
+}
+
+/*
+ * Binary dump for the Command characteristic (little-endian):
+ *   u8 version, u8 op_count, u8 bucket_count
+ *   per op: u32 count, u32 bytes, u32 total_us, u32 max_us,
+ *           u16 buckets[bucket_count] (saturating)
+ */
+int storage_trace_dump(uint8_t *buf, size_t size)
+{
+    size_t per_op = 16 + STORAGE_TRACE_BUCKETS * 2;
+    size_t needed = 3 + STORAGE_OP_COUNT * per_op;
+
+    if (size < needed) {
+        return -ENOMEM;
+    }
+
+    struct trace_hist snapshot[STORAGE_OP_COUNT];
+
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    memcpy(snapshot, hist, sizeof(snapshot));
+    k_spin_unlock(&trace_lock, key);
+
+    uint8_t *p = buf;
+    *p++ = TRACE_DUMP_VERSION;
+    *p++ = STORAGE_OP_COUNT;
+    *p++ = STORAGE_TRACE_BUCKETS;
+
+    for (int op = 0; op < STORAGE_OP_COUNT; op++) {
+        const struct trace_hist *h = &snapshot[op];
+
+        sys_put_le32(h->count, p);
+        sys_put_le32(h->bytes, p + 4);
+        sys_put_le32(h->total_us, p + 8);
+        sys_put_le32(h->max_us, p + 12);
+        p += 16;
+
+        for (int b = 0; b < STORAGE_TRACE_BUCKETS; b++) {
+            sys_put_le16(MIN(h->buckets[b], UINT16_MAX), p);
+            p += 2;
+        }
+    }
+
+    return p - buf;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_trace_show(const struct shell *sh, size_t argc, char **argv)
+{
+    struct trace_hist snapshot[STORAGE_OP_COUNT];
+
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    memcpy(snapshot, hist, sizeof(snapshot));
+    k_spin_unlock(&trace_lock, key);
+
+    for (int op = 0; op < STORAGE_OP_COUNT; op++) {
+        const struct trace_hist *h = &snapshot[op];
+
+        if (h->count == 0) {
+            continue;
+        }
+
+        shell_print(sh, "%-11s n=%u bytes=%u avg=%uus max=%uus", op_names[op],
+                    h->count, h->bytes, h->total_us / h->count, h->max_us);
+
+        for (int b = 0; b < STORAGE_TRACE_BUCKETS; b++) {
+            if (h->buckets[b]) {
+                shell_print(sh, "    %7u-%-7u us: %u", b ? (uint32_t)BIT(b) : 0,
+                            (uint32_t)(BIT(b + 1) - 1), h->buckets[b]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int cmd_trace_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    storage_trace_reset();
+    shell_print(sh, "Storage trace reset");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(trace_cmds,
+    SHELL_CMD(show, NULL, "Show storage latency histograms", cmd_trace_show),
+    SHELL_CMD(reset, NULL, "Clear storage latency histograms", cmd_trace_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(storage_trace, &trace_cmds, "Storage I/O tracing", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,153 @@
+/*
+ * OpenDOTT - Preview Thumbnails
+ * SPDX-License-Identifier: MIT
+ *
+ * A 60x60 RGB565 (big-endian) preview per stored animation, box-filtered
+ * from its first frame whenever that is cached (predecode.c), whether by a
+ * pre-decode or by the player. It is kept next to the other derived files
+ * as /.meta/NAME.thm, so a host app can show the whole library for ~7KB per
+ * item instead of downloading every file.
+ *
+ * The canvas is read a line at a time, so a thumbnail can be built from a
+ * frame cache on flash without the decoder and its canvas, which playback
+ * keeps for itself.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(thumbnail, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define THUMBNAIL_MAGIC     0x4D48544F  /* 'OTHM' */
+#define THUMBNAIL_VERSION   1
+#define THUMBNAIL_EXT       "thm"
+
+#define THUMBNAIL_SCALE     (DISPLAY_WIDTH / THUMBNAIL_SIZE)
+#define THUMBNAIL_ROWS      10      /* Rows filtered per write */
+
+struct thumbnail_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t format;
+    uint8_t width;
+    uint8_t height;
+} __packed;
+
+/* The player and the pre-decode work queue both write thumbnails */
+static K_MUTEX_DEFINE(thumb_lock);
+static uint16_t thumb_rows[THUMBNAIL_SIZE * THUMBNAIL_ROWS];
+
+/* Channel sums of the row of SCALE x SCALE blocks being filtered */
+static uint16_t sum_r[THUMBNAIL_SIZE];
+static uint16_t sum_g[THUMBNAIL_SIZE];
+static uint16_t sum_b[THUMBNAIL_SIZE];
+
+/* Box-filter thumbnail row TY into OUT, fetching its canvas lines */
+static int filter_row(thumbnail_line_t line, void *user, const uint16_t *lut, int ty,
+                      uint16_t *out)
+{
+    memset(sum_r, 0, sizeof(sum_r));
+    memset(sum_g, 0, sizeof(sum_g));
+    memset(sum_b, 0, sizeof(sum_b));
+
+    for (int y = 0; y < THUMBNAIL_SCALE; y++) {
+        const uint8_t *px = line(user, ty * THUMBNAIL_SCALE + y);
+        if (!px) {
+            return OPENDOTT_ERR_FLASH_READ;
+        }
+
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            uint16_t c = sys_be16_to_cpu(lut[px[x]]);
+            int tx = x / THUMBNAIL_SCALE;
+            sum_r[tx] += c >> 11;
+            sum_g[tx] += (c >> 5) & 0x3F;
+            sum_b[tx] += c & 0x1F;
+        }
+    }
+
+    const uint32_t n = THUMBNAIL_SCALE * THUMBNAIL_SCALE;
+    for (int tx = 0; tx < THUMBNAIL_SIZE; tx++) {
+        uint16_t c = ((sum_r[tx] / n) << 11) | ((sum_g[tx] / n) << 5) | (sum_b[tx] / n);
+        out[tx] = sys_cpu_to_be16(c);
+    }
+    return 0;
+}
+
+/* Build NAME's thumbnail from a frame whose canvas lines LINE returns */
+int thumbnail_generate(const char *name, thumbnail_line_t line, void *user,
+                       const uint16_t *lut)
+{
+    struct thumbnail_header hdr = {
+        .magic = THUMBNAIL_MAGIC,
+        .version = THUMBNAIL_VERSION,
+        .format = THUMBNAIL_FORMAT_RGB565,
+        .width = THUMBNAIL_SIZE,
+        .height = THUMBNAIL_SIZE,
+    };
+    struct fs_file_t file;
+
+    k_mutex_lock(&thumb_lock, K_FOREVER);
+
+    int ret = storage_meta_open(name, THUMBNAIL_EXT, true, &file);
+    if (ret < 0) {
+        k_mutex_unlock(&thumb_lock);
+        return ret;
+    }
+
+    for (int ty = 0; ty < THUMBNAIL_SIZE && ret >= 0; ty += THUMBNAIL_ROWS) {
+        for (int y = 0; y < THUMBNAIL_ROWS && ret >= 0; y++) {
+            ret = filter_row(line, user, lut, ty + y, &thumb_rows[y * THUMBNAIL_SIZE]);
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        ret = storage_file_write(&file, sizeof(hdr) + ty * THUMBNAIL_SIZE * sizeof(uint16_t),
+                                 thumb_rows, sizeof(thumb_rows));
+    }
+
+    /* Header last, so a cut-short write never looks valid */
+    if (ret >= 0) {
+        ret = storage_file_write(&file, 0, &hdr, sizeof(hdr));
+    }
+
+    storage_file_close(&file);
+
+    if (ret < 0) {
+        storage_meta_delete(name, THUMBNAIL_EXT);
+    }
+    k_mutex_unlock(&thumb_lock);
+    return ret < 0 ? ret : 0;
+}
+
+/* Read part of NAME's thumbnail pixels. Returns the bytes read, or -ENOENT
+ * (after scheduling a pre-decode) when it has not been generated yet */
+int thumbnail_read(const char *name, size_t offset, uint8_t *buf, size_t len)
+{
+    struct thumbnail_header hdr;
+    size_t size;
+
+    if (storage_get_info(name, &size, NULL) < 0) {
+        return -ENOENT;
+    }
+
+    int ret = storage_meta_read(name, THUMBNAIL_EXT, 0, &hdr, sizeof(hdr));
+    if (ret != sizeof(hdr) || hdr.magic != THUMBNAIL_MAGIC ||
+        hdr.version != THUMBNAIL_VERSION) {
+        /* Refused while an upload is being pre-decoded; asked again later */
+        predecode_schedule_thumbnail(name);
+        return -ENOENT;
+    }
+
+    if (offset >= THUMBNAIL_BYTES) {
+        return 0;
+    }
+
+    return storage_meta_read(name, THUMBNAIL_EXT, sizeof(hdr) + offset, buf,
+                             MIN(len, THUMBNAIL_BYTES - offset));
+}
@@ -0,0 +1,441 @@
+/*
+ * OpenDOTT - Slot Transitions
+ * SPDX-License-Identifier: MIT
+ *
+ * Blends the outgoing frame into the incoming one over a few hundred ms:
+ * crossfade, a left-to-right wipe, or an iris that opens from the centre
+ * to the edge of the round panel.
+ *
+ * A transition is a media decoder, so it runs through the normal pipeline
+ * and its strips go to the panel while the next ones are composed. Both
+ * frames are palette index canvases. The incoming one is frame 0 of the
+ * new slot, read from its predecode frame cache one strip at a time. The
+ * outgoing one is either the canvas of the GIF decoder that was playing
+ * (still open, so nothing else writes to it) or another frame 0 cache.
+ * Only one strip of indexes is held on top of the pipeline's strip pool,
+ * never a second frame.
+ *
+ * Each run logs its frame rate and the time spent composing, reading
+ * flash and sending over SPI per step; `transition stats` shows the last.
+ * The effect and duration are saved, like the color profile.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#endif
+
+#include "opendott.h"
+
+LOG_MODULE_REGISTER(transition, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define TRANSITION_DEFAULT_MS   400
+#define TRANSITION_MAX_MS       2000
+#define TRANSITION_STEP_MS      33      /* Aim for 30 fps */
+#define TRANSITION_OPEN_TIMEOUT K_MSEC(100)
+
+/* Progress through a transition, in 1/256 */
+#define TRANSITION_ONE          256
+
+/* The iris is done when it reaches the edge of the round panel */
+#define TRANSITION_IRIS_RADIUS  (DISPLAY_WIDTH / 2)
+
+/* Not a valid media name, so no upload can shadow it */
+#define TRANSITION_SETTINGS_NAME    ".transition"
+#define TRANSITION_SETTINGS_EXT     "cfg"
+#define TRANSITION_SETTINGS_MAGIC   0x5254444F  /* 'ODTR' */
+
+struct transition_record {
+    uint32_t magic;
+    uint8_t effect;
+    uint8_t reserved;
+    uint16_t duration_ms;
+} __packed;
+
+static const char *const effect_names[TRANSITION_COUNT] = {
+    [TRANSITION_CUT] = "cut",
+    [TRANSITION_CROSSFADE] = "crossfade",
+    [TRANSITION_WIPE] = "wipe",
+    [TRANSITION_IRIS] = "iris",
+};
+
+static enum transition_effect effect = TRANSITION_IRIS;
+static uint16_t duration_ms = TRANSITION_DEFAULT_MS;
+
+static struct media_pipeline pipeline;
+static struct media_source to_src;
+static struct media_source from_src;
+static struct media_sink panel;
+
+/* Incoming indexes for one strip; beside the LZW tables, which are idle
+ * while a transition runs */
+static uint8_t to_rows[DISPLAY_WIDTH * MEDIA_STRIP_LINES] OPENDOTT_DECODE_RAM;
+
+/* The transition being rendered */
+static struct {
+    const uint8_t *from_canvas; /* NULL: read from from_src */
+    const uint16_t *from_lut;
+    const uint16_t *to_lut;
+    size_t from_pixels;         /* Canvas offsets in the frame caches */
+    size_t to_pixels;
+    uint16_t steps;
+    uint16_t progress;          /* Of the step being rendered */
+} tr;
+
+static struct transition_stats last;
+
+/*
+ * Pixel kernels. Palette entries are panel-order RGB565.
+ */
+
+/* Palette indexes to panel pixels */
+static OPENDOTT_RAMFUNC void lut_row(uint16_t *out, const uint8_t *idx,
+                                     const uint16_t *lut, uint16_t count)
+{
+    for (uint16_t x = 0; x < count; x++) {
+        out[x] = lut[idx[x]];
+    }
+}
+
+/* Mix of A and B with B weighted ALPHA/32. SWAR: green moves to the top
+ * half-word, leaving each field enough zero bits above it for the product,
+ * so one multiply scales all three. T (0..31) is added to every field's
+ * 1/32 fraction before it is dropped: an ordered dither instead of always
+ * rounding down */
+static inline uint16_t blend565(uint16_t a, uint16_t b, uint32_t alpha, uint32_t t)
+{
+    uint32_t wa = (a | ((uint32_t)a << 16)) & 0x07E0F81F;
+    uint32_t wb = (b | ((uint32_t)b << 16)) & 0x07E0F81F;
+    uint32_t d = t | (t << 11) | (t << 21);
+    uint32_t w = (wa + (((wb - wa) * alpha + d) >> 5)) & 0x07E0F81F;
+
+    return (uint16_t)(w | (w >> 16));
+}
+
+static OPENDOTT_RAMFUNC void blend_row(uint16_t *out, const uint8_t *from,
+                                       const uint16_t *from_lut, const uint8_t *to,
+                                       const uint16_t *to_lut, uint16_t count,
+                                       uint32_t alpha, uint16_t y)
+{
+    const uint8_t *th = color_dither_thresholds(y);
+
+    for (uint16_t x = 0; x < count; x++) {
+        uint16_t a = sys_be16_to_cpu(from_lut[from[x]]);
+        uint16_t b = sys_be16_to_cpu(to_lut[to[x]]);
+
+        out[x] = sys_cpu_to_be16(blend565(a, b, alpha, th[x & 3] * 2 + 1));
+    }
+}
+
+static uint32_t isqrt(uint32_t n)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > n) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/* Incoming pixels in [START, END) of the row, outgoing either side */
+static void split_row(uint16_t *out, const uint8_t *from, const uint8_t *to,
+                      uint16_t start, uint16_t end)
+{
+    lut_row(out, from, tr.from_lut, start);
+    lut_row(out + start, to + start, tr.to_lut, end - start);
+    lut_row(out + end, from + end, tr.from_lut, DISPLAY_WIDTH - end);
+}
+
+static void compose_row(uint16_t *out, const uint8_t *from, const uint8_t *to, uint16_t y)
+{
+    if (tr.progress >= TRANSITION_ONE) {
+        lut_row(out, to, tr.to_lut, DISPLAY_WIDTH);
+        return;
+    }
+
+    switch (effect) {
+    case TRANSITION_CROSSFADE:
+        blend_row(out, from, tr.from_lut, to, tr.to_lut, DISPLAY_WIDTH, tr.progress >> 3, y);
+        break;
+    case TRANSITION_WIPE:
+        split_row(out, from, to, 0, (uint32_t)DISPLAY_WIDTH * tr.progress / TRANSITION_ONE);
+        break;
+    case TRANSITION_IRIS: {
+        /* In half pixels, so the circle is centred between the middle rows */
+        int32_t r2 = 2 * TRANSITION_IRIS_RADIUS * tr.progress / TRANSITION_ONE;
+        int32_t dy2 = 2 * y + 1 - DISPLAY_HEIGHT;
+        uint16_t half = 0;
+
+        if (dy2 * dy2 < r2 * r2) {
+            half = (isqrt(r2 * r2 - dy2 * dy2) + 1) / 2;
+        }
+        half = MIN(half, DISPLAY_WIDTH / 2);
+        split_row(out, from, to, DISPLAY_WIDTH / 2 - half, DISPLAY_WIDTH / 2 + half);
+        break;
+    }
+    default:
+        lut_row(out, to, tr.to_lut, DISPLAY_WIDTH);
+        break;
+    }
+}
+
+/*
+ * Media decoder: frame N is step N of the transition.
+ */
+
+static int tr_open(struct media_source *src, struct media_info *info, k_timeout_t timeout)
+{
+    info->width = DISPLAY_WIDTH;
+    info->height = DISPLAY_HEIGHT;
+    info->frame_count = tr.steps;
+    info->loop_count = 1;
+    return 0;
+}
+
+static int tr_decode_frame(uint16_t index, uint16_t *delay_ms)
+{
+    /* The last step is all incoming frame */
+    tr.progress = (uint32_t)(index + 1) * TRANSITION_ONE / tr.steps;
+    *delay_ms = TRANSITION_STEP_MS;
+    return 0;
+}
+
+static int tr_read_strip(struct media_strip *strip)
+{
+    size_t len = (size_t)strip->lines * DISPLAY_WIDTH;
+    size_t row = (size_t)strip->y * DISPLAY_WIDTH;
+    const uint8_t *from;
+
+    ssize_t ret = media_source_read(&to_src, tr.to_pixels + row, to_rows, len);
+    if (ret != len) {
+        return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+    }
+
+    if (tr.from_canvas) {
+        from = tr.from_canvas + row;
+    } else {
+        /* Outgoing indexes go in the back half of the output strip: pixel
+         * N is written over bytes 2N and 2N+1, never past an index that
+         * is still to be read */
+        uint8_t *back = (uint8_t *)strip->pixels + len;
+
+        ret = media_source_read(&from_src, tr.from_pixels + row, back, len);
+        if (ret != len) {
+            return ret < 0 ? ret : OPENDOTT_ERR_CORRUPT;
+        }
+        from = back;
+    }
+
+    for (uint16_t line = 0; line < strip->lines; line++) {
+        size_t offset = (size_t)line * DISPLAY_WIDTH;
+
+        compose_row(strip->pixels + offset, from + offset, to_rows + offset,
+                    strip->y + line);
+    }
+    return 0;
+}
+
+static void tr_close(void)
+{
+}
+
+static const struct media_decoder_api media_decoder_transition = {
+    .name = "transition",
+    .open = tr_open,
+    .decode_frame = tr_decode_frame,
+    .read_strip = tr_read_strip,
+    .close = tr_close,
+};
+
+static void record_stats(uint32_t elapsed_ms)
+{
+    const struct media_stage_stats *convert = &pipeline.stats[MEDIA_STAGE_CONVERT];
+    uint32_t steps = MAX(pipeline.stats[MEDIA_STAGE_DECODE].count, 1);
+    uint32_t read_us = to_src.read_us + from_src.read_us;
+
+    last.effect = effect;
+    last.steps = pipeline.stats[MEDIA_STAGE_DECODE].count;
+    last.elapsed_ms = elapsed_ms;
+    last.compose_us = (convert->total_us - MIN(convert->total_us, read_us)) / steps;
+    last.read_us = read_us / steps;
+    last.sink_us = pipeline.stats[MEDIA_STAGE_SINK].total_us / steps;
+
+    LOG_INF("%s: %u steps in %u ms (%u fps), per step: compose %u us, "
+            "flash %u us, SPI %u us", effect_names[effect], last.steps, elapsed_ms,
+            elapsed_ms ? last.steps * 1000 / elapsed_ms : 0, last.compose_us,
+            last.read_us, last.sink_us);
+}
+
+/* Replace the frame on the panel with frame 0 of TO. FROM is what the panel
+ * shows now: another frame 0, or NULL for the frame in the GIF decoder,
+ * which the caller keeps open until this returns. Ends on TO even when
+ * cut; -ECANCELED if transition_stop() ended it early */
+int transition_run(const struct predecode_first *from, const struct predecode_first *to)
+{
+    if (effect == TRANSITION_CUT || duration_ms < TRANSITION_STEP_MS) {
+        return -ENOTSUP;
+    }
+
+    memset(&tr, 0, sizeof(tr));
+    memset(&from_src, 0, sizeof(from_src));
+    tr.steps = duration_ms / TRANSITION_STEP_MS;
+    tr.to_lut = to->lut;
+
+    int ret = predecode_first_source(to, &to_src, &tr.to_pixels);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (from) {
+        ret = predecode_first_source(from, &from_src, &tr.from_pixels);
+        tr.from_lut = from->lut;
+    } else {
+        tr.from_canvas = gif_decoder_canvas();
+        tr.from_lut = gif_decoder_lut();
+    }
+    if (ret < 0) {
+        media_source_close(&to_src);
+        return ret;
+    }
+
+    media_sink_panel_init(&panel);
+    ret = media_pipeline_open_decoder(&pipeline, &to_src, &media_decoder_transition,
+                                      &panel, TRANSITION_OPEN_TIMEOUT);
+    if (ret == 0) {
+        int64_t start = k_uptime_get();
+
+        ret = media_pipeline_play(&pipeline, 1);
+        if (ret == 0 && pipeline.stop) {
+            ret = -ECANCELED;
+        }
+        record_stats(k_uptime_get() - start);
+        media_pipeline_close(&pipeline);
+    }
+
+    media_source_close(&from_src);
+    media_source_close(&to_src);
+    return ret;
+}
+
+/* End a transition in progress after its current step */
+void transition_stop(void)
+{
+    media_pipeline_stop(&pipeline);
+}
+
+/* Use NEW_EFFECT for the next switches and remember it */
+int transition_set(enum transition_effect new_effect, uint16_t new_duration_ms)
+{
+    if (new_effect >= TRANSITION_COUNT) {
+        return -EINVAL;
+    }
+
+    effect = new_effect;
+    duration_ms = MIN(new_duration_ms, TRANSITION_MAX_MS);
+
+    struct transition_record rec = {
+        .magic = TRANSITION_SETTINGS_MAGIC,
+        .effect = effect,
+        .duration_ms = duration_ms,
+    };
+    struct fs_file_t file;
+
+    int ret = storage_meta_open(TRANSITION_SETTINGS_NAME, TRANSITION_SETTINGS_EXT, true, &file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = storage_file_write(&file, 0, &rec, sizeof(rec));
+    storage_file_close(&file);
+    return ret < 0 ? ret : 0;
+}
+
+void transition_get(enum transition_effect *out_effect, uint16_t *out_duration_ms)
+{
+    *out_effect = effect;
+    *out_duration_ms = duration_ms;
+}
+
+/* Load the saved effect; call once storage is up */
+int transition_init(void)
+{
+    struct transition_record rec;
+
+    int ret = storage_meta_read(TRANSITION_SETTINGS_NAME, TRANSITION_SETTINGS_EXT, 0,
+                                &rec, sizeof(rec));
+    if (ret != sizeof(rec) || rec.magic != TRANSITION_SETTINGS_MAGIC ||
+        rec.effect >= TRANSITION_COUNT) {
+        return 0;
+    }
+
+    effect = rec.effect;
+    duration_ms = MIN(rec.duration_ms, TRANSITION_MAX_MS);
+    return 0;
+}
+
+void transition_get_stats(struct transition_stats *stats)
+{
+    *stats = last;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_transition_set(const struct shell *sh, size_t argc, char **argv)
+{
+    for (int i = 0; i < TRANSITION_COUNT; i++) {
+        if (strcmp(argv[1], effect_names[i]) == 0) {
+            int ret = transition_set(i, argc > 2 ? strtoul(argv[2], NULL, 0) : duration_ms);
+            if (ret < 0) {
+                shell_error(sh, "Applied, but not saved: %d", ret);
+            }
+            shell_print(sh, "Transition: %s, %u ms", effect_names[effect], duration_ms);
+            return 0;
+        }
+    }
+
+    shell_error(sh, "Unknown transition: %s", argv[1]);
+    return -EINVAL;
+}
+
+static int cmd_transition_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    shell_print(sh, "Transition: %s, %u ms (%u steps of %u ms)", effect_names[effect],
+                duration_ms, duration_ms / TRANSITION_STEP_MS, TRANSITION_STEP_MS);
+
+    if (last.steps == 0) {
+        shell_print(sh, "No transition run yet");
+        return 0;
+    }
+
+    shell_print(sh, "Last %s: %u steps in %u ms, %u fps", effect_names[last.effect],
+                last.steps, last.elapsed_ms,
+                last.elapsed_ms ? last.steps * 1000 / last.elapsed_ms : 0);
+    shell_print(sh, "  per step: compose %u us, flash %u us, SPI %u us",
+                last.compose_us, last.read_us, last.sink_us);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(transition_cmds,
+    SHELL_CMD_ARG(set, NULL, "Set the effect: set <cut|crossfade|wipe|iris> [ms]",
+                  cmd_transition_set, 2, 1),
+    SHELL_CMD(stats, NULL, "Show the effect and the cost of the last run",
+              cmd_transition_stats),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(transition, &transition_cmds, "Slot transitions", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,202 @@
+/*
+ * OpenDOTT - Button Gesture Tests
+ * SPDX-License-Identifier: MIT
+ *
+ * Drives the sw0 pin on the emulated GPIO controller and checks the events
+ * button.c reports: debouncing, taps, holds and their releases. Timings
+ * stay well clear of the thresholds in button.c (5 ms debounce, 250 ms tap
+ * gap and repeat, 500 ms hold, 3 s long hold).
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+
+#include "opendott.h"
+
+#define MAX_EVENTS  32
+#define SETTLE_MS   400         /* Past the tap gap: any sequence has ended */
+
+static const struct gpio_dt_spec sw0 = GPIO_DT_SPEC_GET(DT_ALIAS(sw0), gpios);
+
+static struct {
+    button_event_t list[MAX_EVENTS];
+    uint8_t count;
+} events;
+
+static void on_event(button_event_t event)
+{
+    if (events.count < MAX_EVENTS) {
+        events.list[events.count++] = event;
+    }
+}
+
+/* Set the contact, then let MS pass. The button is active low */
+static void contact(bool closed, int32_t ms)
+{
+    zassert_ok(gpio_emul_input_set(sw0.port, sw0.pin, closed ? 0 : 1));
+    k_msleep(ms);
+}
+
+static void tap(void)
+{
+    contact(true, 40);
+    contact(false, 80);
+}
+
+static void expect(const button_event_t *want, uint8_t count)
+{
+    zassert_equal(events.count, count, "%u events, want %u", events.count, count);
+    for (uint8_t i = 0; i < count; i++) {
+        zassert_equal(events.list[i], want[i], "event %u: %u, want %u", i, events.list[i],
+                      want[i]);
+    }
+}
+
+static void *button_setup(void)
+{
+    /* The emulator only drives pins configured as inputs */
+    zassert_ok(button_init(on_event));
+    zassert_ok(gpio_emul_input_set(sw0.port, sw0.pin, 1));
+    return NULL;
+}
+
+static void button_before(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    contact(false, SETTLE_MS);
+    events.count = 0;
+}
+
+ZTEST(button, test_short_press)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_SHORT_PRESS,
+    };
+
+    tap();
+
+    /* Reported once no second tap can follow */
+    zassert_equal(events.count, 2);
+    k_msleep(SETTLE_MS);
+    expect(want, ARRAY_SIZE(want));
+}
+
+ZTEST(button, test_double_tap)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_DOWN, BUTTON_EVENT_UP,
+        BUTTON_EVENT_DOUBLE_TAP,
+    };
+
+    tap();
+    tap();
+    k_msleep(SETTLE_MS);
+    expect(want, ARRAY_SIZE(want));
+}
+
+ZTEST(button, test_triple_tap)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_DOWN, BUTTON_EVENT_UP,
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_TRIPLE_TAP,
+    };
+
+    tap();
+    tap();
+    contact(true, 40);
+    contact(false, 20);
+
+    /* The third tap ends the sequence at once */
+    expect(want, ARRAY_SIZE(want));
+}
+
+/* Taps further apart than the gap are separate presses */
+ZTEST(button, test_tap_gap)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_SHORT_PRESS,
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_SHORT_PRESS,
+    };
+
+    tap();
+    k_msleep(SETTLE_MS);
+    tap();
+    k_msleep(SETTLE_MS);
+    expect(want, ARRAY_SIZE(want));
+}
+
+ZTEST(button, test_medium_press)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_HOLD, BUTTON_EVENT_HOLD_REPEAT,
+        BUTTON_EVENT_UP, BUTTON_EVENT_MEDIUM_PRESS,
+    };
+
+    contact(true, 880);
+    contact(false, SETTLE_MS);
+    expect(want, ARRAY_SIZE(want));
+}
+
+ZTEST(button, test_long_press)
+{
+    uint8_t repeats = 0;
+
+    contact(true, 3120);
+    contact(false, SETTLE_MS);
+
+    zassert_true(events.count > 5);
+    zassert_equal(events.list[0], BUTTON_EVENT_DOWN);
+    zassert_equal(events.list[1], BUTTON_EVENT_HOLD);
+    while (events.list[2 + repeats] == BUTTON_EVENT_HOLD_REPEAT) {
+        repeats++;
+    }
+
+    /* Every 250 ms from 750 ms, until LONG_HOLD takes the 3 s slot */
+    zassert_equal(repeats, 9, "%u repeats", repeats);
+    zassert_equal(events.list[2 + repeats], BUTTON_EVENT_LONG_HOLD);
+    zassert_equal(events.count, 2 + repeats + 3);
+    zassert_equal(events.list[events.count - 2], BUTTON_EVENT_UP);
+    zassert_equal(events.list[events.count - 1], BUTTON_EVENT_LONG_PRESS);
+}
+
+/* A tap followed by a hold reports the tap when the hold starts */
+ZTEST(button, test_tap_then_hold)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_DOWN, BUTTON_EVENT_SHORT_PRESS,
+        BUTTON_EVENT_HOLD, BUTTON_EVENT_UP, BUTTON_EVENT_MEDIUM_PRESS,
+    };
+
+    tap();
+    contact(true, 600);
+    contact(false, SETTLE_MS);
+    expect(want, ARRAY_SIZE(want));
+}
+
+/* Edges inside the lockout are ignored; the level is sampled after it */
+ZTEST(button, test_bounce)
+{
+    static const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_SHORT_PRESS,
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_SHORT_PRESS,
+    };
+
+    /* Chatter on press and on release: one tap */
+    contact(true, 1);
+    contact(false, 1);
+    contact(true, 40);
+    contact(false, 1);
+    contact(true, 1);
+    contact(false, SETTLE_MS);
+
+    /* A glitch shorter than the lockout is still a press, reported on
+     * contact; the release is caught when the lockout ends */
+    contact(true, 1);
+    contact(false, SETTLE_MS);
+
+    expect(want, ARRAY_SIZE(want));
+}
+
+ZTEST_SUITE(button, NULL, button_setup, button_before, NULL, NULL);
@@ -0,0 +1,190 @@
+/*
+ * OpenDOTT - Color Correction Tests
+ * SPDX-License-Identifier: MIT
+ *
+ * The fixed-point log2/exp2 behind gamma against libm, the corrected
+ * curves against pow(), RGB565 conversion and its residuals, and the
+ * ordered dither. color.c is included for its static helpers.
+ */
+
+#include <zephyr/ztest.h>
+#include <math.h>
+
+#include "color.c"
+
+/* Q16 units; the LUT only needs 8 bits out */
+#define LOG2_TOLERANCE  4
+#define EXP2_TOLERANCE  16
+
+static void set_profile(uint16_t gamma_x100, uint8_t gain_r, uint8_t gain_g, uint8_t gain_b)
+{
+    struct color_profile p = {
+        .gamma_x100 = gamma_x100,
+        .gain = { gain_r, gain_g, gain_b },
+        .saturation = 100,
+    };
+
+    zassert_ok(color_set_profile(&p));
+}
+
+static void *color_setup(void)
+{
+    zassert_ok(storage_init());
+    zassert_ok(color_init());
+    return NULL;
+}
+
+static void color_after(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    zassert_ok(color_set_profile(&identity));
+}
+
+ZTEST(color, test_log2_q16)
+{
+    for (uint32_t x = 1; x <= 65536; x++) {
+        int32_t want = lround(log2(x / 65536.0) * 65536);
+
+        zassert_within(log2_q16(x), want, LOG2_TOLERANCE, "log2(%u): %d, want %d", x,
+                       log2_q16(x), want);
+    }
+}
+
+ZTEST(color, test_exp2_q16)
+{
+    for (int32_t y = -16 * 65536; y <= 0; y += 3) {
+        int32_t want = lround(exp2(y / 65536.0) * 65536);
+
+        zassert_within((int32_t)exp2_q16(y), want, EXP2_TOLERANCE, "exp2(%d): %u, want %d",
+                       y, exp2_q16(y), want);
+    }
+
+    zassert_equal(exp2_q16(0), 65536);
+    zassert_equal(exp2_q16(-32 * 65536), 0);
+}
+
+ZTEST(color, test_gamma_curves)
+{
+    static const uint16_t gammas[] = { 25, 45, 180, 220, 300, 400 };
+
+    for (int i = 0; i < ARRAY_SIZE(gammas); i++) {
+        set_profile(gammas[i], 100, 100, 100);
+        zassert_not_equal(color_profile_id(), 0);
+
+        for (int v = 0; v < 256; v++) {
+            int want = lround(255 * pow(v / 255.0, gammas[i] / 100.0));
+
+            for (int ch = 0; ch < 3; ch++) {
+                zassert_within(curve[ch][v], want, 1, "gamma %u, %d: %u, want %d",
+                               gammas[i], v, curve[ch][v], want);
+            }
+        }
+        zassert_equal(curve[0][0], 0);
+        zassert_equal(curve[0][255], 255);
+    }
+
+    /* Gains scale after gamma and clip at full scale */
+    set_profile(220, 50, 100, 150);
+    for (int v = 0; v < 256; v++) {
+        zassert_equal(curve[0][v], curve[1][v] * 50 / 100);
+        zassert_equal(curve[2][v], MIN(curve[1][v] * 150 / 100, 255));
+    }
+}
+
+ZTEST(color, test_profile_limits)
+{
+    struct color_profile p = identity;
+
+    p.gamma_x100 = COLOR_GAMMA_MIN - 1;
+    zassert_equal(color_set_profile(&p), -EINVAL);
+    p.gamma_x100 = COLOR_GAMMA_MAX + 1;
+    zassert_equal(color_set_profile(&p), -EINVAL);
+    zassert_equal(color_profile_id(), 0);
+
+    set_profile(180, 100, 100, 100);
+    uint16_t id = color_profile_id();
+
+    set_profile(180, 100, 100, 99);
+    zassert_not_equal(color_profile_id(), id);
+    zassert_ok(color_set_profile(&identity));
+    zassert_equal(color_profile_id(), 0);
+}
+
+ZTEST(color, test_identity_rgb565)
+{
+    for (int v = 0; v < 256; v++) {
+        uint8_t res;
+
+        zassert_equal(color_to_rgb565(v, 0, 0, &res), (v & 0xF8) << 8);
+        zassert_equal(res, v < 0xF8 ? (v & 7) << 5 : 0, "red %d", v);
+        zassert_equal(color_to_rgb565(0, v, 0, &res), (v & 0xFC) << 3);
+        zassert_equal(res, v < 0xFC ? (v & 3) << 3 : 0, "green %d", v);
+        zassert_equal(color_to_rgb565(0, 0, v, &res), v >> 3);
+        zassert_equal(res, v < 0xF8 ? v & 7 : 0, "blue %d", v);
+    }
+
+    uint16_t px = sys_cpu_to_be16(0x1234);
+
+    color_correct_rgb565(&px, 1);
+    zassert_equal(px, sys_cpu_to_be16(0x1234));
+}
+
+ZTEST(color, test_dither_thresholds)
+{
+    uint32_t seen = 0;
+
+    for (uint16_t y = 0; y < 4; y++) {
+        const uint8_t *t = color_dither_thresholds(y);
+
+        zassert_mem_equal(t, color_dither_thresholds(y + 4), 4);
+        for (int x = 0; x < 4; x++) {
+            zassert_true(t[x] < 16);
+            seen |= BIT(t[x]);
+        }
+    }
+
+    /* Each threshold once per 4x4 tile */
+    zassert_equal(seen, 0xFFFF);
+}
+
+/* Over a 4x4 tile, each channel rounds up in proportion to its residual */
+ZTEST(color, test_dither_mean)
+{
+    static const uint8_t rgb[][3] = {
+        { 0x45, 0x86, 0x23 }, { 0x07, 0x03, 0x01 }, { 0x40, 0x80, 0x20 }, { 0xF7, 0xFB, 0xF7 },
+    };
+    uint16_t lut[ARRAY_SIZE(rgb)];
+    uint8_t res[ARRAY_SIZE(rgb)];
+
+    for (int i = 0; i < ARRAY_SIZE(rgb); i++) {
+        lut[i] = sys_cpu_to_be16(color_to_rgb565(rgb[i][0], rgb[i][1], rgb[i][2], &res[i]));
+    }
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(rgb); i++) {
+        uint8_t idx[4] = { i, i, i, i };
+        uint16_t base = sys_be16_to_cpu(lut[i]);
+        uint32_t up_r = 0, up_g = 0, up_b = 0;
+
+        for (uint16_t y = 0; y < 4; y++) {
+            uint16_t out[4];
+
+            color_dither_row(out, idx, lut, res, ARRAY_SIZE(out), y);
+            for (int x = 0; x < 4; x++) {
+                uint16_t c = sys_be16_to_cpu(out[x]);
+
+                up_r += (c >> 11) - (base >> 11);
+                up_g += ((c >> 5) & 0x3F) - ((base >> 5) & 0x3F);
+                up_b += (c & 0x1F) - (base & 0x1F);
+            }
+        }
+
+        /* Sixteenths of a step: red and blue residuals are eighths, green
+         * quarters */
+        zassert_equal(up_r, (rgb[i][0] & 7) * 2, "color %u red", i);
+        zassert_equal(up_g, (rgb[i][1] & 3) * 4, "color %u green", i);
+        zassert_equal(up_b, (rgb[i][2] & 7) * 2, "color %u blue", i);
+    }
+}
+
+ZTEST_SUITE(color, NULL, color_setup, NULL, color_after, NULL);
@@ -0,0 +1,347 @@
+/*
+ * OpenDOTT - GIF Decoder Tests
+ * SPDX-License-Identifier: MIT
+ *
+ * LZW decoding of a small GIF from a reference encoder, and the frame
+ * index built from GIFs assembled here: offsets, timing, disposal, and
+ * which files count as stills.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "opendott.h"
+
+#define SCREEN     16
+#define SCREEN_X0  ((DISPLAY_WIDTH - SCREEN) / 2)
+#define SCREEN_Y0  ((DISPLAY_HEIGHT - SCREEN) / 2)
+
+static const uint8_t palette[4][3] = {
+    { 0, 0, 0 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 },
+};
+
+/* 16x16 over palette[], pixels as in lzw_pixel(), LZW minimum code size 2.
+ * Codes grow to 7 bits and include the code-not-yet-in-table case */
+static const uint8_t lzw_gif[] = {
+    0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x10, 0x00, 0x10, 0x00, 0x81, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00,
+    0xff, 0x2c, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x10, 0x00, 0x00, 0x02,
+    0x39, 0x8c, 0x8f, 0xa9, 0xcb, 0xed, 0x0d, 0x86, 0x30, 0x62, 0x80, 0x19,
+    0x6d, 0x98, 0x15, 0xc4, 0xa9, 0x09, 0x98, 0x14, 0x64, 0xc0, 0xf6, 0x51,
+    0x56, 0x38, 0x6e, 0x56, 0x9a, 0xba, 0x57, 0x39, 0x84, 0x72, 0xca, 0xd2,
+    0x63, 0x18, 0x77, 0x79, 0x74, 0x23, 0xf5, 0x2c, 0xbb, 0x13, 0xe7, 0x45,
+    0xfa, 0x09, 0x6b, 0xc6, 0x61, 0xc4, 0xd8, 0xea, 0xa4, 0x0a, 0x00, 0x3b,
+};
+
+static uint8_t lzw_pixel(int x, int y)
+{
+    return y < 4 ? 1 : ((x * 3) ^ (y * 5) ^ (x >> 2)) & 3;
+}
+
+/* GIF assembly. Frame data is LZW with only literal codes: a clear code
+ * every two pixels keeps codes at 3 bits */
+static struct {
+    uint8_t buf[1024];
+    size_t len;
+    uint32_t offsets[4];
+    uint8_t frames;
+    uint32_t bits;
+    uint8_t bit_count;
+    size_t block;               /* Length byte of the open data sub-block */
+} gif;
+
+struct frame_spec {
+    uint16_t x, y, w, h;
+    uint8_t disposal;
+    uint16_t delay_cs;
+    bool transparent;
+};
+
+static void gif_put(const void *data, size_t len)
+{
+    __ASSERT_NO_MSG(gif.len + len <= sizeof(gif.buf));
+    memcpy(&gif.buf[gif.len], data, len);
+    gif.len += len;
+}
+
+static void gif_put_u8(uint8_t b)
+{
+    gif_put(&b, 1);
+}
+
+static void gif_put_le16(uint16_t v)
+{
+    uint8_t b[2];
+
+    sys_put_le16(v, b);
+    gif_put(b, sizeof(b));
+}
+
+static void gif_begin(bool loop)
+{
+    gif.len = 0;
+    gif.frames = 0;
+
+    gif_put("GIF89a", 6);
+    gif_put_le16(SCREEN);
+    gif_put_le16(SCREEN);
+    gif_put_u8(0x81);           /* Global color table, 4 entries */
+    gif_put_u8(0);              /* Background index */
+    gif_put_u8(0);
+    gif_put(palette, sizeof(palette));
+
+    if (loop) {
+        gif_put("\x21\xff\x0b" "NETSCAPE2.0" "\x03\x01", 16);
+        gif_put_le16(3);
+        gif_put_u8(0);
+    }
+}
+
+static void lzw_put_code(uint8_t code)
+{
+    gif.bits |= code << gif.bit_count;
+    gif.bit_count += 3;
+
+    while (gif.bit_count >= 8) {
+        if (gif.buf[gif.block] == 255) {
+            gif.block = gif.len;
+            gif_put_u8(0);
+        }
+        gif_put_u8(gif.bits & 0xFF);
+        gif.buf[gif.block]++;
+        gif.bits >>= 8;
+        gif.bit_count -= 8;
+    }
+}
+
+static void gif_frame(const struct frame_spec *f, uint8_t color)
+{
+    gif_put("\x21\xf9\x04", 3);
+    gif_put_u8((f->disposal << 2) | (f->transparent ? 1 : 0));
+    gif_put_le16(f->delay_cs);
+    gif_put_u8(f->transparent ? 3 : 0);
+    gif_put_u8(0);
+
+    gif.offsets[gif.frames++] = gif.len;
+    gif_put_u8(0x2C);
+    gif_put_le16(f->x);
+    gif_put_le16(f->y);
+    gif_put_le16(f->w);
+    gif_put_le16(f->h);
+    gif_put_u8(0);
+
+    gif_put_u8(2);              /* LZW minimum code size */
+    gif.bits = 0;
+    gif.bit_count = 0;
+    gif.block = gif.len;
+    gif_put_u8(0);
+
+    for (uint32_t i = 0; i < (uint32_t)f->w * f->h; i++) {
+        if (i % 2 == 0) {
+            lzw_put_code(4);
+        }
+        lzw_put_code(color);
+    }
+    lzw_put_code(5);
+    lzw_put_code(0);            /* Flush the last bits */
+    if (gif.buf[gif.block] == 0) {
+        gif.len--;
+    }
+    gif_put_u8(0);
+}
+
+static void gif_end(void)
+{
+    gif_put_u8(0x3B);
+}
+
+static const struct gif_info *open_mem(struct media_source *src, const uint8_t *data,
+                                       size_t len)
+{
+    if (media_source_mem_init(src, data, len) < 0 ||
+        gif_decoder_open_source(src, K_NO_WAIT) < 0) {
+        return NULL;
+    }
+    return gif_decoder_info();
+}
+
+/* The panel color of canvas pixel (X, Y) of the logical screen */
+static uint16_t screen_pixel(int x, int y)
+{
+    const uint8_t *canvas = gif_decoder_canvas();
+
+    return gif_decoder_lut()[canvas[(SCREEN_Y0 + y) * DISPLAY_WIDTH + SCREEN_X0 + x]];
+}
+
+static uint16_t palette_color(uint8_t i)
+{
+    return sys_cpu_to_be16(color_to_rgb565(palette[i][0], palette[i][1], palette[i][2],
+                                           NULL));
+}
+
+static void *gif_setup(void)
+{
+    zassert_ok(storage_init());
+    return NULL;
+}
+
+ZTEST(gif, test_lzw_decode)
+{
+    struct media_source src;
+    const struct gif_info *info = open_mem(&src, lzw_gif, sizeof(lzw_gif));
+
+    zassert_not_null(info);
+    zassert_equal(info->width, SCREEN);
+    zassert_equal(info->height, SCREEN);
+    zassert_equal(info->frame_count, 1);
+    zassert_ok(gif_decoder_decode(0));
+
+    for (int y = 0; y < SCREEN; y++) {
+        for (int x = 0; x < SCREEN; x++) {
+            zassert_equal(screen_pixel(x, y), palette_color(lzw_pixel(x, y)),
+                          "pixel %d,%d", x, y);
+        }
+    }
+
+    /* Around the logical screen is the background color */
+    zassert_equal(screen_pixel(-1, 0), palette_color(0));
+    zassert_equal(screen_pixel(SCREEN, SCREEN - 1), palette_color(0));
+
+    gif_decoder_close();
+}
+
+ZTEST(gif, test_index_frames)
+{
+    static const struct frame_spec frames[] = {
+        { .x = 0, .y = 0, .w = SCREEN, .h = SCREEN, .disposal = 1, .delay_cs = 5 },
+        { .x = 2, .y = 3, .w = 4, .h = 5, .disposal = 2, .delay_cs = 0,
+          .transparent = true },
+        { .x = 15, .y = 15, .w = 1, .h = 1, .disposal = 1, .delay_cs = 1 },
+    };
+    static const uint16_t delay_ms[] = { 50, 100, 100 };
+    struct media_source src;
+    struct gif_frame_info frame;
+
+    gif_begin(true);
+    for (int i = 0; i < ARRAY_SIZE(frames); i++) {
+        gif_frame(&frames[i], i + 1);
+    }
+    gif_end();
+
+    const struct gif_info *info = open_mem(&src, gif.buf, gif.len);
+
+    zassert_not_null(info);
+    zassert_equal(info->frame_count, ARRAY_SIZE(frames));
+    zassert_equal(info->loop_count, 3);
+
+    for (int i = 0; i < ARRAY_SIZE(frames); i++) {
+        zassert_ok(gif_decoder_frame_info(i, &frame));
+        zassert_equal(frame.offset, gif.offsets[i], "frame %d", i);
+        zassert_equal(frame.x, frames[i].x);
+        zassert_equal(frame.y, frames[i].y);
+        zassert_equal(frame.w, frames[i].w);
+        zassert_equal(frame.h, frames[i].h);
+        zassert_equal(frame.delay_ms, delay_ms[i], "frame %d", i);
+        zassert_equal(frame.disposal, frames[i].disposal);
+        zassert_equal(frame.lct_bits, 0);
+    }
+    zassert_not_equal(gif_decoder_frame_info(ARRAY_SIZE(frames), &frame), 0);
+
+    zassert_ok(gif_decoder_frame_info(1, &frame));
+    zassert_equal(frame.transparent, 3);
+    zassert_not_equal(frame.flags, 0);
+
+    /* Frame 1 draws over frame 0, then is cleared to the background */
+    zassert_ok(gif_decoder_decode(0));
+    zassert_ok(gif_decoder_decode(1));
+    zassert_equal(screen_pixel(2, 3), palette_color(2));
+    zassert_equal(screen_pixel(5, 7), palette_color(2));
+    zassert_equal(screen_pixel(6, 7), palette_color(1));
+    zassert_ok(gif_decoder_decode(2));
+    zassert_equal(screen_pixel(2, 3), palette_color(0));
+    zassert_equal(screen_pixel(15, 15), palette_color(3));
+    zassert_equal(gif_decoder_position(), 3);
+
+    gif_decoder_close();
+}
+
+ZTEST(gif, test_still_detection)
+{
+    static const struct {
+        const char *what;
+        uint8_t first_disposal;
+        struct frame_spec later[2];
+        uint8_t later_count;
+        uint16_t frame_count;
+    } cases[] = {
+        { "empty", 1, { { .w = 0, .h = 0 } }, 1, 1 },
+        { "right of the panel", 1, { { .x = 200, .w = 4, .h = 4 } }, 1, 1 },
+        { "below the panel", 1, { { .y = 130, .w = 4, .h = 4 } }, 1, 1 },
+        { "two empty", 1, { { .w = 0, .h = 0 }, { .x = 0, .y = 0 } }, 2, 1 },
+        { "partly on the panel", 1, { { .x = 120, .w = 16, .h = 1 } }, 1, 2 },
+        { "visible pixel", 1, { { .x = 8, .y = 8, .w = 1, .h = 1 } }, 1, 2 },
+        { "first cleared", 2, { { .x = 200, .w = 4, .h = 4 } }, 1, 2 },
+        { "visible then empty", 1,
+          { { .x = 1, .y = 1, .w = 2, .h = 2 }, { .w = 0, .h = 0 } }, 2, 3 },
+    };
+    struct media_source src;
+    struct gif_frame_info frame;
+
+    for (int i = 0; i < ARRAY_SIZE(cases); i++) {
+        struct frame_spec first = {
+            .w = SCREEN, .h = SCREEN, .disposal = cases[i].first_disposal,
+        };
+
+        gif_begin(false);
+        gif_frame(&first, 1);
+        for (int k = 0; k < cases[i].later_count; k++) {
+            gif_frame(&cases[i].later[k], 2);
+        }
+        gif_end();
+
+        const struct gif_info *info = open_mem(&src, gif.buf, gif.len);
+
+        zassert_not_null(info, "%s", cases[i].what);
+        zassert_equal(info->frame_count, cases[i].frame_count, "%s: %u frames",
+                      cases[i].what, info->frame_count);
+
+        /* A still's later frames are indexed, just never played */
+        zassert_ok(gif_decoder_frame_info(cases[i].later_count, &frame), "%s",
+                   cases[i].what);
+        gif_decoder_close();
+    }
+}
+
+/* A stored file's index is written once and read back on the next open */
+ZTEST(gif, test_index_stored)
+{
+    static const struct frame_spec frames[] = {
+        { .w = SCREEN, .h = SCREEN, .delay_cs = 10 },
+        { .x = 4, .y = 4, .w = 2, .h = 2, .delay_cs = 20 },
+    };
+    struct gif_frame_info frame;
+    uint32_t magic;
+
+    gif_begin(false);
+    gif_frame(&frames[0], 1);
+    gif_frame(&frames[1], 3);
+    gif_end();
+
+    zassert_ok(storage_save_image(gif.buf, gif.len, "index.gif"));
+
+    for (int open = 0; open < 2; open++) {
+        zassert_ok(gif_decoder_open("index.gif", K_NO_WAIT));
+        zassert_equal(gif_decoder_info()->frame_count, 2);
+        zassert_ok(gif_decoder_frame_info(1, &frame));
+        zassert_equal(frame.offset, gif.offsets[1]);
+        zassert_equal(frame.delay_ms, 200);
+        gif_decoder_close();
+
+        zassert_equal(storage_meta_read("index.gif", "idx", 0, &magic, sizeof(magic)),
+                      sizeof(magic));
+    }
+
+    zassert_ok(storage_delete_image("index.gif"));
+}
+
+ZTEST_SUITE(gif, NULL, gif_setup, NULL, NULL, NULL);
@@ -0,0 +1,186 @@
+/*
+ * OpenDOTT - Late Frame Dump Tests
+ * SPDX-License-Identifier: MIT
+ *
+ * The media_late_dump() layout read by the app (docs/PROTOCOL.md, command
+ * 0x16), the ring behind it, and late frames recorded by real playback
+ * through a sink that is slow on purpose. media_pipeline.c is included
+ * for late_record().
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "media_pipeline.c"
+
+#define DUMP_HEADER     10
+#define DUMP_PER_FRAME  26
+#define DUMP_MAX        (DUMP_HEADER + MEDIA_LATE_FRAMES * DUMP_PER_FRAME)
+
+#define SLOW_SINK_MS    600     /* Longer than any frame delay in the fixture */
+
+static const uint8_t test_gif[] = {
+#include "test_image.gif.inc"
+};
+
+static uint8_t dump[DUMP_MAX];
+
+/* Record a late frame whose stage times are derived from N */
+static void record(uint16_t n, int64_t late_ms)
+{
+    struct media_pipeline p = { 0 };
+
+    p.frame_read_us = 1000 + n;
+    p.frame_us[MEDIA_STAGE_DECODE] = 3000 + n;
+    p.frame_us[MEDIA_STAGE_CONVERT] = 4000;
+    p.frame_us[MEDIA_STAGE_COMPOSITE] = 5000 + n;
+    p.frame_us[MEDIA_STAGE_SINK] = 6000 + n;
+
+    late_record(&p, n, 100 + n, late_ms);
+}
+
+/* Check entry I of the dump against what record(N, LATE_MS) stored */
+static void check_entry(int i, uint16_t n, uint16_t late_ms)
+{
+    const uint8_t *e = &dump[DUMP_HEADER + i * DUMP_PER_FRAME];
+
+    zassert_true(sys_get_le32(e) <= k_uptime_get_32(), "entry %d uptime", i);
+    zassert_equal(sys_get_le16(e + 4), n, "entry %d frame", i);
+    zassert_equal(sys_get_le16(e + 6), 100 + n, "entry %d budget", i);
+    zassert_equal(sys_get_le16(e + 8), late_ms, "entry %d late", i);
+    zassert_equal(sys_get_le32(e + 10), 1000 + n, "entry %d read", i);
+    /* Decode and convert, less the reads made during them */
+    zassert_equal(sys_get_le32(e + 14), 3000 + n + 4000 - (1000 + n), "entry %d decode", i);
+    zassert_equal(sys_get_le32(e + 18), 5000 + n, "entry %d composite", i);
+    zassert_equal(sys_get_le32(e + 22), 6000 + n, "entry %d sink", i);
+}
+
+static void media_before(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    media_late_reset();
+    memset(dump, 0xAA, sizeof(dump));
+}
+
+ZTEST(media, test_late_dump_empty)
+{
+    zassert_equal(media_late_dump(dump, sizeof(dump)), DUMP_HEADER);
+    zassert_equal(dump[0], MEDIA_LATE_DUMP_VERSION);
+    zassert_equal(dump[1], 0);
+    zassert_equal(sys_get_le32(&dump[2]), 0);
+    zassert_equal(sys_get_le32(&dump[6]), 0);
+    zassert_equal(dump[DUMP_HEADER], 0xAA, "wrote past its length");
+}
+
+ZTEST(media, test_late_dump_layout)
+{
+    record(7, 12);
+    record(9, 100000);          /* Saturates at UINT16_MAX */
+    late_ring.played = 40;
+
+    zassert_equal(media_late_dump(dump, sizeof(dump)), DUMP_HEADER + 2 * DUMP_PER_FRAME);
+    zassert_equal(dump[0], MEDIA_LATE_DUMP_VERSION);
+    zassert_equal(dump[1], 2);
+    zassert_equal(sys_get_le32(&dump[2]), 40);
+    zassert_equal(sys_get_le32(&dump[6]), 2);
+
+    check_entry(0, 7, 12);
+    check_entry(1, 9, UINT16_MAX);
+}
+
+/* Only the most recent frames are kept, oldest first; the count covers all */
+ZTEST(media, test_late_dump_ring)
+{
+    const uint16_t total = MEDIA_LATE_FRAMES + 3;
+
+    for (uint16_t n = 0; n < total; n++) {
+        record(n, n + 1);
+    }
+
+    zassert_equal(media_late_dump(dump, sizeof(dump)), DUMP_MAX);
+    zassert_equal(dump[1], MEDIA_LATE_FRAMES);
+    zassert_equal(sys_get_le32(&dump[6]), total);
+
+    for (int i = 0; i < MEDIA_LATE_FRAMES; i++) {
+        uint16_t n = total - MEDIA_LATE_FRAMES + i;
+
+        check_entry(i, n, n + 1);
+    }
+
+    media_late_reset();
+    zassert_equal(media_late_dump(dump, sizeof(dump)), DUMP_HEADER);
+}
+
+ZTEST(media, test_late_dump_too_small)
+{
+    record(1, 1);
+    zassert_equal(media_late_dump(dump, DUMP_MAX - 1), -ENOMEM);
+}
+
+/* A sink that takes longer than the frame delay on odd frames */
+static int slow_frame_begin(struct media_sink *sink, uint16_t frame)
+{
+    sink->ctx = (void *)(uintptr_t)frame;
+    return 0;
+}
+
+static int slow_write_strip(struct media_sink *sink, const struct media_strip *strip)
+{
+    if (strip->y == 0 && ((uintptr_t)sink->ctx & 1)) {
+        k_msleep(SLOW_SINK_MS);
+    }
+    return 0;
+}
+
+static int slow_frame_end(struct media_sink *sink)
+{
+    return 0;
+}
+
+static const struct media_sink_api slow_api = {
+    .frame_begin = slow_frame_begin,
+    .write_strip = slow_write_strip,
+    .frame_end = slow_frame_end,
+};
+
+ZTEST(media, test_late_playback)
+{
+    struct media_pipeline p;
+    struct media_source src;
+    struct media_sink sink = { .api = &slow_api };
+
+    zassert_ok(media_source_mem_init(&src, test_gif, sizeof(test_gif)));
+    zassert_ok(media_pipeline_open(&p, &src, &sink, K_SECONDS(1)));
+
+    uint16_t frames = p.info.frame_count;
+
+    zassert_true(frames > 2);
+    zassert_ok(media_pipeline_play(&p, 1));
+    media_pipeline_close(&p);
+
+    zassert_true(media_late_dump(dump, sizeof(dump)) > DUMP_HEADER);
+    zassert_equal(sys_get_le32(&dump[2]), frames);
+    zassert_equal(dump[1], frames / 2);
+    zassert_equal(sys_get_le32(&dump[6]), frames / 2);
+
+    for (int i = 0; i < dump[1]; i++) {
+        const uint8_t *e = &dump[DUMP_HEADER + i * DUMP_PER_FRAME];
+        uint16_t budget = sys_get_le16(e + 6);
+
+        zassert_equal(sys_get_le16(e + 4), 2 * i + 1);
+        zassert_true(budget > 0 && budget < SLOW_SINK_MS);
+        zassert_true(sys_get_le16(e + 8) >= SLOW_SINK_MS - budget - 1, "late %u ms",
+                     sys_get_le16(e + 8));
+        zassert_true(sys_get_le32(e + 22) >= (SLOW_SINK_MS - 1) * USEC_PER_MSEC,
+                     "sink %u us", sys_get_le32(e + 22));
+    }
+}
+
+static void *media_setup(void)
+{
+    zassert_ok(storage_init());
+    return NULL;
+}
+
+ZTEST_SUITE(media, NULL, media_setup, media_before, NULL, NULL);
@@ -0,0 +1,60 @@
+/*
+ * OpenDOTT - Mock Panel Golden Images
+ * SPDX-License-Identifier: MIT
+ *
+ * Plays the uploader's test image through the media pipeline into the
+ * mock panel and compares every frame against a golden CRC of its PPM
+ * pixels. On a mismatch, mock_panel/frame_NNNNN.ppm in the build directory
+ * shows what was drawn. After an intended change to rendering, update
+ * golden[] from the CRCs the failures report.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/crc.h>
+
+#include "opendott.h"
+
+#define GOLDEN_NAME  "golden.gif"
+#define FRAME_RGB    (DISPLAY_WIDTH * DISPLAY_HEIGHT * 3)
+
+static const uint8_t test_gif[] = {
+#include "test_image.gif.inc"
+};
+
+/* CRC32 of each frame's RGB888 pixels, identity color profile */
+static const uint32_t golden[] = {
+    0xceef15aa, 0x4a070436, 0x4fe2caec, 0x2322f787, 0x26c7395d, 0xa22f28c1,
+};
+
+static void *golden_setup(void)
+{
+    zassert_ok(storage_init());
+    zassert_ok(display_init());
+    zassert_ok(storage_save_image(test_gif, sizeof(test_gif), GOLDEN_NAME));
+    return NULL;
+}
+
+ZTEST(mock_panel, test_frames_match_golden)
+{
+    struct media_pipeline p;
+    struct media_source src;
+    struct media_sink panel;
+
+    media_sink_panel_init(&panel);
+    zassert_ok(media_source_file_open(&src, GOLDEN_NAME));
+    zassert_ok(media_pipeline_open(&p, &src, &panel, K_SECONDS(1)));
+    zassert_equal(p.info.frame_count, ARRAY_SIZE(golden));
+
+    for (uint16_t frame = 0; frame < p.info.frame_count; frame++) {
+        zassert_ok(media_pipeline_render(&p, frame, NULL));
+
+        uint32_t crc = crc32_ieee(mock_panel_rgb(), FRAME_RGB);
+        zassert_equal(crc, golden[frame], "frame %u: CRC 0x%08x, golden 0x%08x", frame,
+                      crc, golden[frame]);
+    }
+
+    media_pipeline_close(&p);
+    media_source_close(&src);
+}
+
+ZTEST_SUITE(mock_panel, NULL, golden_setup, NULL, NULL, NULL);
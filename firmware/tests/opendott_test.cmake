@@ -0,0 +1,29 @@
+# SPDX-License-Identifier: MIT
+#
+# Shared by the ztest apps under tests/: they build against the firmware's
+# Kconfig, prj.conf and native_sim devicetree, plus every firmware module
+# except main.c and the device-only ones. Include before find_package(Zephyr)
+# and call opendott_test_sources() after it. A suite that tests a module's
+# static functions #includes that module's .c and passes it to
+# opendott_test_sources() to leave it out.
+
+set(OPENDOTT_DIR ${CMAKE_CURRENT_LIST_DIR}/..)
+
+set(KCONFIG_ROOT ${OPENDOTT_DIR}/Kconfig)
+set(DTC_OVERLAY_FILE ${OPENDOTT_DIR}/boards/native_sim.overlay)
+set(CONF_FILE ${OPENDOTT_DIR}/prj.conf ${CMAKE_CURRENT_SOURCE_DIR}/prj.conf)
+
+function(opendott_test_sources)
+    file(GLOB sources ${OPENDOTT_DIR}/src/*.c)
+    foreach(module main.c ble_service.c ota.c assets.c mock_panel.c mock_panel_host.c ${ARGN})
+        list(REMOVE_ITEM sources ${OPENDOTT_DIR}/src/${module})
+    endforeach()
+
+    target_sources(app PRIVATE ${sources})
+    target_include_directories(app PRIVATE ${OPENDOTT_DIR}/include ${OPENDOTT_DIR}/src)
+
+    if(CONFIG_OPENDOTT_MOCK_PANEL)
+        target_sources(app PRIVATE ${OPENDOTT_DIR}/src/mock_panel.c)
+        target_sources(native_simulator INTERFACE ${OPENDOTT_DIR}/src/mock_panel_host.c)
+    endif()
+endfunction()
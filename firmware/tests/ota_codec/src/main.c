@@ -0,0 +1,213 @@
+/*
+ * OpenDOTT - OTA Decoder Tests
+ * SPDX-License-Identifier: MIT
+ *
+ * Streams produced by lz_compress() and delta_encode() in
+ * tools/dott_flash.py, decoded by ota_codec.c. If the uploader's encoders
+ * change, regenerate the vectors from the inputs described next to them.
+ */
+
+#include <zephyr/ztest.h>
+
+#include "opendott.h"
+
+#define FOX      "The quick brown fox"
+#define FOX_LEN  (sizeof(FOX) - 1)
+#define RUN_LEN  300
+#define OUT_MAX  600
+
+/* lz_compress(FOX + b"-" * 300 + FOX + b"-" * 5 + FOX[4:9]): literals, a
+ * run of distance 1 matches, then matches from 319 bytes back */
+static const uint8_t lz_stream[] = {
+    0xff, 0x54, 0x68, 0x65, 0x20, 0x71, 0x75, 0x69, 0x63, 0xff, 0x6b, 0x20,
+    0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20, 0x0f, 0x66, 0x6f, 0x78, 0x2d, 0x00,
+    0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x00, 0x0f, 0x00, 0x0f,
+    0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f,
+    0x00, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x08, 0x3e,
+    0x1f, 0x3e, 0x13, 0x13, 0x02,
+};
+
+/* delta_encode(base, new) with base as in base_byte() and
+ * new = base[100:300] + b"patched!" + base[0:100] + base[300:512], byte 450
+ * inverted: copies forwards and backwards, and literals */
+static const uint8_t delta_patch[] = {
+    0x01, 0xc8, 0x01, 0xc8, 0x01, 0x02, 0x08, 0x70, 0x61, 0x74, 0x63, 0x68,
+    0x65, 0x64, 0x21, 0x01, 0xd7, 0x04, 0x64, 0x01, 0x90, 0x03, 0x8e, 0x01,
+    0x02, 0x01, 0x9a, 0x01, 0x02, 0x45,
+};
+
+#define BASE_LEN   512
+#define DELTA_LEN  520
+
+static struct {
+    uint8_t buf[OUT_MAX];
+    size_t len;
+    size_t limit;                   /* emit() fails with -EFBIG past this */
+    const uint8_t *patch;
+    size_t patch_len;
+    size_t patch_pos;
+    uint8_t base[BASE_LEN];
+} out;
+
+static int emit(uint8_t b, void *user)
+{
+    if (user != &out) {
+        return -EINVAL;
+    }
+    if (out.len >= out.limit) {
+        return -EFBIG;
+    }
+    out.buf[out.len++] = b;
+    return 0;
+}
+
+static int patch_read_byte(void *user, uint8_t *b)
+{
+    ARG_UNUSED(user);
+
+    if (out.patch_pos == out.patch_len) {
+        return -ENODATA;
+    }
+    *b = out.patch[out.patch_pos++];
+    return 0;
+}
+
+static int base_copy(void *user, uint32_t src, uint32_t count)
+{
+    if (src + count > BASE_LEN) {
+        return -EINVAL;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        int ret = emit(out.base[src + i], user);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static const struct ota_delta_io delta_io = {
+    .read_byte = patch_read_byte,
+    .copy = base_copy,
+    .emit = emit,
+};
+
+static uint8_t base_byte(uint32_t i)
+{
+    return (i * 131 + (i >> 3)) & 0xFF;
+}
+
+static size_t lz_expected(uint8_t *buf)
+{
+    size_t n = 0;
+
+    memcpy(&buf[n], FOX, FOX_LEN);
+    n += FOX_LEN;
+    memset(&buf[n], '-', RUN_LEN);
+    n += RUN_LEN;
+    memcpy(&buf[n], FOX, FOX_LEN);
+    n += FOX_LEN;
+    memset(&buf[n], '-', 5);
+    n += 5;
+    memcpy(&buf[n], &FOX[4], 5);
+    n += 5;
+
+    return n;
+}
+
+static void out_reset(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    memset(&out, 0, sizeof(out));
+    out.limit = OUT_MAX;
+    for (uint32_t i = 0; i < BASE_LEN; i++) {
+        out.base[i] = base_byte(i);
+    }
+}
+
+static void lz_check_chunked(size_t chunk)
+{
+    static struct ota_lz lz;
+    uint8_t expected[OUT_MAX];
+    size_t len = lz_expected(expected);
+
+    out_reset(NULL);
+    ota_lz_init(&lz);
+
+    for (size_t off = 0; off < sizeof(lz_stream); off += chunk) {
+        size_t n = MIN(chunk, sizeof(lz_stream) - off);
+        zassert_ok(ota_lz_feed(&lz, &lz_stream[off], n, emit, &out));
+    }
+
+    zassert_equal(out.len, len, "chunk %zu: %zu bytes out", chunk, out.len);
+    zassert_mem_equal(out.buf, expected, len, "chunk %zu", chunk);
+}
+
+ZTEST(ota_codec, test_lz_reference_stream)
+{
+    lz_check_chunked(sizeof(lz_stream));
+}
+
+/* Chunk boundaries fall inside flag groups and between match bytes */
+ZTEST(ota_codec, test_lz_any_chunking)
+{
+    for (size_t chunk = 1; chunk <= 8; chunk++) {
+        lz_check_chunked(chunk);
+    }
+}
+
+ZTEST(ota_codec, test_lz_emit_error)
+{
+    static struct ota_lz lz;
+
+    out.limit = FOX_LEN + 10;
+    ota_lz_init(&lz);
+
+    zassert_equal(ota_lz_feed(&lz, lz_stream, sizeof(lz_stream), emit, &out), -EFBIG);
+    zassert_equal(out.len, out.limit);
+}
+
+ZTEST(ota_codec, test_delta_reference_patch)
+{
+    uint8_t expected[DELTA_LEN];
+
+    memcpy(&expected[0], &out.base[100], 200);
+    memcpy(&expected[200], "patched!", 8);
+    memcpy(&expected[208], &out.base[0], 100);
+    memcpy(&expected[308], &out.base[300], 212);
+    expected[450] ^= 0xFF;
+
+    out.patch = delta_patch;
+    out.patch_len = sizeof(delta_patch);
+
+    zassert_ok(ota_delta_apply(&delta_io, &out, DELTA_LEN));
+    zassert_equal(out.len, DELTA_LEN);
+    zassert_mem_equal(out.buf, expected, DELTA_LEN);
+    zassert_equal(out.patch_pos, sizeof(delta_patch), "patch not fully consumed");
+}
+
+ZTEST(ota_codec, test_delta_bad_patches)
+{
+    static const uint8_t bad_op[] = { 0x03 };
+    static const uint8_t long_varint[] = { 0x02, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+
+    out.patch = bad_op;
+    out.patch_len = sizeof(bad_op);
+    zassert_equal(ota_delta_apply(&delta_io, &out, DELTA_LEN), -EBADMSG);
+
+    out.patch = long_varint;
+    out.patch_len = sizeof(long_varint);
+    out.patch_pos = 0;
+    zassert_equal(ota_delta_apply(&delta_io, &out, DELTA_LEN), -EBADMSG);
+
+    /* A patch that ends before the image does */
+    out.patch = delta_patch;
+    out.patch_len = sizeof(delta_patch) - 1;
+    out.patch_pos = 0;
+    out.len = 0;
+    zassert_equal(ota_delta_apply(&delta_io, &out, DELTA_LEN), -ENODATA);
+}
+
+ZTEST_SUITE(ota_codec, NULL, NULL, out_reset, NULL, NULL);
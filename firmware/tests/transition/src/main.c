@@ -0,0 +1,185 @@
+/*
+ * OpenDOTT - Transition Kernel Tests
+ * SPDX-License-Identifier: MIT
+ *
+ * blend565() against a per-channel reference, and the rows compose_row()
+ * builds for the crossfade, wipe and iris. transition.c is included for
+ * its static kernels.
+ */
+
+#include <zephyr/ztest.h>
+#include <math.h>
+
+#include "transition.c"
+
+#define FROM_COLOR  0xF800      /* Red */
+#define TO_COLOR    0x001F      /* Blue */
+
+static uint16_t from_lut[GIF_PALETTE_SIZE];
+static uint16_t to_lut[GIF_PALETTE_SIZE];
+static const uint8_t zero_row[DISPLAY_WIDTH];
+
+/* One channel of the mix, dither T added before rounding down */
+static int mix(int a, int b, int alpha, int t)
+{
+    return (a * 32 + (b - a) * alpha + t) >> 5;
+}
+
+static void compose(uint16_t *out, enum transition_effect fx, uint16_t progress, uint16_t y)
+{
+    transition_set(fx, TRANSITION_DEFAULT_MS);
+    tr.from_lut = from_lut;
+    tr.to_lut = to_lut;
+    tr.progress = progress;
+    compose_row(out, zero_row, zero_row, y);
+}
+
+/* The run of incoming pixels in OUT; there must be only one */
+static void to_run(const uint16_t *out, uint16_t *start, uint16_t *count)
+{
+    *start = DISPLAY_WIDTH;
+    *count = 0;
+    for (uint16_t x = 0; x < DISPLAY_WIDTH; x++) {
+        if (out[x] == sys_cpu_to_be16(TO_COLOR)) {
+            if (*count == 0) {
+                *start = x;
+            }
+            zassert_equal(x, *start + *count, "incoming pixels not contiguous");
+            (*count)++;
+        } else {
+            zassert_equal(out[x], sys_cpu_to_be16(FROM_COLOR));
+        }
+    }
+}
+
+static void *transition_setup(void)
+{
+    for (int i = 0; i < GIF_PALETTE_SIZE; i++) {
+        from_lut[i] = sys_cpu_to_be16(FROM_COLOR);
+        to_lut[i] = sys_cpu_to_be16(TO_COLOR);
+    }
+    return NULL;
+}
+
+ZTEST(transition, test_blend565)
+{
+    uint32_t seed = 1;
+
+    for (int i = 0; i < 256; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint16_t a = seed >> 16;
+        seed = seed * 1103515245 + 12345;
+        uint16_t b = seed >> 16;
+
+        for (uint32_t alpha = 0; alpha <= 32; alpha++) {
+            for (uint32_t t = 0; t < 32; t++) {
+                uint16_t want = (mix(a >> 11, b >> 11, alpha, t) << 11) |
+                                (mix((a >> 5) & 0x3F, (b >> 5) & 0x3F, alpha, t) << 5) |
+                                mix(a & 0x1F, b & 0x1F, alpha, t);
+
+                zassert_equal(blend565(a, b, alpha, t), want,
+                              "%04x, %04x, alpha %u, t %u: %04x, want %04x", a, b, alpha,
+                              t, blend565(a, b, alpha, t), want);
+            }
+        }
+
+        zassert_equal(blend565(a, b, 0, 31), a);
+        zassert_equal(blend565(a, b, 32, 31), b);
+    }
+}
+
+/* A dithered crossfade averages to the exact mix over a 4x4 tile */
+ZTEST(transition, test_crossfade_dither)
+{
+    uint16_t out[DISPLAY_WIDTH];
+
+    for (uint16_t progress = 0; progress < TRANSITION_ONE; progress += 8) {
+        uint32_t red = 0, blue = 0;
+
+        for (uint16_t y = 0; y < 4; y++) {
+            compose(out, TRANSITION_CROSSFADE, progress, y);
+            for (int x = 0; x < 4; x++) {
+                uint16_t c = sys_be16_to_cpu(out[x]);
+
+                red += c >> 11;
+                blue += c & 0x1F;
+            }
+        }
+
+        uint32_t alpha = progress >> 3;
+
+        zassert_within(red, 16 * 31 * (32 - alpha) / 32, 1, "progress %u", progress);
+        zassert_within(blue, 16 * 31 * alpha / 32, 1, "progress %u", progress);
+    }
+}
+
+ZTEST(transition, test_wipe)
+{
+    uint16_t out[DISPLAY_WIDTH];
+    uint16_t start, count;
+
+    for (uint16_t progress = 0; progress <= TRANSITION_ONE; progress++) {
+        compose(out, TRANSITION_WIPE, progress, 17);
+        to_run(out, &start, &count);
+
+        zassert_equal(count, DISPLAY_WIDTH * progress / TRANSITION_ONE);
+        zassert_true(count == 0 || start == 0);
+    }
+}
+
+/* Half the chord of a circle of radius R centred on the panel, DY from
+ * the centre, limited to the panel */
+static double chord(double r, double dy)
+{
+    double half = r > 0 && dy * dy < r * r ? sqrt(r * r - dy * dy) : 0;
+
+    return MIN(half, DISPLAY_WIDTH / 2.0);
+}
+
+/* The iris is a disc of incoming pixels centred on the panel, within a
+ * pixel of the ideal circle (whose radius is rounded down to half pixels).
+ * It only grows, and the last step replaces the whole panel */
+ZTEST(transition, test_iris)
+{
+    static uint16_t prev[DISPLAY_HEIGHT];
+    uint16_t out[DISPLAY_WIDTH];
+    uint16_t start, count;
+
+    memset(prev, 0, sizeof(prev));
+
+    for (uint16_t progress = 0; progress < TRANSITION_ONE; progress += 4) {
+        uint16_t counts[DISPLAY_HEIGHT];
+        double r = TRANSITION_IRIS_RADIUS * progress / (double)TRANSITION_ONE;
+
+        for (uint16_t y = 0; y < DISPLAY_HEIGHT; y++) {
+            compose(out, TRANSITION_IRIS, progress, y);
+            to_run(out, &start, &counts[y]);
+
+            if (counts[y] > 0 && counts[y] < DISPLAY_WIDTH) {
+                zassert_equal(start, (DISPLAY_WIDTH - counts[y]) / 2, "row %u off centre", y);
+                zassert_equal(counts[y] % 2, 0);
+            }
+
+            double dy = y + 0.5 - DISPLAY_HEIGHT / 2.0;
+
+            zassert_between_inclusive(counts[y] / 2.0, chord(r - 0.5, dy) - 1,
+                                      chord(r, dy) + 1, "progress %u, row %u: %u pixels",
+                                      progress, y, counts[y]);
+            zassert_true(counts[y] >= prev[y], "row %u shrank", y);
+            prev[y] = counts[y];
+        }
+
+        for (uint16_t y = 0; y < DISPLAY_HEIGHT / 2; y++) {
+            zassert_equal(counts[y], counts[DISPLAY_HEIGHT - 1 - y], "row %u and its mirror", y);
+        }
+    }
+
+    /* The last step is all incoming frame, corners too */
+    for (uint16_t y = 0; y < DISPLAY_HEIGHT; y++) {
+        compose(out, TRANSITION_IRIS, TRANSITION_ONE, y);
+        to_run(out, &start, &count);
+        zassert_equal(count, DISPLAY_WIDTH, "row %u", y);
+    }
+}
+
+ZTEST_SUITE(transition, NULL, transition_setup, NULL, NULL, NULL);
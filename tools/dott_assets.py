@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""
+DOTT Asset Pack Builder
+=======================
+Build the read-only asset pack (fonts, icons, palettes) that the OpenDOTT
+firmware reads in place from the QSPI flash through XIP.
+
+The pack lives in the `assets_partition` (offset 0xF00000 of the QSPI flash,
+1MB) and its layout must match firmware/src/assets.c.
+
+Manifest (JSON):
+    {
+      "fonts":    [{"name": "small", "file": "DejaVuSans.ttf", "size": 14}],
+      "icons":    [{"name": "battery", "file": "battery.png"}],
+      "palettes": [{"name": "status", "colors": ["#000000", "#ff8800"]}]
+    }
+
+Usage:
+    python dott_assets.py build manifest.json -o assets.bin
+    python dott_assets.py build manifest.json -o assets.hex   # for nrfjprog --qspi
+    python dott_assets.py info assets.bin
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+
+try:
+    from PIL import Image, ImageFont, ImageDraw
+except ImportError:
+    print("Error: Pillow not installed. Run: pip install pillow")
+    sys.exit(1)
+
+PACK_MAGIC = 0x5041444F  # "ODAP"
+PACK_VERSION = 1
+PACK_MAX_SIZE = 0x100000
+
+# QSPI flash is memory mapped at 0x12000000 on the nRF52840
+QSPI_XIP_BASE = 0x12000000
+ASSETS_PARTITION_OFFSET = 0xF00000
+
+TYPE_FONT = 1
+TYPE_ICON = 2
+TYPE_PALETTE = 3
+
+HEADER_FMT = '<IHHII'     # magic, version, count, size, crc32
+ENTRY_FMT = '<16sBBHHHII'  # name, type, reserved, width, height, reserved2, offset, size
+FONT_FMT = '<BBBBB3x'     # first_char, glyph_count, height, bpp, baseline
+GLYPH_FMT = '<IBBH'       # offset, width, advance, reserved
+
+HEADER_SIZE = struct.calcsize(HEADER_FMT)
+ENTRY_SIZE = struct.calcsize(ENTRY_FMT)
+
+TYPE_NAMES = {TYPE_FONT: 'font', TYPE_ICON: 'icon', TYPE_PALETTE: 'palette'}
+
+
+def rgb565(r, g, b):
+    """Pack 8-bit RGB into RGB565."""
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+
+
+def build_font(path, size, first_char=0x20, last_char=0x7E):
+    """Rasterize a TTF into a 4bpp coverage atlas."""
+    font = ImageFont.truetype(path, size)
+    ascent, descent = font.getmetrics()
+    height = ascent + descent
+
+    glyph_count = last_char - first_char + 1
+    table_size = struct.calcsize(FONT_FMT) + glyph_count * struct.calcsize(GLYPH_FMT)
+
+    table = []
+    atlas = bytearray()
+
+    for code in range(first_char, last_char + 1):
+        ch = chr(code)
+        # Cells are a full advance wide so drawing a glyph also paints the
+        # inter-character gap in the background color
+        width = int(round(font.getlength(ch)))
+        advance = width
+
+        offset = table_size + len(atlas)
+        if width > 0:
+            img = Image.new('L', (width, height), 0)
+            ImageDraw.Draw(img).text((0, 0), ch, font=font, fill=255)
+            stride = (width + 1) // 2
+            for y in range(height):
+                row = bytearray(stride)
+                for x in range(width):
+                    a = img.getpixel((x, y)) >> 4
+                    row[x // 2] |= (a << 4) if x % 2 == 0 else a
+                atlas += row
+
+        if width > 255 or advance > 255:
+            raise ValueError(f"Glyph {ch!r} too wide at size {size}")
+        table.append(struct.pack(GLYPH_FMT, offset, width, advance, 0))
+
+    header = struct.pack(FONT_FMT, first_char, glyph_count, height, 4, ascent)
+    return header + b''.join(table) + bytes(atlas), 0, height
+
+
+def build_icon(path):
+    """Convert an image to big-endian RGB565 (panel byte order)."""
+    img = Image.open(path).convert('RGB')
+    width, height = img.size
+    if width > 240 or height > 240:
+        raise ValueError(f"Icon {path} larger than the 240x240 panel")
+
+    raw = img.tobytes()
+    data = bytearray()
+    for i in range(0, len(raw), 3):
+        data += struct.pack('>H', rgb565(raw[i], raw[i + 1], raw[i + 2]))
+    return bytes(data), width, height
+
+
+def build_palette(colors):
+    """Encode a list of #rrggbb colors as big-endian RGB565."""
+    data = bytearray()
+    for color in colors:
+        value = int(color.lstrip('#'), 16)
+        data += struct.pack('>H', rgb565(value >> 16, (value >> 8) & 0xFF, value & 0xFF))
+    return bytes(data), len(colors), 1
+
+
+def build_pack(manifest_path):
+    with open(manifest_path) as f:
+        manifest = json.load(f)
+    base = os.path.dirname(os.path.abspath(manifest_path))
+
+    assets = []
+    for font in manifest.get('fonts', []):
+        blob, w, h = build_font(os.path.join(base, font['file']), font['size'])
+        assets.append((font['name'], TYPE_FONT, w, h, blob))
+    for icon in manifest.get('icons', []):
+        blob, w, h = build_icon(os.path.join(base, icon['file']))
+        assets.append((icon['name'], TYPE_ICON, w, h, blob))
+    for palette in manifest.get('palettes', []):
+        blob, w, h = build_palette(palette['colors'])
+        assets.append((palette['name'], TYPE_PALETTE, w, h, blob))
+
+    offset = HEADER_SIZE + ENTRY_SIZE * len(assets)
+    entries = bytearray()
+    blobs = bytearray()
+
+    for name, kind, width, height, blob in assets:
+        encoded = name.encode('ascii')
+        if len(encoded) > 16:
+            raise ValueError(f"Asset name too long (16 max): {name}")
+        # Keep blobs 4-byte aligned so XIP reads of 16/32-bit fields are aligned
+        pad = (-len(blobs)) % 4
+        blobs += bytes(pad)
+        entries += struct.pack(ENTRY_FMT, encoded, kind, 0, width, height, 0,
+                               offset + len(blobs), len(blob))
+        blobs += blob
+
+    body = bytes(entries) + bytes(blobs)
+    size = HEADER_SIZE + len(body)
+    if size > PACK_MAX_SIZE:
+        raise ValueError(f"Pack is {size} bytes, partition holds {PACK_MAX_SIZE}")
+
+    header = struct.pack(HEADER_FMT, PACK_MAGIC, PACK_VERSION, len(assets), size,
+                         zlib.crc32(body) & 0xFFFFFFFF)
+    return header + body
+
+
+def write_hex(data, path, address):
+    """Write Intel HEX so nrfjprog can program the QSPI flash directly."""
+    with open(path, 'w') as f:
+        for i in range(0, len(data), 16):
+            addr = address + i
+            if i == 0 or (addr & 0xFFFF) == 0:
+                upper = addr >> 16
+                rec = bytes([2, 0, 0, 4, upper >> 8, upper & 0xFF])
+                f.write(':' + rec.hex().upper() + f'{(-sum(rec)) & 0xFF:02X}\n')
+            chunk = data[i:i + 16]
+            rec = bytes([len(chunk), (addr >> 8) & 0xFF, addr & 0xFF, 0]) + chunk
+            f.write(':' + rec.hex().upper() + f'{(-sum(rec)) & 0xFF:02X}\n')
+        f.write(':00000001FF\n')
+
+
+def cmd_build(args):
+    pack = build_pack(args.manifest)
+
+    if args.output.endswith('.hex'):
+        write_hex(pack, args.output, QSPI_XIP_BASE + ASSETS_PARTITION_OFFSET)
+    else:
+        with open(args.output, 'wb') as f:
+            f.write(pack)
+
+    print(f"Wrote {args.output}: {len(pack)} bytes")
+
+
+def cmd_info(args):
+    with open(args.pack, 'rb') as f:
+        data = f.read()
+
+    magic, version, count, size, crc = struct.unpack_from(HEADER_FMT, data)
+    if magic != PACK_MAGIC:
+        print("Error: not an asset pack")
+        return
+
+    ok = (zlib.crc32(data[HEADER_SIZE:size]) & 0xFFFFFFFF) == crc
+    print(f"Asset pack v{version}: {count} assets, {size} bytes, CRC {'OK' if ok else 'BAD'}")
+
+    for i in range(count):
+        name, kind, _, w, h, _, off, length = struct.unpack_from(
+            ENTRY_FMT, data, HEADER_SIZE + i * ENTRY_SIZE)
+        name = name.rstrip(b'\0').decode('ascii')
+        print(f"  {name:16s} {TYPE_NAMES.get(kind, '?'):8s} {w:4d}x{h:<4d} "
+              f"@0x{off:06x} {length} bytes")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="DOTT Asset Pack Builder")
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    build = sub.add_parser('build', help='Build a pack from a JSON manifest')
+    build.add_argument('manifest')
+    build.add_argument('-o', '--output', default='assets.bin',
+                       help='Output file (.bin raw, .hex for nrfjprog --qspi)')
+
+    info = sub.add_parser('info', help='List the contents of a pack')
+    info.add_argument('pack')
+
+    args = parser.parse_args()
+    if args.command == 'build':
+        cmd_build(args)
+    elif args.command == 'info':
+        cmd_info(args)
+
+
+if __name__ == '__main__':
+    main()
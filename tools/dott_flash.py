@@ -4,8 +4,18 @@ DOTT Firmware Flash Tool
 ========================
 Upload firmware to DOTT via MCUmgr SMP over BLE.
 
+Uploads are pipelined: up to --window image upload requests are in flight
+at once, each carrying as much data as fits in one ATT write at the
+negotiated MTU. The device answers every request with the offset it expects
+next, so a dropped or reordered chunk just rewinds the stream to that
+offset. Re-running an interrupted flash of the same file resumes where the
+device left off (MCUmgr matches the image SHA256 sent with the first chunk).
+
 Usage:
     python dott_flash.py flash release2.0.bin
+    python dott_flash.py flash release2.0.bin --window 8
+    python dott_flash.py flash release2.0.bin --compress
+    python dott_flash.py flash release2.1.bin --base release2.0.bin
     python dott_flash.py info
     python dott_flash.py reset
 """
@@ -42,11 +52,169 @@ class SMPOp:
 class SMPGroup:
     OS = 0
     IMAGE = 1
+    OPENDOTT = 64   # firmware/src/ota.c
 
 class SMPCmd:
     OS_RESET = 5
     IMG_STATE = 0
     IMG_UPLOAD = 1
+    OTA_UPLOAD_LZ = 0
+    OTA_UPLOAD_DELTA = 1
+
+
+SMP_HEADER_SIZE = 8
+# CBOR keys plus len/ulen/sha/base/blen on the first chunk; the rest of
+# the write is data
+UPLOAD_OVERHEAD = 128
+# Firmware reassembles up to this many bytes per SMP frame
+# (CONFIG_MCUMGR_TRANSPORT_NETBUF_SIZE)
+MAX_FRAME_SIZE = 1024
+MIN_CHUNK_SIZE = 128
+DEFAULT_WINDOW = 4
+UPLOAD_RETRIES = 5
+
+
+# LZSS parameters, must match firmware/src/ota_codec.c and
+# firmware/tests/ota_codec
+LZ_WINDOW_SIZE = 4096
+LZ_MIN_MATCH = 3
+LZ_MAX_MATCH = 18
+LZ_MAX_CHAIN = 64
+
+
+def lz_compress(data):
+    """
+    LZSS: a flag byte then up to 8 items, LSB first. Flag bit 1 is a literal
+    byte, 0 is a match [d_lo, d_hi:4 | n:4] copying n + 3 bytes from
+    distance ((d_hi << 8) | d_lo) + 1.
+    """
+    out = bytearray()
+    chains = {}
+    n = len(data)
+    i = 0
+    flag_pos = 0
+    bit = 8
+    
+    def insert(pos):
+        if pos + LZ_MIN_MATCH <= n:
+            chain = chains.setdefault(data[pos:pos + LZ_MIN_MATCH], [])
+            chain.append(pos)
+            if len(chain) > LZ_MAX_CHAIN * 2:
+                del chain[:LZ_MAX_CHAIN]
+    
+    while i < n:
+        if bit == 8:
+            flag_pos = len(out)
+            out.append(0)
+            bit = 0
+            
+        best_len, best_dist = 0, 0
+        limit = min(LZ_MAX_MATCH, n - i)
+        if limit >= LZ_MIN_MATCH:
+            for pos in reversed(chains.get(data[i:i + LZ_MIN_MATCH], [])[-LZ_MAX_CHAIN:]):
+                dist = i - pos
+                if dist > LZ_WINDOW_SIZE:
+                    break
+                length = LZ_MIN_MATCH
+                while length < limit and data[pos + length] == data[i + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_dist = length, dist
+                    if length == limit:
+                        break
+                        
+        if best_len >= LZ_MIN_MATCH:
+            d = best_dist - 1
+            out += bytes([d & 0xFF, ((d >> 8) << 4) | (best_len - LZ_MIN_MATCH)])
+            for k in range(best_len):
+                insert(i + k)
+            i += best_len
+        else:
+            out[flag_pos] |= 1 << bit
+            out.append(data[i])
+            insert(i)
+            i += 1
+        bit += 1
+        
+    return bytes(out)
+
+
+# Delta patch ops, must match firmware/src/ota_codec.c and
+# firmware/tests/ota_codec
+DELTA_OP_COPY = 0x01
+DELTA_OP_ADD = 0x02
+DELTA_KEY_LEN = 8
+DELTA_MIN_COPY = 12
+DELTA_MAX_CANDIDATES = 8
+# Patches are spooled in the MCUboot scratch partition
+DELTA_MAX_SIZE = 0xA000
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        b = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def delta_encode(old, new):
+    """
+    Patch NEW against OLD as COPY/ADD ops:
+      0x01 COPY varint(zigzag src delta) varint(n) - n bytes from OLD
+      0x02 ADD  varint(n) bytes                    - literal bytes
+    Copy sources are relative to the end of the previous copy, so runs of
+    unchanged code shifted by the same amount cost a few bytes each.
+    """
+    index = {}
+    for pos in range(len(old) - DELTA_KEY_LEN + 1):
+        cands = index.setdefault(old[pos:pos + DELTA_KEY_LEN], [])
+        if len(cands) < DELTA_MAX_CANDIDATES:
+            cands.append(pos)
+    
+    out = bytearray()
+    literal = bytearray()
+    src = 0
+    i = 0
+    
+    def flush_literal():
+        if literal:
+            out.append(DELTA_OP_ADD)
+            out.extend(varint(len(literal)))
+            out.extend(literal)
+            literal.clear()
+    
+    while i < len(new):
+        best_len, best_pos = 0, 0
+        # Prefer continuing the previous copy; it costs the fewest bytes
+        cands = [src] if src < len(old) else []
+        cands += index.get(new[i:i + DELTA_KEY_LEN], [])
+        for pos in cands:
+            length = 0
+            limit = min(len(old) - pos, len(new) - i)
+            while length < limit and old[pos + length] == new[i + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_pos = length, pos
+                
+        if best_len >= DELTA_MIN_COPY:
+            flush_literal()
+            delta = best_pos - src
+            out.append(DELTA_OP_COPY)
+            out.extend(varint(delta * 2 if delta >= 0 else -delta * 2 - 1))
+            out.extend(varint(best_len))
+            src = best_pos + best_len
+            i += best_len
+        else:
+            literal.append(new[i])
+            i += 1
+            
+    flush_literal()
+    return bytes(out)
 
 
 def build_smp_packet(op, group, cmd_id, data=None, seq=0):
@@ -100,19 +268,46 @@ class DOTTFlasher:
     def _notification_handler(self, sender, data):
         self.responses.put_nowait(data)
         
-    async def smp_command(self, group, cmd, data=None, timeout=10.0):
-        """Send SMP command and wait for response."""
+    def _next_seq(self):
         self.seq = (self.seq + 1) % 256
-        packet = build_smp_packet(SMPOp.WRITE, group, cmd, data, self.seq)
+        return self.seq
         
+    async def _send(self, group, cmd, data, seq):
+        packet = build_smp_packet(SMPOp.WRITE, group, cmd, data, seq)
         await self.client.write_gatt_char(UUID_SMP_CHAR, packet, response=False)
         
+    async def _wait_response(self, timeout):
+        """Wait for the next SMP response, or (None, None) on timeout."""
         try:
             response = await asyncio.wait_for(self.responses.get(), timeout)
-            _, result = parse_smp_response(response)
-            return result
         except asyncio.TimeoutError:
-            return None
+            return None, None
+        return parse_smp_response(response)
+        
+    def _drain_responses(self):
+        while not self.responses.empty():
+            self.responses.get_nowait()
+        
+    async def smp_command(self, group, cmd, data=None, timeout=10.0):
+        """Send SMP command and wait for its response."""
+        seq = self._next_seq()
+        self._drain_responses()
+        await self._send(group, cmd, data, seq)
+        
+        loop = asyncio.get_running_loop()
+        deadline = loop.time() + timeout
+        while True:
+            hdr, result = await self._wait_response(max(0, deadline - loop.time()))
+            if hdr is None:
+                return None
+            if hdr['seq'] == seq:
+                return result
+                
+    def max_chunk_size(self):
+        """Largest upload data that keeps each SMP frame in one ATT write."""
+        mtu = getattr(self.client, 'mtu_size', 23) or 23
+        frame = min(mtu - 3, MAX_FRAME_SIZE)
+        return max(MIN_CHUNK_SIZE, frame - SMP_HEADER_SIZE - UPLOAD_OVERHEAD)
             
     async def get_image_state(self):
         """Get current firmware image state."""
@@ -123,8 +318,98 @@ class DOTTFlasher:
         print("Sending reset command...")
         return await self.smp_command(SMPGroup.OS, SMPCmd.OS_RESET)
         
-    async def upload_firmware(self, firmware_path):
-        """Upload firmware image via MCUmgr."""
+    async def _upload_stream(self, payload, group, cmd, first_fields, window, chunk_size,
+                             fields=None):
+        """
+        Pipelined upload of PAYLOAD with an img-style upload command.
+        Returns the final response, or None on failure.
+        """
+        total_size = len(payload)
+        
+        def request(offset):
+            req = dict(fields or {})
+            req["off"] = offset
+            req["data"] = payload[offset:offset + chunk_size]
+            # The first chunk carries the total length and hash. The device
+            # erases the slot here, or answers with its current offset when
+            # an upload of the same image was interrupted
+            if offset == 0:
+                req.update(first_fields)
+            return req
+        
+        # Send the first chunk alone: it can take seconds (slot erase) and
+        # tells us where to resume
+        result = await self.smp_command(group, cmd, request(0), timeout=60)
+        if result is None:
+            print("Error: No response to first chunk")
+            return None
+        if result.get('rc', 0) != 0:
+            print(f"Error: Upload failed with rc={result.get('rc')}")
+            return None
+            
+        acked = result.get('off', min(chunk_size, total_size))
+        if acked > chunk_size:
+            print(f"Resuming at offset {acked}")
+        
+        loop = asyncio.get_running_loop()
+        started = loop.time()
+        in_flight = {}  # seq -> offset the device should expect next
+        next_off = acked
+        retries = 0
+        
+        while acked < total_size:
+            while len(in_flight) < window and next_off < total_size:
+                seq = self._next_seq()
+                req = request(next_off)
+                await self._send(group, cmd, req, seq)
+                next_off += len(req["data"])
+                in_flight[seq] = next_off
+                
+            # The last chunk waits for the device to build and hash the image
+            hdr, result = await self._wait_response(5.0 if next_off < total_size else 60.0)
+            
+            if hdr is None:
+                retries += 1
+                if retries > UPLOAD_RETRIES:
+                    print(f"\n\nError: No response at offset {acked}")
+                    return None
+                # Lost write or notification: restart the window from the
+                # last offset the device confirmed
+                in_flight.clear()
+                next_off = acked
+                continue
+                
+            expected = in_flight.pop(hdr['seq'], None)
+            if expected is None:
+                continue  # Response to a request from before a rewind
+                
+            rc = result.get('rc', 0)
+            if rc != 0:
+                print(f"\n\nError: Upload failed with rc={rc} at offset {acked}")
+                print(f"Response: {result}")
+                return None
+                
+            off = result.get('off', expected)
+            retries = 0
+            acked = max(acked, off)
+            
+            if off != expected:
+                # Device dropped a chunk and told us where it is
+                in_flight.clear()
+                next_off = off
+                
+            elapsed = max(loop.time() - started, 0.001)
+            progress = (acked / total_size) * 100
+            print(f"\rUploading: {progress:5.1f}% ({acked}/{total_size} bytes, "
+                  f"{acked / elapsed / 1024:.1f} KB/s)", end="", flush=True)
+            
+        print(f"\rUploading: 100.0% ({total_size}/{total_size} bytes) in "
+              f"{loop.time() - started:.1f}s" + " " * 12)
+        return result
+        
+    async def upload_firmware(self, firmware_path, window=DEFAULT_WINDOW, chunk_size=None,
+                              compress=False, base_path=None):
+        """Upload firmware image via MCUmgr with pipelined chunks."""
         print(f"\n{'='*60}")
         print("FIRMWARE UPLOAD")
         print('='*60)
@@ -134,58 +419,57 @@ class DOTTFlasher:
             
         total_size = len(firmware_data)
         sha256 = hashlib.sha256(firmware_data).digest()
+        chunk_size = chunk_size or self.max_chunk_size()
         
         print(f"Firmware: {firmware_path}")
         print(f"Size: {total_size} bytes ({total_size/1024:.1f} KB)")
         print(f"SHA256: {sha256.hex()[:16]}...")
-        print()
-        
-        # MCUmgr image upload uses chunked transfer
-        # Each chunk has: image number, offset, data, and optionally length + sha for first chunk
         
-        chunk_size = 128  # Conservative for BLE MTU
-        offset = 0
-        image_num = 0  # Slot 0 for main image
+        patch = None
+        if base_path:
+            with open(base_path, 'rb') as f:
+                base_data = f.read()
+            patch = delta_encode(base_data, firmware_data)
+            print(f"Delta against {base_path}: {len(patch)} bytes")
+            if len(patch) > DELTA_MAX_SIZE:
+                print(f"Patch exceeds the {DELTA_MAX_SIZE}-byte scratch partition, "
+                      "sending a compressed image instead")
+                patch = None
+                compress = True
         
-        while offset < total_size:
-            chunk = firmware_data[offset:offset + chunk_size]
-            
-            # Build upload request
-            req = {
-                "image": image_num,
-                "off": offset,
-                "data": chunk,
-            }
-            
-            # First chunk includes total length and hash
-            if offset == 0:
-                req["len"] = total_size
-                req["sha"] = sha256
-                
-            # Progress
-            progress = (offset / total_size) * 100
-            print(f"\rUploading: {progress:5.1f}% ({offset}/{total_size} bytes)", end="", flush=True)
-            
-            # Send chunk
-            result = await self.smp_command(SMPGroup.IMAGE, SMPCmd.IMG_UPLOAD, req, timeout=30)
+        if patch is not None:
+            # Device checks BASE against slot0, spools the patch into scratch
+            # and rebuilds the image into slot1 once it has all of it
+            payload = patch
+            group, cmd = SMPGroup.OPENDOTT, SMPCmd.OTA_UPLOAD_DELTA
+            first = {"len": len(payload), "ulen": total_size, "sha": sha256,
+                     "base": hashlib.sha256(base_data).digest(), "blen": len(base_data)}
+            fields = None
+        elif compress:
+            # Device expands the stream into slot1 and checks the SHA256 of
+            # the result before marking it for a test boot
+            payload = lz_compress(firmware_data)
+            print(f"Compressed: {len(payload)} bytes ({len(payload) * 100 / total_size:.0f}%)")
+            group, cmd = SMPGroup.OPENDOTT, SMPCmd.OTA_UPLOAD_LZ
+            first = {"len": len(payload), "ulen": total_size, "sha": sha256}
+            fields = None
+        else:
+            payload = firmware_data
+            group, cmd = SMPGroup.IMAGE, SMPCmd.IMG_UPLOAD
+            first = {"len": total_size, "sha": sha256}
+            fields = {"image": 0}  # Slot 0 for main image
             
-            if result is None:
-                print(f"\n\nError: No response at offset {offset}")
-                return False
-                
-            rc = result.get('rc', -1)
-            if rc != 0:
-                print(f"\n\nError: Upload failed with rc={rc} at offset {offset}")
-                print(f"Response: {result}")
-                return False
-                
-            # Get next offset from response (device tells us where to continue)
-            next_off = result.get('off', offset + len(chunk))
-            offset = next_off
+        print(f"Chunk: {chunk_size} bytes, window: {window}")
+        print()
+        
+        result = await self._upload_stream(payload, group, cmd, first, window, chunk_size, fields)
+        if result is None:
+            return False
             
-            await asyncio.sleep(0.01)  # Small delay
+        if group == SMPGroup.OPENDOTT and not result.get('match'):
+            print("\nError: Device did not confirm the image hash")
+            return False
             
-        print(f"\rUploading: 100.0% ({total_size}/{total_size} bytes)")
         print("\n✓ Upload complete!")
         
         # Verify
@@ -243,7 +527,8 @@ async def cmd_info(address):
         await flasher.disconnect()
 
 
-async def cmd_flash(address, firmware_path):
+async def cmd_flash(address, firmware_path, window=DEFAULT_WINDOW, chunk_size=None,
+                    compress=False, base_path=None):
     """Flash firmware to device."""
     if not os.path.exists(firmware_path):
         print(f"Error: File not found: {firmware_path}")
@@ -253,7 +538,8 @@ async def cmd_flash(address, firmware_path):
     try:
         await flasher.connect()
         
-        success = await flasher.upload_firmware(firmware_path)
+        success = await flasher.upload_firmware(firmware_path, window, chunk_size, compress,
+                                                base_path)
         
         if success:
             print("\n" + "="*60)
@@ -288,6 +574,15 @@ async def main():
     parser.add_argument('command', choices=['info', 'flash', 'reset'])
     parser.add_argument('file', nargs='?', help='Firmware file for flash command')
     parser.add_argument('-a', '--address', help='Device address')
+    parser.add_argument('-w', '--window', type=int, default=DEFAULT_WINDOW,
+                        help=f'Upload requests in flight (default {DEFAULT_WINDOW})')
+    parser.add_argument('-c', '--chunk', type=int,
+                        help='Data bytes per upload request (default: fit the MTU)')
+    parser.add_argument('-z', '--compress', action='store_true',
+                        help='Send an LZ-compressed image (OpenDOTT firmware only)')
+    parser.add_argument('-b', '--base',
+                        help='Send a delta against this image, which must be the '
+                             'confirmed one on the device (OpenDOTT firmware only)')
     
     args = parser.parse_args()
     
@@ -301,7 +596,8 @@ async def main():
         if not args.file:
             print("Error: flash requires firmware file")
             return
-        await cmd_flash(address, args.file)
+        await cmd_flash(address, args.file, max(1, args.window), args.chunk, args.compress,
+                        args.base)
     elif args.command == 'reset':
         await cmd_reset(address)
 
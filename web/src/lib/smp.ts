@@ -24,6 +24,14 @@ const CMD_IMAGE_LIST = 0x00;
 const CMD_IMAGE_UPLOAD = 0x01;
 const CMD_IMAGE_ERASE = 0x05;
 
+// Image upload tuning. Each request carries as much data as fits in one
+// ATT write at the firmware's 498-byte MTU (SMP header + CBOR keys take the
+// rest), and up to UPLOAD_WINDOW requests are in flight at once.
+const UPLOAD_CHUNK_SIZE = 400;
+const UPLOAD_MIN_CHUNK_SIZE = 128;
+const UPLOAD_WINDOW = 4;
+const UPLOAD_RETRIES = 5;
+
 // Simple CBOR encoder for our needs
 function encodeCBOR(obj: Record<string, unknown>): Uint8Array {
   const entries = Object.entries(obj);
@@ -253,21 +261,49 @@ export class SMPClient {
     this.notifications = [];
     await this.char.writeValueWithoutResponse(packet as unknown as BufferSource);
     
-    // Wait for response
+    return this.waitNotification(timeoutMs);
+  }
+
+  private async waitNotification(timeoutMs: number): Promise<Uint8Array | null> {
     const start = Date.now();
     while (Date.now() - start < timeoutMs) {
       if (this.notifications.length > 0) {
         return this.notifications.shift()!;
       }
-      await new Promise(r => setTimeout(r, 50));
+      await new Promise(r => setTimeout(r, 5));
     }
     return null;
   }
 
+  private nextSeq(): number {
+    const seq = this.seq;
+    this.seq = (this.seq + 1) & 0xff;
+    return seq;
+  }
+
+  private buildUpload(firmware: Uint8Array, offset: number, chunkSize: number, hash: Uint8Array, seq: number): { packet: Uint8Array; length: number } {
+    const chunk = firmware.slice(offset, Math.min(offset + chunkSize, firmware.length));
+    const payloadObj: Record<string, unknown> = {
+      'off': offset,
+      'data': chunk,
+    };
+    
+    // Only the first chunk carries 'len' and 'sha'. The device erases the
+    // slot on it, or answers with its current offset when an upload of the
+    // same image was interrupted (resume)
+    if (offset === 0) {
+      payloadObj['len'] = firmware.length;
+      payloadObj['sha'] = hash;
+    }
+    
+    const packet = buildSMPPacket(OP_WRITE, GROUP_IMAGE, CMD_IMAGE_UPLOAD, encodeCBOR(payloadObj), seq);
+    return { packet, length: chunk.length };
+  }
+
   async listImages(): Promise<{ slot: number; version: string; hash: Uint8Array; active: boolean; pending: boolean; confirmed: boolean }[] | null> {
     this.log('Listing firmware images...');
     
-    const packet = buildSMPPacket(OP_READ, GROUP_IMAGE, CMD_IMAGE_LIST, new Uint8Array(0), this.seq++);
+    const packet = buildSMPPacket(OP_READ, GROUP_IMAGE, CMD_IMAGE_LIST, new Uint8Array(0), this.nextSeq());
     const response = await this.sendAndWait(packet);
     
     if (!response) {
@@ -328,69 +364,111 @@ export class SMPClient {
     const firmwareHash = await sha256(firmware);
     this.log(`Firmware hash: ${Array.from(firmwareHash.slice(0, 8)).map(b => b.toString(16).padStart(2, '0')).join('')}...`);
     
-    const CHUNK_SIZE = 128;  // Bytes per packet (conservative for BLE)
-    let offset = 0;
-    let lastPercent = -1;
+    let chunkSize = UPLOAD_CHUNK_SIZE;
+    let acked = -1;
     
-    while (offset < firmware.length) {
-      const chunk = firmware.slice(offset, Math.min(offset + CHUNK_SIZE, firmware.length));
-      
-      // Build upload packet with CBOR payload
-      // First chunk needs image length, subsequent chunks don't
-      const payloadObj: Record<string, unknown> = {
-        'off': offset,
-        'data': chunk,
-      };
+    // First chunk goes alone: the slot erase can take seconds, and the
+    // response tells us where to resume
+    while (acked < 0) {
+      let response: Uint8Array | null = null;
+      try {
+        const { packet } = this.buildUpload(firmware, 0, chunkSize, firmwareHash, this.nextSeq());
+        response = await this.sendAndWait(packet, 30000);
+      } catch (e) {
+        if (chunkSize <= UPLOAD_MIN_CHUNK_SIZE) {
+          this.log(`Upload failed: ${(e as Error).message}`);
+          return { success: false, hash: null };
+        }
+        // Write larger than the negotiated MTU
+        chunkSize = Math.max(UPLOAD_MIN_CHUNK_SIZE, chunkSize >> 1);
+        this.log(`Write rejected, retrying with ${chunkSize}-byte chunks`);
+        continue;
+      }
       
-      // Only include 'len' and 'sha' on first chunk
-      if (offset === 0) {
-        payloadObj['len'] = firmware.length;
-        payloadObj['sha'] = firmwareHash;
+      if (!response) {
+        this.log('Upload failed: no response to first chunk');
+        return { success: false, hash: null };
       }
       
-      const payload = encodeCBOR(payloadObj);
-      const packet = buildSMPPacket(OP_WRITE, GROUP_IMAGE, CMD_IMAGE_UPLOAD, payload, this.seq++);
+      const parsed = parseSMPResponse(response);
+      console.log('[SMP] First upload response:', JSON.stringify(parsed.payload));
       
-      // First chunk needs longer timeout (device allocates flash)
-      const timeout = offset === 0 ? 30000 : 10000;
+      if (parsed.payload['rc'] !== undefined && parsed.payload['rc'] !== 0) {
+        this.log(`Upload failed at offset 0: rc=${parsed.payload['rc']}`);
+        return { success: false, hash: null };
+      }
       
-      // Retry logic for transient failures
-      let response: Uint8Array | null = null;
-      for (let retry = 0; retry < 3; retry++) {
-        response = await this.sendAndWait(packet, timeout);
-        if (response) break;
-        if (retry < 2) {
-          this.log(`Retry ${retry + 1} at offset ${offset}...`);
-          await new Promise(r => setTimeout(r, 500));
+      acked = (parsed.payload['off'] as number | undefined) ?? Math.min(chunkSize, firmware.length);
+      if (acked > chunkSize) {
+        this.log(`Resuming upload at offset ${acked}`);
+      }
+    }
+    
+    // Pipelined upload: keep a window of requests in flight, matched to
+    // responses by sequence number. The device answers each with the offset
+    // it expects next; if that is not where the request ended, a chunk was
+    // dropped and we rewind to the device's offset.
+    const inFlight = new Map<number, number>();  // seq -> expected next offset
+    const started = Date.now();
+    let nextOff = acked;
+    let retries = 0;
+    let lastPercent = -1;
+    
+    while (acked < firmware.length) {
+      try {
+        while (inFlight.size < UPLOAD_WINDOW && nextOff < firmware.length) {
+          const seq = this.nextSeq();
+          const { packet, length } = this.buildUpload(firmware, nextOff, chunkSize, firmwareHash, seq);
+          await this.char!.writeValueWithoutResponse(packet as unknown as BufferSource);
+          nextOff += length;
+          inFlight.set(seq, nextOff);
         }
+      } catch (e) {
+        if (chunkSize <= UPLOAD_MIN_CHUNK_SIZE) {
+          this.log(`Upload failed at offset ${acked}: ${(e as Error).message}`);
+          return { success: false, hash: null };
+        }
+        chunkSize = Math.max(UPLOAD_MIN_CHUNK_SIZE, chunkSize >> 1);
+        this.log(`Write rejected, retrying with ${chunkSize}-byte chunks`);
+        inFlight.clear();
+        nextOff = acked;
+        continue;
       }
       
+      const response = await this.waitNotification(5000);
       if (!response) {
-        this.log(`Upload failed at offset ${offset}: no response after 3 retries`);
-        return { success: false, hash: null };
+        if (++retries > UPLOAD_RETRIES) {
+          this.log(`Upload failed at offset ${acked}: no response after ${UPLOAD_RETRIES} retries`);
+          return { success: false, hash: null };
+        }
+        this.log(`Retry ${retries} at offset ${acked}...`);
+        inFlight.clear();
+        nextOff = acked;
+        continue;
       }
       
       const parsed = parseSMPResponse(response);
-      
-      // Log first response for debugging
-      if (offset === 0) {
-        console.log('[SMP] First upload response:', JSON.stringify(parsed.payload));
+      const expected = inFlight.get(parsed.seq);
+      if (expected === undefined) {
+        continue;  // Response to a request sent before a rewind
       }
+      inFlight.delete(parsed.seq);
       
       if (parsed.payload['rc'] !== undefined && parsed.payload['rc'] !== 0) {
-        this.log(`Upload failed at offset ${offset}: rc=${parsed.payload['rc']}`);
+        this.log(`Upload failed at offset ${acked}: rc=${parsed.payload['rc']}`);
         return { success: false, hash: null };
       }
       
-      // Check if device reports different offset (resume support)
-      const nextOff = parsed.payload['off'] as number | undefined;
-      if (nextOff !== undefined && nextOff > offset) {
-        offset = nextOff;
-      } else {
-        offset += chunk.length;
+      const off = (parsed.payload['off'] as number | undefined) ?? expected;
+      retries = 0;
+      acked = Math.max(acked, off);
+      
+      if (off !== expected) {
+        inFlight.clear();
+        nextOff = off;
       }
       
-      const percent = Math.floor((offset / firmware.length) * 100);
+      const percent = Math.floor((acked / firmware.length) * 100);
       onProgress?.(percent);
       
       // Log progress at each percent change
@@ -400,7 +478,8 @@ export class SMPClient {
       }
     }
     
-    this.log('Firmware upload complete');
+    const seconds = (Date.now() - started) / 1000;
+    this.log(`Firmware upload complete (${seconds.toFixed(1)} s, ${(firmware.length / 1024 / Math.max(seconds, 0.001)).toFixed(1)} KB/s)`);
     
     return { success: true, hash: firmwareHash };
   }
@@ -409,7 +488,7 @@ export class SMPClient {
     this.log('Resetting device...');
     
     // Use OS group reset command (not Image group)
-    const packet = buildSMPPacket(OP_WRITE, GROUP_OS, CMD_OS_RESET, new Uint8Array(0), this.seq++);
+    const packet = buildSMPPacket(OP_WRITE, GROUP_OS, CMD_OS_RESET, new Uint8Array(0), this.nextSeq());
     await this.char?.writeValueWithoutResponse(packet as unknown as BufferSource);
     
     // Device will disconnect, so we don't wait for response
@@ -421,7 +500,7 @@ export class SMPClient {
     this.log(`Erasing slot ${slot}...`);
     
     const payload = encodeCBOR({ 'slot': slot });
-    const packet = buildSMPPacket(OP_WRITE, GROUP_IMAGE, CMD_IMAGE_ERASE, payload, this.seq++);
+    const packet = buildSMPPacket(OP_WRITE, GROUP_IMAGE, CMD_IMAGE_ERASE, payload, this.nextSeq());
     const response = await this.sendAndWait(packet, 30000);  // Erase can take time
     
     if (!response) {